@@ -19,6 +19,7 @@ void ProcessorAPI::Flush()
 	LogicProvider()->ResetCurrentContextState();
 	CommandSet()->ResetCommandSet();
 	MMU()->ResetEverything();
+	modules_.clear();
 
 	for( unsigned i = 0; i <= Value::V_MAX; ++i ) {
 		Executor( static_cast<Value::Type>( i ) )->ResetImplementations();
@@ -52,7 +53,15 @@ void ProcessorAPI::DeleteContext( ctx_t id )
 	verify_method;
 
 	cassert( CurrentContext().buffer != id, "Attempt to deallocate currently selected context buffer %zu", id );
+
+	if( stream_.context == id ) {
+		msg( E_WARNING, E_VERBOSE, "Abandoning the stream of context %zu", id );
+		Reader()->RdReset();
+		stream_.context = 0;
+	}
+
 	MMU()->ReleaseContextBuffer( id );
+	modules_.erase( id );
 }
 
 void ProcessorAPI::DeleteCurrentContext()
@@ -73,25 +82,81 @@ void ProcessorAPI::DeleteCurrentContext()
 	} while( new_context_buffer == current_context_buffer );
 
 	MMU()->ReleaseContextBuffer( current_context_buffer );
+	modules_.erase( current_context_buffer );
 	msg( E_INFO, E_DEBUG, "Context buffer %zu deleted (new is %zu). %zu frames removed.",
 		 current_context_buffer, new_context_buffer, frames_erased );
 }
 
-ctx_t ProcessorAPI::Load( FILE* file )
+void ProcessorAPI::LoadBinarySection( IReader* reader, const std::pair<MemorySectionIdentifier, size_t>& section_info )
 {
-	verify_method;
-
 	IMMU* mmu = MMU();
-	ILogic* logic = LogicProvider();
 
-	ctx_t allocated_ctx = mmu->AllocateContextBuffer();
-	logic->SwitchToContextBuffer( allocated_ctx );
-	msg( E_INFO, E_VERBOSE, "Loading from stream -> context %zu", allocated_ctx );
+	if( section_info.first.SectionType() == SEC_SYMBOL_MAP || section_info.first.SectionType() == SEC_SYMBOL_TABLE ) {
+		msg( E_INFO, E_DEBUG, "Reading symbols section: %zu records", section_info.second );
 
-	IReader* reader = Reader();
-	cassert( reader, "Loader module is not attached" );
+		symbol_map external_symbols = reader->ReadSymbols();
+		cassert( external_symbols.size() == section_info.second, "Invalid symbol map size: %zu",
+		         external_symbols.size() );
+		mmu->SetSymbolImage( std::move( external_symbols ) );
+	}
+
+	else if( section_info.first.SectionType() == SEC_SYMBOL_NAMES ) {
+		msg( E_INFO, E_DEBUG, "Skipping symbol names: read along with the symbol table" );
+	}
+
+	else if( section_info.first.SectionType() == SEC_NATIVE_IMAGE ) {
+		msg( E_INFO, E_DEBUG, "Reading native image: %zu bytes", section_info.second );
+
+		llarray image = reader->ReadSectionImage();
+		IBackend* backend = Backend();
+
+		// The image is relocated when the context is compiled, if its checksum still matches.
+		if( !backend ) {
+			msg( E_INFO, E_VERBOSE, "Skipping native image: no backend is attached" );
+		} else if( !backend->ImportImage( LogicProvider()->ChecksumState(), image, image.size() ) ) {
+			msg( E_WARNING, E_USER, "Native image was not accepted by the backend, the context will be compiled anew" );
+		}
+	}
+
+	else {
+		msg( E_INFO, E_DEBUG, "Reading section type \"%s\": %zu records",
+		     ProcDebug::Print( section_info.first.SectionType() ).c_str(),
+			 section_info.second );
+
+		// Use the image in place (copied by the MMU only when the section is resized)
+		// if the reader can provide it and there is nothing to append it to.
+		MemorySectionType section_type = section_info.first.SectionType();
+		bool image_is_empty = section_info.second && !mmu->QuerySectionLimits().at( section_info.first );
+
+		// With LO_LAZY_SECTIONS, DATA and BYTEPOOL are read page by page when accessed.
+		if( ( linker_options_ & MASK( LO_LAZY_SECTIONS ) ) && image_is_empty &&
+		    ( section_type == SEC_DATA_IMAGE || section_type == SEC_BYTEPOOL_IMAGE ) ) {
+			if( section_source_t source = reader->DeferSectionImage() ) {
+				mmu->DeferSection( section_info.first, section_info.second, source );
+				return;
+			}
+		}
+
+		std::shared_ptr<void> backing;
+		void* mapped_image = nullptr;
+		if( ( section_type == SEC_CODE_IMAGE || section_type == SEC_DATA_IMAGE || section_type == SEC_BYTEPOOL_IMAGE ) &&
+		    image_is_empty ) {
+			mapped_image = reader->MapSectionImage( &backing );
+		}
+
+		if( mapped_image ) {
+			mmu->AdoptSection( section_info.first, mapped_image, section_info.second, backing );
+		} else {
+			llarray image_section_buffer = reader->ReadSectionImage();
+			mmu->AppendSection( section_info.first, image_section_buffer, section_info.second );
+		}
+	}
+}
+
+void ProcessorAPI::LoadContents( IReader* reader, FileType file_type )
+{
+	IMMU* mmu = MMU();
 
-	FileType file_type = reader->RdSetup( file );
 	switch( file_type ) {
 	case FT_BINARY: {
 
@@ -100,23 +165,7 @@ ctx_t ProcessorAPI::Load( FILE* file )
 		msg( E_INFO, E_DEBUG, "Loading binary file absolute image" );
 
 		while( ( section_info = reader->NextSection() ).first ) {
-			if( section_info.first.SectionType() == SEC_SYMBOL_MAP ) {
-				msg( E_INFO, E_DEBUG, "Reading symbols section: %zu records", section_info.second );
-
-				symbol_map external_symbols = reader->ReadSymbols();
-				cassert( external_symbols.size() == section_info.second, "Invalid symbol map size: %zu",
-				         external_symbols.size() );
-				mmu->SetSymbolImage( std::move( external_symbols ) );
-			}
-
-			else {
-				msg( E_INFO, E_DEBUG, "Reading section type \"%s\": %zu records",
-				     ProcDebug::Print( section_info.first.SectionType() ).c_str(),
-					 section_info.second );
-
-				llarray image_section_buffer = reader->ReadSectionImage();
-				mmu->AppendSection( section_info.first, image_section_buffer, section_info.second );
-			}
+			LoadBinarySection( reader, section_info );
 		} // while (next section)
 
 		msg( E_INFO, E_DEBUG, "Binary file read completed" );
@@ -153,6 +202,11 @@ ctx_t ProcessorAPI::Load( FILE* file )
 				mmu->AppendSection( SEC_DATA_IMAGE, result->data.data(), result->data.size() );
 			}
 
+			if( result->data_reserved ) {
+				msg( E_INFO, E_DEBUG, "Reserving data: %zu", result->data_reserved );
+				mmu->AppendSection( SEC_DATA_RESERVE, &result->data_reserve_pattern, result->data_reserved );
+			}
+
 			if( !result->bytepool.empty() ) {
 				msg( E_INFO, E_DEBUG, "Adding bytepool data: %zu bytes", result->bytepool.size() );
 				mmu->AppendSection( SEC_BYTEPOOL_IMAGE, result->bytepool.data(), result->bytepool.size() );
@@ -163,6 +217,10 @@ ctx_t ProcessorAPI::Load( FILE* file )
 		msg( E_INFO, E_DEBUG, "Stream decode completed - committing symbols" );
 		linker->DirectLink_Commit();
 
+		if( linker_options_ & MASK( LO_MERGE_STRINGS ) ) {
+			linker->MergeStrings();
+		}
+
 		break;
 
 	} // stream file
@@ -175,6 +233,34 @@ ctx_t ProcessorAPI::Load( FILE* file )
 		casshole( "Switch error" );
 		break;
 	} // switch (file_type)
+}
+
+ctx_t ProcessorAPI::Load( FILE* file )
+{
+	verify_method;
+
+	IMMU* mmu = MMU();
+	ILogic* logic = LogicProvider();
+
+	IReader* reader = Reader();
+	cassert( reader, "Loader module is not attached" );
+	cassert( !stream_.context, "Cannot load while context %zu is being streamed", stream_.context );
+
+	ctx_t allocated_ctx = mmu->AllocateContextBuffer();
+	logic->SwitchToContextBuffer( allocated_ctx );
+	msg( E_INFO, E_VERBOSE, "Loading from stream -> context %zu", allocated_ctx );
+
+	// A failed load leaves no trace: neither the context nor the reader state.
+	try {
+		LoadContents( reader, reader->RdSetup( file ) );
+	}
+
+	catch( ... ) {
+		reader->RdReset();
+		logic->RestoreCurrentContext();
+		mmu->ReleaseContextBuffer( allocated_ctx );
+		throw;
+	}
 
 	msg( E_INFO, E_VERBOSE, "Loading completed" );
 	reader->RdReset();
@@ -183,6 +269,70 @@ ctx_t ProcessorAPI::Load( FILE* file )
 	return allocated_ctx;
 }
 
+ctx_t ProcessorAPI::LoadStreamBegin( FILE* file )
+{
+	verify_method;
+
+	IMMU* mmu = MMU();
+	ILogic* logic = LogicProvider();
+
+	IReader* reader = Reader();
+	cassert( reader, "Loader module is not attached" );
+	cassert( !stream_.context, "Context %zu is already being streamed", stream_.context );
+
+	ctx_t allocated_ctx = mmu->AllocateContextBuffer();
+	logic->SwitchToContextBuffer( allocated_ctx );
+	msg( E_INFO, E_VERBOSE, "Streaming from file -> context %zu", allocated_ctx );
+
+	FileType file_type = reader->RdSetup( file );
+	logic->RestoreCurrentContext();
+
+	if( file_type != FT_BINARY ) {
+		reader->RdReset();
+		mmu->ReleaseContextBuffer( allocated_ctx );
+		casshole( "Only binary files can be streamed" );
+	}
+
+	stream_.context = allocated_ctx;
+	stream_.code_loaded = 0;
+
+	while( !stream_.code_loaded && LoadStreamStep() );
+
+	msg( E_INFO, E_VERBOSE, "Context %zu is ready: %zu commands loaded", allocated_ctx, stream_.code_loaded );
+	return allocated_ctx;
+}
+
+bool ProcessorAPI::LoadStreamStep()
+{
+	verify_method;
+
+	if( !stream_.context ) {
+		return false;
+	}
+
+	ILogic* logic = LogicProvider();
+	IReader* reader = Reader();
+	cassert( reader, "Reader of the streamed context %zu is not attached", stream_.context );
+
+	logic->SwitchToContextBuffer( stream_.context );
+
+	std::pair<MemorySectionIdentifier, size_t> section_info = reader->NextSection();
+	if( section_info.first ) {
+		LoadBinarySection( reader, section_info );
+
+		if( section_info.first.SectionType() == SEC_CODE_IMAGE ) {
+			stream_.code_loaded += section_info.second;
+		}
+	} else {
+		msg( E_INFO, E_VERBOSE, "Streaming of context %zu completed", stream_.context );
+		reader->RdReset();
+		stream_.context = 0;
+	}
+
+	logic->RestoreCurrentContext();
+	return stream_.context;
+}
+
 void ProcessorAPI::Dump( ctx_t id, FILE* file )
 {
 	verify_method;
@@ -192,7 +342,16 @@ void ProcessorAPI::Dump( ctx_t id, FILE* file )
 	IWriter* writer = Writer();
 	cassert( writer, "Writer module is not attached" );
 	writer->WrSetup( file );
-	writer->Write( id );
+
+	try {
+		writer->Write( id );
+	}
+
+	catch( ... ) {
+		writer->WrReset();
+		throw;
+	}
+
 	writer->WrReset();
 }
 
@@ -206,37 +365,222 @@ ctx_t ProcessorAPI::MergeContexts( const std::vector<ctx_t>& contexts )
 	msg( E_INFO, E_VERBOSE, "Merging %zu context buffers", contexts.size() );
 
 	ctx_t result_ctx = mmu->AllocateContextBuffer();
+
+	// Lay out the result up front: each context is placed right after the preceding ones.
+	std::vector<Offsets> placement( contexts.size() ), limits( contexts.size() );
+	std::vector<symbol_map> symbols( contexts.size() );
+	Offsets total;
+	size_t trailing_reserve = 0;
+
+	for( size_t i = 0; i < contexts.size(); ++i ) {
+		logic->SwitchToContextBuffer( contexts[i] );
+		limits[i] = mmu->QuerySectionLimits();
+		symbols[i] = mmu->DumpSymbolImage();
+		if( i + 1 == contexts.size() ) {
+			trailing_reserve = mmu->QueryReservedData( nullptr );
+		}
+		logic->RestoreCurrentContext();
+
+		placement[i] = total;
+		total.Code() += limits[i].Code();
+		total.Data() += limits[i].Data();
+		total.Bytepool() += limits[i].Bytepool();
+	}
+
 	logic->SwitchToContextBuffer( result_ctx );
 	linker->DirectLink_Init();
 
-	for( std::vector<ctx_t>::const_reverse_iterator it = contexts.crbegin(); it != contexts.crend(); ++it ) {
-		ctx_t source_ctx = *it;
-		msg( E_INFO, E_VERBOSE, "Adding context buffer %zu", source_ctx );
+	// The reserved DATA of the last context stays the (unallocated) tail of the result.
+	mmu->ResizeSection( SEC_CODE_IMAGE, total.Code() );
+	mmu->ResizeSection( SEC_DATA_IMAGE, total.Data() - trailing_reserve );
+	mmu->ResizeSection( SEC_BYTEPOOL_IMAGE, total.Bytepool() );
 
-		logic->SwitchToContextBuffer( source_ctx );
+	// Copy and relocate each context once.
+	std::vector<LinkedModule> modules( contexts.size() );
 
-		Offsets source_limits = mmu->QuerySectionLimits();
+	for( size_t i = 0; i < contexts.size(); ++i ) {
+		msg( E_INFO, E_VERBOSE, "Adding context buffer %zu", contexts[i] );
 
-		msg( E_INFO, E_DEBUG, "Reading source context symbol map" );
-		symbol_map src_symbols = mmu->DumpSymbolImage();
+		mmu->PasteFromContext( contexts[i], placement[i] );
 
-		logic->RestoreCurrentContext();
+		modules[i].id = contexts[i];
+		modules[i].at = placement[i];
+		modules[i].limits = limits[i];
+		for( const symbol_map::value_type& symbol_record: symbols[i] ) {
+			if( symbol_record.second.second.is_resolved ) {
+				modules[i].defined_symbols.push_back( symbol_record.first );
+			}
+		}
 
-		// Relocate dest section to free space for pasting
-		mmu->ShiftImages( source_limits );
-		mmu->PasteFromContext( source_ctx );
+		if( linker_jobs_ <= 1 ) {
+			linker->Relocate( symbols[i], placement[i], limits[i].Code() );
+			linker->MergeLink_Add( std::move( symbols[i] ) );
+		}
+	}
+
+	if( linker_jobs_ > 1 ) {
+		std::vector<size_t> code_counts;
+		for( const Offsets& context_limits: limits ) {
+			code_counts.push_back( context_limits.Code() );
+		}
 
-		linker->Relocate( source_limits );
-		linker->MergeLink_Add( std::move( src_symbols ) );
+		linker->MergeLink_AddParallel( std::move( symbols ), placement, code_counts, linker_jobs_ );
 	}
 
 	linker->DirectLink_Commit();
+
+	// Merged strings are shared between the modules, so they cannot be replaced separately.
+	if( linker_options_ & MASK( LO_MERGE_STRINGS ) ) {
+		linker->MergeStrings();
+	} else {
+		modules_[result_ctx] = std::move( modules );
+	}
+
 	logic->RestoreCurrentContext();
 
 	msg( E_INFO, E_VERBOSE, "Merging completed" );
 	return result_ctx;
 }
 
+void ProcessorAPI::ReplaceModule( ctx_t module, FILE* file )
+{
+	verify_method;
+
+	IMMU* mmu = MMU();
+	ILinker* linker = Linker();
+	ILogic* logic = LogicProvider();
+
+	ctx_t merged_ctx = 0;
+	LinkedModule* record = nullptr;
+
+	for( std::pair<const ctx_t, std::vector<LinkedModule> >& merged: modules_ ) {
+		for( LinkedModule& candidate: merged.second ) {
+			if( candidate.id == module ) {
+				cverify( !record, "Module %zu is merged into both contexts %zu and %zu", module, merged_ctx, merged.first );
+				merged_ctx = merged.first;
+				record = &candidate;
+			}
+		}
+	}
+
+	cverify( record, "Context %zu is not a module of any merged context", module );
+	cverify( !stream_.context, "Cannot replace a module while context %zu is being streamed", stream_.context );
+
+	msg( E_INFO, E_VERBOSE, "Replacing module %zu of context %zu", module, merged_ctx );
+
+	logic->SwitchToContextBuffer( merged_ctx );
+	size_t old_checksum = logic->ChecksumState();
+	Offsets total = mmu->QuerySectionLimits();
+	symbol_map linked = mmu->DumpSymbolImage();
+	logic->RestoreCurrentContext();
+
+	ctx_t new_ctx = Load( file ), scratch_ctx = 0;
+	bool switched = false;
+
+	// The merged context is not changed until the new module is known to link.
+	// The loaded module and the scratch buffer are released, and the current context restored, on every path.
+	try {
+		logic->SwitchToContextBuffer( new_ctx );
+		switched = true;
+		Offsets limits = mmu->QuerySectionLimits();
+		symbol_map symbols = mmu->DumpSymbolImage();
+		logic->RestoreCurrentContext();
+		switched = false;
+
+		// Reuse each of the old ranges if the new module fits there or if it is the last one (then it is extended);
+		// otherwise the module is appended, and the old range is left unused.
+		Offsets placement;
+		for( MemorySectionType section: { SEC_CODE_IMAGE, SEC_DATA_IMAGE, SEC_BYTEPOOL_IMAGE } ) {
+			MemorySectionIdentifier id( section );
+			bool reuse = ( limits[id] <= record->limits[id] ) || ( record->at[id] + record->limits[id] == total[id] );
+			placement[id] = reuse ? record->at[id] : total[id];
+		}
+
+		msg( E_INFO, E_DEBUG, "Placing module: code at %zu, data at %zu, bytepool at %zu",
+		     placement.Code(), placement.Data(), placement.Bytepool() );
+
+		// Turn the old definitions into usages, so that the new ones replace them on linking.
+		std::unordered_set<size_t> old_definitions( record->defined_symbols.begin(), record->defined_symbols.end() );
+		symbol_map relinked;
+		relinked.reserve( linked.size() );
+
+		for( const symbol_map::value_type& symbol_record: linked ) {
+			if( old_definitions.count( symbol_record.first ) ) {
+				const SymbolName& name = symbol_record.second.first;
+				relinked.insert( symbol_record.first, name.c_str(), name.size(), Symbol( symbol_record.first ) );
+			} else {
+				relinked.insert( symbol_record );
+			}
+		}
+
+		// The code is relocated once it is pasted.
+		linker->Relocate( symbols, placement, 0 );
+
+		std::vector<size_t> defined_symbols;
+		for( const symbol_map::value_type& symbol_record: symbols ) {
+			if( symbol_record.second.second.is_resolved ) {
+				defined_symbols.push_back( symbol_record.first );
+			}
+		}
+
+		// Link in a scratch buffer: a redefinition fails here.
+		scratch_ctx = mmu->AllocateContextBuffer();
+		logic->SwitchToContextBuffer( scratch_ctx );
+		switched = true;
+		mmu->SetSymbolImage( std::move( relinked ) );
+		linker->DirectLink_Init();
+		linker->MergeLink_Add( std::move( symbols ) );
+		linker->DirectLink_Commit();
+		symbol_map result = mmu->DumpSymbolImage();
+		logic->RestoreCurrentContext();
+		switched = false;
+
+		logic->SwitchToContextBuffer( merged_ctx );
+		switched = true;
+
+		for( MemorySectionType section: { SEC_CODE_IMAGE, SEC_DATA_IMAGE, SEC_BYTEPOOL_IMAGE } ) {
+			MemorySectionIdentifier id( section );
+			if( placement[id] + limits[id] > total[id] ) {
+				mmu->ResizeSection( section, placement[id] + limits[id] );
+			}
+		}
+
+		mmu->PasteFromContext( new_ctx, placement );
+
+		symbol_map no_symbols;
+		linker->Relocate( no_symbols, placement, limits.Code() );
+		mmu->SetSymbolImage( std::move( result ) );
+
+		logic->RestoreCurrentContext();
+		switched = false;
+
+		record->at = placement;
+		record->limits = limits;
+		record->defined_symbols.swap( defined_symbols );
+	}
+
+	catch( ... ) {
+		if( switched ) {
+			logic->RestoreCurrentContext();
+		}
+		if( scratch_ctx ) {
+			mmu->ReleaseContextBuffer( scratch_ctx );
+		}
+		DeleteContext( new_ctx );
+		throw;
+	}
+
+	mmu->ReleaseContextBuffer( scratch_ctx );
+	DeleteContext( new_ctx );
+
+	// The whole code of the merged context is compiled at once, so its image is out of date.
+	if( IBackend* backend = Backend() ) {
+		backend->ReleaseImage( old_checksum );
+	}
+
+	msg( E_INFO, E_VERBOSE, "Module %zu replaced", module );
+}
+
 void ProcessorAPI::Compile()
 {
 	verify_method;
@@ -248,8 +592,18 @@ void ProcessorAPI::Compile()
 		msg( E_INFO, E_VERBOSE, "Attempting to compile context %zu", CurrentContext().buffer );
 		cassert( backend, "Backend is not attached" );
 
+		// The whole code is compiled at once.
+		if( stream_.context && stream_.context == CurrentContext().buffer ) {
+			while( LoadStreamStep() );
+		}
+
 		size_t chk = logic->ChecksumState();
 
+		if( backend->ImageIsOK( chk ) ) {
+			msg( E_INFO, E_VERBOSE, "Image is already compiled: checksum %zx", chk );
+			return;
+		}
+
 		backend->CompileBuffer( chk );
 		cassert( backend->ImageIsOK( chk ), "Backend reported compile error" );
 
@@ -299,6 +653,10 @@ calc_t ProcessorAPI::Exec()
 
 	while( !( CurrentContext().flags & MASK( F_EXIT ) ) ) {
 
+		// Code of a streamed context is loaded as execution reaches it.
+		while( stream_.context && stream_.context == CurrentContext().buffer &&
+		       CurrentContext().ip >= stream_.code_loaded && LoadStreamStep() );
+
 		last_command = &mmu->ACommand( CurrentContext().ip );
 
 		try {
@@ -331,6 +689,159 @@ calc_t ProcessorAPI::Exec()
 	return result;
 }
 
+MemoryUsage ProcessorAPI::QueryMemoryUsage( ctx_t id )
+{
+	verify_method;
+
+	MemoryUsage result = MMU()->QueryMemoryUsage( id );
+
+	if( IBackend* backend = Backend() ) {
+		result.native_images = backend->QueryImageMemory();
+	}
+
+	return result;
+}
+
+void ProcessorAPI::MapHostBuffer( const char* symbol, void* buffer, size_t count, Value::Type type )
+{
+	verify_method;
+
+	const symbol_type& sym = MMU()->ASymbol( crc32_runtime( symbol ) );
+	cverify( sym.second.is_resolved, "Cannot map host buffer over undefined symbol \"%s\"", symbol );
+
+	DirectReference ref = Linker()->Resolve( sym.second.ref );
+	cverify( ref.section == S_DATA || ref.section == S_BYTEPOOL,
+	         "Cannot map host buffer over symbol \"%s\" in section %s", symbol, ProcDebug::Print( ref.section ).c_str() );
+
+	msg( E_INFO, E_VERBOSE, "Mapping host buffer over symbol \"%s\" (count: %zu)", symbol, count );
+	MMU()->MapHostBuffer( MemorySectionIdentifier( ref.section ), ref.address, buffer, count, type );
+}
+
+void ProcessorAPI::UnmapHostBuffer( const char* symbol )
+{
+	verify_method;
+
+	const symbol_type& sym = MMU()->ASymbol( crc32_runtime( symbol ) );
+	DirectReference ref = Linker()->Resolve( sym.second.ref );
+	MMU()->UnmapHostBuffer( MemorySectionIdentifier( ref.section ), ref.address );
+}
+
+void ProcessorAPI::StripSymbols( ctx_t id, const std::vector<std::string>& exported )
+{
+	verify_method;
+
+	ILogic* logic = LogicProvider();
+
+	std::vector<size_t> hashes;
+	for( const std::string& symbol: exported ) {
+		hashes.push_back( crc32_runtime( symbol.c_str() ) );
+	}
+
+	msg( E_INFO, E_VERBOSE, "Stripping symbols of context %zu", id );
+
+	logic->SwitchToContextBuffer( id );
+	Linker()->StripSymbols( hashes );
+	logic->RestoreCurrentContext();
+
+	// References into the modules are inlined now.
+	modules_.erase( id );
+}
+
+void ProcessorAPI::EliminateDeadCode( ctx_t id, const std::vector<std::string>& exported )
+{
+	verify_method;
+
+	ILogic* logic = LogicProvider();
+	cverify( stream_.context != id, "Cannot eliminate dead code while context %zu is being streamed", id );
+
+	std::vector<size_t> hashes;
+	for( const std::string& symbol: exported ) {
+		hashes.push_back( crc32_runtime( symbol.c_str() ) );
+	}
+
+	msg( E_INFO, E_VERBOSE, "Eliminating dead code of context %zu", id );
+
+	logic->SwitchToContextBuffer( id );
+	Linker()->EliminateDeadCode( hashes );
+	logic->RestoreCurrentContext();
+
+	// The modules are moved.
+	modules_.erase( id );
+}
+
+void ProcessorAPI::DumpDataProfile( ctx_t id, FILE* file )
+{
+	verify_method;
+
+	ILogic* logic = LogicProvider();
+	cassert( file, "Invalid profile file" );
+
+	logic->SwitchToContextBuffer( id );
+	std::unordered_map<size_t, size_t> profile = Linker()->AggregateDataProfile( logic->QueryDataProfile( id ) );
+
+	size_t written = 0;
+	for( const std::pair<const size_t, size_t>& count_record: profile ) {
+		const symbol_type& symbol = MMU()->ASymbol( count_record.first );
+		if( !symbol.first.empty() ) {
+			fprintf( file, "%zu %s\n", count_record.second, symbol.first.c_str() );
+			++written;
+		}
+	}
+	logic->RestoreCurrentContext();
+
+	msg( E_INFO, E_VERBOSE, "Dumped data profile of context %zu (%zu symbols)", id, written );
+}
+
+void ProcessorAPI::ReorderData( ctx_t id, FILE* profile )
+{
+	verify_method;
+
+	ILogic* logic = LogicProvider();
+	cassert( profile, "Invalid profile file" );
+	cverify( stream_.context != id, "Cannot reorder data while context %zu is being streamed", id );
+
+	std::unordered_map<size_t, size_t> counts;
+	char line[STATIC_LENGTH];
+
+	while( fgets( line, STATIC_LENGTH, profile ) ) {
+		char* name = nullptr;
+		size_t count = strtoull( line, &name, 10 );
+
+		name += strspn( name, " \t" );
+		name[strcspn( name, " \t\r\n" )] = '\0';
+
+		if( *name ) {
+			counts[crc32_runtime( name )] = count;
+		}
+	}
+
+	msg( E_INFO, E_VERBOSE, "Reordering data of context %zu (%zu profiled symbols)", id, counts.size() );
+
+	logic->SwitchToContextBuffer( id );
+	Linker()->ReorderData( counts );
+	logic->RestoreCurrentContext();
+
+	// The modules are moved.
+	modules_.erase( id );
+}
+
+program_image_t ProcessorAPI::ExportImage( ctx_t id )
+{
+	verify_method;
+
+	msg( E_INFO, E_VERBOSE, "Exporting context %zu as a program image", id );
+	return MMU()->ExportImage( id );
+}
+
+ctx_t ProcessorAPI::Instantiate( const program_image_t& image )
+{
+	verify_method;
+
+	ctx_t allocated_ctx = MMU()->InstantiateImage( image );
+	msg( E_INFO, E_VERBOSE, "Instantiated program image into context %zu", allocated_ctx );
+	return allocated_ctx;
+}
+
 void ProcessorAPI::DumpExecutionContext( std::string* ctx_dump )
 {
 	char temporary_buffer[STATIC_LENGTH];
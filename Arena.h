@@ -0,0 +1,299 @@
+#ifndef INTERPRETER_ARENA_H
+#define INTERPRETER_ARENA_H
+
+#include "build.h"
+
+// -------------------------------------------------------------------------------------
+// Library		Homework
+// File			Arena.h
+// Author		Ivan Shapovalov <intelfx100@gmail.com>
+// Description	Chunked bump allocator for per-context storage.
+// -------------------------------------------------------------------------------------
+
+namespace Processor
+{
+
+/*
+ * Memory is carved sequentially from a list of chunks and is never returned
+ * individually (except for the most recent allocation, which may be rolled back).
+ * Everything is released at once when the arena is destroyed or reset,
+ * or rewound to reuse the largest chunk for the next round of allocations.
+ *
+ * Large allocations get blocks of their own, which are freed on release: containers
+ * sharing an arena grow interleaved, so their old buffers are seldom the most recent
+ * allocation, and only the small ones are left behind until the arena is reset.
+ */
+class Arena
+{
+	struct Chunk
+	{
+		Chunk* next;
+		size_t size; // including this header
+	};
+
+	struct LargeBlock
+	{
+		LargeBlock* prev;
+		LargeBlock* next;
+		size_t size; // including this header
+	};
+
+	static const size_t initial_chunk_size = 4096;
+	static const size_t max_chunk_size = 1 << 20;
+	static const size_t large_allocation_size = 1 << 16;
+	static const size_t alignment = 16;
+
+	Chunk* head_;
+	char* cursor_;
+	char* end_;
+	size_t next_chunk_size_;
+	LargeBlock* large_;
+
+	static size_t AlignUp( size_t value, size_t align )
+	{
+		return ( value + align - 1 ) & ~( align - 1 );
+	}
+
+	static size_t LargeHeaderSize()
+	{
+		return AlignUp( sizeof( LargeBlock ), alignment );
+	}
+
+	void* AllocateLarge( size_t size )
+	{
+		size_t total = LargeHeaderSize() + size;
+
+		LargeBlock* block = reinterpret_cast<LargeBlock*>( malloc( total ) );
+		s_cassert( block, "Arena: failed to allocate a block of %zu bytes", total );
+
+		block->prev = nullptr;
+		block->next = large_;
+		block->size = total;
+		if( large_ ) {
+			large_->prev = block;
+		}
+		large_ = block;
+
+		return reinterpret_cast<char*>( block ) + LargeHeaderSize();
+	}
+
+	void ReleaseLarge( void* ptr )
+	{
+		LargeBlock* block = reinterpret_cast<LargeBlock*>( reinterpret_cast<char*>( ptr ) - LargeHeaderSize() );
+
+		if( block->prev ) {
+			block->prev->next = block->next;
+		} else {
+			large_ = block->next;
+		}
+		if( block->next ) {
+			block->next->prev = block->prev;
+		}
+
+		free( block );
+	}
+
+	void ReleaseAllLarge()
+	{
+		while( large_ ) {
+			LargeBlock* next = large_->next;
+			free( large_ );
+			large_ = next;
+		}
+	}
+
+	void AddChunk( size_t min_payload )
+	{
+		size_t header = AlignUp( sizeof( Chunk ), alignment );
+		size_t size = std::max( next_chunk_size_, header + min_payload );
+
+		Chunk* chunk = reinterpret_cast<Chunk*>( malloc( size ) );
+		s_cassert( chunk, "Arena: failed to allocate a chunk of %zu bytes", size );
+
+		chunk->next = head_;
+		chunk->size = size;
+		head_ = chunk;
+
+		cursor_ = reinterpret_cast<char*>( chunk ) + header;
+		end_ = reinterpret_cast<char*>( chunk ) + size;
+
+		if( next_chunk_size_ < max_chunk_size ) {
+			next_chunk_size_ *= 2;
+		}
+	}
+
+public:
+	Arena() :
+		head_( nullptr ),
+		cursor_( nullptr ),
+		end_( nullptr ),
+		next_chunk_size_( initial_chunk_size ),
+		large_( nullptr )
+	{
+	}
+
+	Arena( const Arena& ) = delete;
+	Arena& operator=( const Arena& ) = delete;
+
+	~Arena()
+	{
+		Reset();
+	}
+
+	void* Allocate( size_t size )
+	{
+		size = AlignUp( size ? size : 1, alignment );
+
+		if( size >= large_allocation_size ) {
+			return AllocateLarge( size );
+		}
+
+		if( static_cast<size_t>( end_ - cursor_ ) < size ) {
+			AddChunk( size );
+		}
+
+		void* result = cursor_;
+		cursor_ += size;
+		return result;
+	}
+
+	// Free a large allocation, or give back a small one if it is the last allocation made;
+	// otherwise do nothing.
+	void Release( void* ptr, size_t size )
+	{
+		size = AlignUp( size ? size : 1, alignment );
+
+		if( size >= large_allocation_size ) {
+			ReleaseLarge( ptr );
+		} else if( reinterpret_cast<char*>( ptr ) + size == cursor_ ) {
+			cursor_ = reinterpret_cast<char*>( ptr );
+		}
+	}
+
+	void Reset()
+	{
+		ReleaseAllLarge();
+
+		while( head_ ) {
+			Chunk* next = head_->next;
+			free( head_ );
+			head_ = next;
+		}
+
+		cursor_ = end_ = nullptr;
+		next_chunk_size_ = initial_chunk_size;
+	}
+
+	// Forget all allocations, keeping the most recent (largest) chunk.
+	void Rewind()
+	{
+		ReleaseAllLarge();
+
+		if( !head_ ) {
+			return;
+		}
+
+		while( Chunk* next = head_->next ) {
+			head_->next = next->next;
+			free( next );
+		}
+
+		cursor_ = reinterpret_cast<char*>( head_ ) + AlignUp( sizeof( Chunk ), alignment );
+		end_ = reinterpret_cast<char*>( head_ ) + head_->size;
+	}
+
+	size_t Capacity() const
+	{
+		size_t result = 0;
+		for( Chunk* chunk = head_; chunk; chunk = chunk->next ) {
+			result += chunk->size;
+		}
+		for( LargeBlock* block = large_; block; block = block->next ) {
+			result += block->size;
+		}
+		return result;
+	}
+};
+
+/*
+ * Standard allocator adapter over an Arena.
+ * Containers using it shall not outlive the arena.
+ */
+template <typename T>
+class ArenaAllocator
+{
+	template <typename U> friend class ArenaAllocator;
+
+	Arena* arena_;
+
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	template <typename U>
+	struct rebind { typedef ArenaAllocator<U> other; };
+
+	explicit ArenaAllocator( Arena* arena ) :
+		arena_( arena )
+	{
+	}
+
+	template <typename U>
+	ArenaAllocator( const ArenaAllocator<U>& rhs ) :
+		arena_( rhs.arena_ )
+	{
+	}
+
+	T* allocate( size_t count )
+	{
+		s_cassert( arena_, "Allocating from a NULL arena" );
+		return reinterpret_cast<T*>( arena_->Allocate( count * sizeof( T ) ) );
+	}
+
+	void deallocate( T* ptr, size_t count )
+	{
+		if( arena_ ) {
+			arena_->Release( ptr, count * sizeof( T ) );
+		}
+	}
+
+	size_t max_size() const
+	{
+		return static_cast<size_t>( -1 ) / sizeof( T );
+	}
+
+	template <typename U, typename... Args>
+	void construct( U* ptr, Args&&... args )
+	{
+		::new( static_cast<void*>( ptr ) ) U( std::forward<Args>( args )... );
+	}
+
+	template <typename U>
+	void destroy( U* ptr )
+	{
+		ptr->~U();
+	}
+
+	template <typename U>
+	bool operator==( const ArenaAllocator<U>& rhs ) const { return arena_ == rhs.arena_; }
+
+	template <typename U>
+	bool operator!=( const ArenaAllocator<U>& rhs ) const { return arena_ != rhs.arena_; }
+};
+
+template <typename T>
+using arena_vector = std::vector<T, ArenaAllocator<T> >;
+
+} // namespace Processor
+
+#endif // INTERPRETER_ARENA_H
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
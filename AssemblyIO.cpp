@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "AssemblyIO.h"
 
+#include <climits>
+
 // -------------------------------------------------------------------------------------
 // Library		Homework
 // File			AssemblyIO.cpp
@@ -17,8 +19,16 @@ using namespace Processor;
 AsmHandler::AsmHandler() :
 	reading_file_( nullptr ),
 	writing_file_( nullptr ),
+	source_mapping_(),
+	source_buffer_(),
+	source_cursor_( nullptr ),
+	source_end_( nullptr ),
+	mnemonic_cache_used_( 0 ),
+	register_hash_seed_( 0 ),
 	current_line_num( 0 )
 {
+	mem_init( mnemonic_cache_ );
+	mem_init( register_table_ );
 }
 
 AsmHandler::~AsmHandler()
@@ -41,14 +51,212 @@ bool AsmHandler::_Verify() const
 	return 1;
 }
 
+namespace {
+	// Locale-independent replacements of isspace() and tolower().
+	inline bool helper_is_space( char c )
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	inline char helper_to_lower( char c )
+	{
+		return ( c >= 'A' && c <= 'Z' ) ? c - 'A' + 'a' : c;
+	}
+
+	inline size_t helper_hash_step( size_t hash, char c )
+	{
+		return hash * 31 + static_cast<unsigned char>( c );
+	}
+
+	size_t helper_hash_string( const char* string, size_t seed )
+	{
+		while( *string ) {
+			seed = helper_hash_step( seed, *string++ );
+		}
+
+		return seed;
+	}
+
+	// Scans a non-negative decimal or hexadecimal ("0x"-prefixed) number.
+	// Returns nullptr on anything else (octal, signed, overflowing), which is left to strtol().
+	const char* helper_scan_address( const char* string, size_t* result )
+	{
+		size_t value = 0, base = 10;
+
+		if( string[0] == '0' && string[1] == 'x' ) {
+			base = 16;
+			string += 2;
+		} else if( string[0] == '0' && string[1] >= '0' && string[1] <= '9' ) {
+			return nullptr;
+		}
+
+		const char* begin = string;
+
+		for( ;; ++string ) {
+			size_t digit;
+			char c = *string;
+
+			if( c >= '0' && c <= '9' ) {
+				digit = c - '0';
+			} else if( base == 16 && c >= 'a' && c <= 'f' ) {
+				digit = c - 'a' + 10;
+			} else {
+				break;
+			}
+
+			if( value > ( LONG_MAX - digit ) / base ) {
+				return nullptr;
+			}
+
+			value = value * base + digit;
+		}
+
+		if( string == begin ) {
+			return nullptr;
+		}
+
+		*result = value;
+		return string;
+	}
+}
+
 FileType AsmHandler::RdSetup( FILE* file )
 {
 	reading_file_ = file;
 	verify_method;
 
+	SetupSource( file );
+	SetupLookupTables();
+
 	return FT_STREAM;
 }
 
+void AsmHandler::SetupSource( FILE* file )
+{
+	source_mapping_ = std::make_shared<MappedFile>( file );
+	source_buffer_.clear();
+
+	if( source_mapping_->IsMapped() ) {
+		source_cursor_ = source_mapping_->Data();
+		source_end_ = source_cursor_ + source_mapping_->Size();
+
+		// The mapping cannot be extended, so an unterminated last line is moved to the buffer.
+		if( source_end_[-1] != '\n' ) {
+			char* last_line = source_end_;
+			while( last_line != source_cursor_ && last_line[-1] != '\n' ) {
+				--last_line;
+			}
+
+			source_buffer_.assign( last_line, source_end_ );
+			source_buffer_.push_back( '\n' );
+			source_end_ = last_line;
+		}
+
+		msg( E_INFO, E_DEBUG, "Reading mapped source (%zu bytes)", source_mapping_->Size() );
+	}
+
+	else {
+		source_mapping_.reset();
+
+		char chunk[STATIC_LENGTH];
+		while( size_t count = fread( chunk, 1, sizeof( chunk ), file ) ) {
+			source_buffer_.insert( source_buffer_.end(), chunk, chunk + count );
+		}
+
+		cverify( !ferror( file ), "Error reading source: %s", strerror( errno ) );
+
+		if( !source_buffer_.empty() && source_buffer_.back() != '\n' ) {
+			source_buffer_.push_back( '\n' );
+		}
+
+		source_cursor_ = source_buffer_.data();
+		source_end_ = source_cursor_ + source_buffer_.size();
+
+		msg( E_INFO, E_DEBUG, "Reading buffered source (%zu bytes)", source_buffer_.size() );
+	}
+}
+
+void AsmHandler::SetupLookupTables()
+{
+	// The command set may have changed since the previous file.
+	mem_init( mnemonic_cache_ );
+	mnemonic_cache_used_ = 0;
+
+	// Find a seed which maps register names to distinct slots.
+	ILogic* logic = proc_->LogicProvider();
+	for( register_hash_seed_ = 1; register_hash_seed_ < 256; ++register_hash_seed_ ) {
+		mem_init( register_table_ );
+		bool collision = false;
+
+		for( unsigned rid = R_A; rid < R_MAX && !collision; ++rid ) {
+			const char* name = logic->EncodeRegister( static_cast<Register>( rid ) );
+			RegisterSlot& slot = register_table_[helper_hash_string( name, register_hash_seed_ ) & ( register_table_size - 1 )];
+
+			if( slot.name ) {
+				collision = true;
+			} else {
+				slot.name = name;
+				slot.id = static_cast<Register>( rid );
+			}
+		}
+
+		if( !collision ) {
+			return;
+		}
+	}
+
+	// Not found: every register is then decoded by the logic provider.
+	msg( E_WARNING, E_VERBOSE, "Could not build register lookup table" );
+	mem_init( register_table_ );
+	register_hash_seed_ = 0;
+}
+
+char* AsmHandler::NextLine()
+{
+	if( source_cursor_ == source_end_ ) {
+		// Switch from the mapping to the buffer, unless already there.
+		if( source_buffer_.empty() || source_end_ == source_buffer_.data() + source_buffer_.size() ) {
+			return nullptr;
+		}
+
+		source_cursor_ = source_buffer_.data();
+		source_end_ = source_cursor_ + source_buffer_.size();
+	}
+
+	char* line = source_cursor_;
+	char* line_end = reinterpret_cast<char*>( memchr( line, '\n', source_end_ - line ) );
+	cassert( line_end, "Unterminated source line" );
+
+	*line_end = '\0';
+	source_cursor_ = line_end + 1;
+
+	return line;
+}
+
+const CommandTraits* AsmHandler::LookupCommand( const char* mnemonic, size_t hash )
+{
+	size_t index = hash & ( mnemonic_cache_size - 1 );
+
+	// The table is kept at most half full, so there is always an empty slot.
+	for( ; mnemonic_cache_[index].traits; index = ( index + 1 ) & ( mnemonic_cache_size - 1 ) ) {
+		const MnemonicSlot& slot = mnemonic_cache_[index];
+
+		if( slot.hash == hash && !strcmp( slot.traits->mnemonic, mnemonic ) ) {
+			return slot.traits;
+		}
+	}
+
+	const CommandTraits* traits = proc_->CommandSet()->DecodeCommand( mnemonic );
+
+	if( traits && mnemonic_cache_used_ < mnemonic_cache_size / 2 ) {
+		mnemonic_cache_[index].hash = hash;
+		mnemonic_cache_[index].traits = traits;
+		++mnemonic_cache_used_;
+	}
+
+	return traits;
+}
+
 void AsmHandler::RdReset()
 {
 	verify_method;
@@ -59,6 +267,10 @@ void AsmHandler::RdReset()
 		fclose( reading_file_ );
 		reading_file_ = nullptr;
 
+		source_mapping_.reset();
+		source_buffer_.clear();
+		source_cursor_ = source_end_ = nullptr;
+
 		current_line_num = 0;
 		last_statement_type = Value::V_MAX;
 		decode_output.Clear();
@@ -72,8 +284,12 @@ void AsmHandler::WrReset()
 	if( writing_file_ ) {
 		msg( E_INFO, E_DEBUG, "Resetting writing file" );
 
-		fclose( writing_file_ );
+		// Buffered output is only written out here: the file is complete only if this succeeds.
+		bool failed = ferror( writing_file_ );
+		failed = fclose( writing_file_ ) || failed;
 		writing_file_ = nullptr;
+
+		cassert( !failed, "Could not write the output file: %s", strerror( errno ) );
 	}
 }
 
@@ -112,6 +328,16 @@ llarray AsmHandler::ReadSectionImage()
 	casshole( "Not implemented" );
 }
 
+void* AsmHandler::MapSectionImage( std::shared_ptr<void>* )
+{
+	casshole( "Not implemented" );
+}
+
+section_source_t AsmHandler::DeferSectionImage()
+{
+	casshole( "Not implemented" );
+}
+
 symbol_map AsmHandler::ReadSymbols()
 {
 	casshole( "Not implemented" );
@@ -142,8 +368,6 @@ Reference::SingleRef AsmHandler::ParseIndirectReference( char* arg )
 
 	Reference::SingleRef result; mem_init( result );
 
-	msg( E_INFO, E_DEBUG, "Parsing indirect reference \"%s\"", arg );
-
 	if( arg[0] == '$' ) {
 		result.indirection_section = S_REGISTER;
 		result.target = ParseRegisterReference( arg + 1 );
@@ -170,10 +394,7 @@ Reference AsmHandler::ParseFullReference( char* arg )
 
 	Reference result; mem_init( result );
 
-	PrepReference( arg );
-	msg( E_INFO, E_DEBUG, "Parsing complete reference \"%s\"", arg );
-
-	char* second_component = nullptr;
+	char* second_component = PrepReference( arg );
 
 	// Read section specifier (if present)
 	if( arg[1] == ':' ) {
@@ -181,8 +402,8 @@ Reference AsmHandler::ParseFullReference( char* arg )
 		arg += 2;
 	}
 
-	// Get pointer to second component (if present)
-	if( ( second_component = strchr( arg, '+' ) ) ) {
+	// Cut off second component (if present)
+	if( second_component ) {
 		*second_component++ = '\0';
 	}
 
@@ -201,7 +422,13 @@ Reference::BaseRef AsmHandler::ParseRegisterReference( char* arg )
 	Reference::BaseRef result; mem_init( result );
 
 	result.type = Reference::BaseRef::BRT_MEMORY_REF;
-	result.memory_address = proc_->LogicProvider()->DecodeRegister( arg );
+
+	const RegisterSlot& slot = register_table_[helper_hash_string( arg, register_hash_seed_ ) & ( register_table_size - 1 )];
+	if( slot.name && !strcmp( slot.name, arg ) ) {
+		result.memory_address = slot.id;
+	} else {
+		result.memory_address = proc_->LogicProvider()->DecodeRegister( arg ); // reports unknown registers
+	}
 
 	return result;
 }
@@ -210,8 +437,6 @@ Reference::SingleRef AsmHandler::ParseSingleReference( char* arg, AddrType* glob
 {
 	Reference::SingleRef result; mem_init( result );
 
-	msg( E_INFO, E_DEBUG, "Parsing single reference \"%s\"", arg );
-
 	switch( arg[0] ) {
 	default: /* direct reference */
 		result.indirection_section = S_NONE;
@@ -254,7 +479,14 @@ Reference::BaseRef AsmHandler::ParseBaseReference( char* arg )
 {
 	Reference::BaseRef result; mem_init( result );
 
-	msg( E_INFO, E_DEBUG, "Parsing basic reference \"%s\"", arg );
+	size_t address;
+	const char* scan_end = helper_scan_address( arg, &address );
+
+	if( scan_end && *scan_end == '\0' ) {
+		result.type = Reference::BaseRef::BRT_MEMORY_REF;
+		result.memory_address = address;
+		return result;
+	}
 
 	errno = 0;
 	char* endptr;
@@ -269,8 +501,6 @@ Reference::BaseRef AsmHandler::ParseBaseReference( char* arg )
 
 		result.type = Reference::BaseRef::BRT_MEMORY_REF;
 		result.memory_address = immediate;
-
-		msg( E_INFO, E_DEBUG, "Basic reference: immediate \"%lu\"", immediate );
 	}
 
 	else {
@@ -279,8 +509,6 @@ Reference::BaseRef AsmHandler::ParseBaseReference( char* arg )
 
 		result.type = Reference::BaseRef::BRT_SYMBOL;
 		result.symbol_hash = referenced_symbol.hash;
-
-		msg( E_INFO, E_DEBUG, "Basic reference: symbol \"%s\" (%zx)", arg, referenced_symbol.hash );
 	}
 
 	return result;
@@ -289,8 +517,6 @@ Reference::BaseRef AsmHandler::ParseBaseReference( char* arg )
 void AsmHandler::ParseInsertString( char* arg )
 {
 	std::string output_string;
-
-	msg( E_INFO, E_DEBUG, "Parsing string literal %s", arg );
 	char* input_ptr = arg + 1, current, output;
 
 	while( ( current = *input_ptr++ ) != '"' ) {
@@ -349,9 +575,6 @@ void AsmHandler::ParseInsertString( char* arg )
 
 	output_string.push_back( '\0' );
 
-	msg( E_INFO, E_DEBUG, "Decoded string \"%s\" (length %zu)",
-	     output_string.c_str(), output_string.size() );
-
 	cassert( decode_output.bytepool.empty(), "More than one string in single decode unit" );
 
 	decode_output.bytepool.reserve( output_string.size() + 1 );
@@ -382,7 +605,7 @@ char* AsmHandler::PrepLine( char* read_buffer )
 	char* begin, *tmp = read_buffer, *last_non_whitespace;
 	bool in_string = false;
 
-	while( isspace( * ( begin = tmp++ ) ) );
+	while( helper_is_space( * ( begin = tmp++ ) ) );
 
 	if( *begin == '\0' )
 		return nullptr;
@@ -404,10 +627,10 @@ char* AsmHandler::PrepLine( char* read_buffer )
 			*tmp = '\0';
 
 		else {
-			if( !isspace( *tmp ) )
+			if( !helper_is_space( *tmp ) )
 				last_non_whitespace = tmp;
 
-			*tmp = tolower( *tmp );
+			*tmp = helper_to_lower( *tmp );
 		}
 
 	} while( *tmp++ );
@@ -417,25 +640,43 @@ char* AsmHandler::PrepLine( char* read_buffer )
 	return begin;
 }
 
-void AsmHandler::PrepReference( char* reference )
+// Strips whitespace in place; returns the position of the '+' separating components (if any).
+char* AsmHandler::PrepReference( char* reference )
 {
-	char* dest = reference;
+	char* dest = reference, *plus = nullptr;
 	bool in_string = false;
 
 	while( *reference ) {
-		if( helper_is_string( in_string, reference ) || !isspace( *reference ) ) {
+		if( helper_is_string( in_string, reference ) ) {
+			*dest++ = *reference;
+		} else if( !helper_is_space( *reference ) ) {
+			if( *reference == '+' && !plus ) {
+				plus = dest;
+			}
 			*dest++ = *reference;
 		}
 		++reference;
 	}
 
 	*dest++ = '\0';
+	return plus;
 }
 
-void AsmHandler::ReadSingleDeclaration( const char* decl_data )
+void AsmHandler::PushDeclarationData( const calc_t& value, size_t reserve_count )
 {
-	char name[STATIC_LENGTH], initialiser[STATIC_LENGTH], type;
+	if( reserve_count ) {
+		msg( E_INFO, E_DEBUG, "Declaration: reserving %zu DATA entries", reserve_count );
+
+		cassert( !decode_output.data_reserved, "More than one reservation in single decode unit" );
+		decode_output.data_reserved = reserve_count;
+		decode_output.data_reserve_pattern = value;
+	} else {
+		decode_output.data.push_back( value );
+	}
+}
 
+void AsmHandler::ReadSingleDeclaration( char* decl_data )
+{
 	// Declaration is generally a reference to something, so declare it
 	Reference declaration_reference; mem_init( declaration_reference );
 
@@ -458,7 +699,45 @@ void AsmHandler::ReadSingleDeclaration( const char* decl_data )
 		return;
 	}
 
-	int arguments = sscanf( decl_data, "%[^:= ] %c %s", name, &type, initialiser );
+	// Split "<name> [<type> <initialiser>]" in place
+	char* name = decl_data, *position = decl_data, *subscript = nullptr, *initialiser = nullptr;
+
+	while( *position && *position != ':' && *position != '=' && !helper_is_space( *position ) ) {
+		if( *position == '[' && !subscript ) {
+			subscript = position;
+		}
+		++position;
+	}
+
+	char* name_end = position;
+	while( helper_is_space( *position ) ) ++position;
+
+	char type = *position;
+	if( type ) {
+		++position;
+		while( helper_is_space( *position ) ) ++position;
+
+		if( *position ) {
+			initialiser = position;
+		}
+	}
+
+	*name_end = '\0';
+	int arguments = !*name ? 0 : !type ? 1 : !initialiser ? 2 : 3;
+
+	// Parse reservation size (if present): "name[count]"
+	size_t reserve_count = 0;
+	if( subscript ) {
+		*subscript++ = '\0';
+
+		errno = 0;
+		char* endptr;
+		reserve_count = strtoul( subscript, &endptr, 0 ); // base autodetermine
+
+		cverify( !errno && endptr != subscript && !strcmp( endptr, "]" ),
+		         "Declaration: invalid reservation size in \"%s\"", decl_data );
+		cverify( reserve_count, "Declaration: zero-sized reservation of \"%s\"", name );
+	}
 
 	switch( arguments ) {
 	case 3:
@@ -482,11 +761,13 @@ void AsmHandler::ReadSingleDeclaration( const char* decl_data )
 			msg( E_INFO, E_DEBUG, "Declaration: DATA entry \"%s\" = %s",
 			     name, ProcDebug::PrintValue( declaration_data ).c_str() );
 
-			decode_output.data.push_back( declaration_data );
+			PushDeclarationData( declaration_data, reserve_count );
 			break;
 		}
 
 		case ':': {
+			cverify( !reserve_count, "Declaration: cannot reserve space for alias \"%s\"", name );
+
 			// Parse aliased reference
 			declaration_reference = ParseFullReference( initialiser );
 
@@ -512,7 +793,9 @@ void AsmHandler::ReadSingleDeclaration( const char* decl_data )
 		declaration_reference.components[0].target.type = Reference::BaseRef::BRT_DEFINITION;
 
 		// Create "uninitialised" value and set its type
+		// The payload is zeroed even if untyped, since a reservation copies it into every reserved cell.
 		calc_t uninitialised_data;
+		uninitialised_data.integer = 0;
 		uninitialised_data.type = last_statement_type;
 
 		// if type is known, initialise to 0 in appropriate type.
@@ -528,7 +811,7 @@ void AsmHandler::ReadSingleDeclaration( const char* decl_data )
 			msg( E_INFO, E_DEBUG, "Declaration: DATA entry \"%s\" uninitialised (untyped)", name );
 		}
 
-		decode_output.data.push_back( uninitialised_data );
+		PushDeclarationData( uninitialised_data, reserve_count );
 		break;
 	}
 
@@ -542,10 +825,10 @@ void AsmHandler::ReadSingleDeclaration( const char* decl_data )
 	InsertSymbol( declaration_symbol, name, decode_output.mentioned_symbols );
 }
 
-void AsmHandler::ReadSingleCommand( const char* command,
+void AsmHandler::ReadSingleCommand( const char* command, size_t hash,
                                     char* argument )
 {
-	const CommandTraits* desc = proc_->CommandSet()->DecodeCommand( command );
+	const CommandTraits* desc = LookupCommand( command, hash );
 	cverify( desc, "Command: \"%s\": unsupported command", command );
 
 	Command output_command; mem_init( output_command );
@@ -605,71 +888,80 @@ void AsmHandler::ReadSingleCommand( const char* command,
 	decode_output.commands.push_back( output_command );
 }
 
-char* AsmHandler::ParseLabel( char* string )
+void AsmHandler::InsertLabel( char* name )
 {
-	do { // TODO rewrite to while()
-		if( *string == ' ' || *string == '\0' )
-			return nullptr; // no label
-
-		if( *string == ':' ) {
-			*string = '\0';
-			return string + 1; // found label
-		}
-	} while( *string++ );
-
-	return nullptr;
+	Reference label_reference; mem_init( label_reference );
+	label_reference.global_section = S_CODE;
+	label_reference.has_second_component = 0;
+	label_reference.components[0].indirection_section = S_NONE;
+	label_reference.components[0].target.type = Reference::BaseRef::BRT_DEFINITION;
+
+	Symbol label_symbol( name, label_reference );
+	InsertSymbol( label_symbol, name, decode_output.mentioned_symbols );
 }
 
 void AsmHandler::ReadSingleStatement( char* input )
 {
 	verify_method;
-	size_t labels = 0;
 
-	char* command, *argument, typespec = 0, *current_position = PrepLine( input );
+	char* position = PrepLine( input ), *command, *dot, *argument = nullptr;
+	size_t hash;
 	last_statement_type = Value::V_MAX;
 
-	/* skip leading space and return if empty string */
-	if( !current_position ) {
-		msg( E_INFO, E_DEBUG, "Decoding line %u: empty line", current_line_num );
+	/* return if empty string */
+	if( !position ) {
 		return;
 	}
 
-	msg( E_INFO, E_DEBUG, "Decoding line %u: \"%s\"", current_line_num, current_position );
+	msg( E_INFO, E_DEBUG, "Decoding line %u: \"%s\"", current_line_num, position );
 
-	/* parse labels */
-	while( char* next_chunk = ParseLabel( current_position ) ) {
-		Reference label_reference; mem_init( label_reference );
-		label_reference.global_section = S_CODE;
-		label_reference.has_second_component = 0;
-		label_reference.components[0].indirection_section = S_NONE;
-		label_reference.components[0].target.type = Reference::BaseRef::BRT_DEFINITION;
+	/* scan labels and the command, hashing the mnemonic on the way */
+	for( ;; ) {
+		command = position;
+		dot = nullptr;
+		hash = 0;
 
-		Symbol label_symbol( current_position, label_reference );
-		InsertSymbol( label_symbol, current_position, decode_output.mentioned_symbols );
+		for( ; *position && *position != ':' && !helper_is_space( *position ); ++position ) {
+			if( dot ) {
+				continue;
+			}
 
-		msg( E_INFO, E_DEBUG, "Label: \"%s\"", current_position );
-		++labels;
-		current_position = next_chunk;
+			if( *position == '.' ) {
+				dot = position;
+			} else {
+				hash = helper_hash_step( hash, *position );
+			}
+		}
 
-		while( isspace( *current_position ) ) ++current_position;
-	}
+		if( *position != ':' ) {
+			break;
+		}
 
-	msg( E_INFO, E_DEBUG, "Labels: %zu", labels );
+		*position++ = '\0';
+		InsertLabel( command );
 
-	/* get remaining statement */
-	command = strtok( current_position, " \t" );
-	argument = strtok( nullptr, "" );
+		while( helper_is_space( *position ) ) ++position;
+	}
 
-	if( !command ) {
-		msg( E_INFO, E_DEBUG, "Statement: no statement" );
+	if( position == command ) {
 		return; // no command
 	}
 
+	/* get the argument */
+	if( *position ) {
+		*position++ = '\0';
+		while( helper_is_space( *position ) ) ++position;
+
+		if( *position ) {
+			argument = position;
+		}
+	}
+
 	/* parse explicit type-specifier */
-	if( char* dot = strchr( command, '.' ) ) {
+	if( dot ) {
 		*dot++ = '\0';
 
-		switch( tolower( *dot ) ) {
+		switch( *dot ) {
 		case 'f':
 			last_statement_type = Value::V_FLOAT;
 			break;
@@ -680,7 +972,7 @@ void AsmHandler::ReadSingleStatement( char* input )
 			break;
 
 		default:
-			casshole( "Invalid command type specification: '%c'", typespec );
+			casshole( "Invalid command type specification: '%c'", *dot );
 			break;
 		}
 	}
@@ -693,24 +985,24 @@ void AsmHandler::ReadSingleStatement( char* input )
 	}
 
 	else {
-		ReadSingleCommand( command, argument );
+		ReadSingleCommand( command, hash, argument );
 	}
 }
 
 DecodeResult* AsmHandler::ReadStream()
 {
 	verify_method;
-	char read_buffer[STATIC_LENGTH];
 
 	try {
 		decode_output.Clear();
 
-		if( !fgets( read_buffer, STATIC_LENGTH, reading_file_ ) )
+		char* line = NextLine();
+		if( !line )
 			return nullptr;
 
 		++current_line_num;
 
-		ReadSingleStatement( read_buffer );
+		ReadSingleStatement( line );
 		return &decode_output;
 	}
 
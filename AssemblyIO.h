@@ -5,6 +5,7 @@
 
 #include "Interfaces.h"
 #include "Linker.h"
+#include "MappedFile.h"
 
 // -------------------------------------------------------------------------------------
 // Library		Homework
@@ -19,23 +20,64 @@ namespace ProcessorImplementation
 {
 using namespace Processor;
 
+/*
+ * The source is mapped (or, if that is impossible, read as a whole) and lexed in place:
+ * lines and tokens are terminated by overwriting the delimiters in the private mapping.
+ * Mnemonics are looked up through a table keyed by a hash computed while scanning them,
+ * and registers through a perfect hash table built from the register names at RdSetup().
+ */
 class INTERPRETER_API AsmHandler : LogBase( AsmHandler ), public IReader, public IWriter
 {
+	static const size_t mnemonic_cache_size = 256; // power of two
+	static const size_t register_table_size = 16; // power of two
+
+	struct MnemonicSlot
+	{
+		size_t hash;
+		const CommandTraits* traits;
+	};
+
+	struct RegisterSlot
+	{
+		const char* name;
+		Register id;
+	};
+
 	FILE* reading_file_;
 	FILE* writing_file_;
 
+	// Source text: the mapped file, then "source_buffer_" (holding the unterminated last line
+	// of the mapped file, or the whole file if it could not be mapped). Every line ends with '\n'.
+	mapped_file_t source_mapping_;
+	std::vector<char> source_buffer_;
+	char* source_cursor_;
+	char* source_end_;
+
+	MnemonicSlot mnemonic_cache_[mnemonic_cache_size];
+	size_t mnemonic_cache_used_;
+
+	RegisterSlot register_table_[register_table_size];
+	size_t register_hash_seed_;
+
 	unsigned current_line_num;
 	Value::Type last_statement_type;
 	DecodeResult decode_output;
 
+	void SetupSource( FILE* file );
+	void SetupLookupTables();
+	char* NextLine();
+
+	const CommandTraits* LookupCommand( const char* mnemonic, size_t hash );
+
 	void ReadSingleStatement( char* input );
-	void ReadSingleDeclaration( const char* decl_data );
-	void ReadSingleCommand( const char* command, char* argument );
+	void ReadSingleDeclaration( char* decl_data );
+	void PushDeclarationData( const calc_t& value, size_t reserve_count );
+	void ReadSingleCommand( const char* command, size_t hash, char* argument );
+	void InsertLabel( char* name );
 
 	void InternalWriteFile();
 	char* PrepLine( char* read_buffer );
-	void PrepReference( char* reference );
-	char* ParseLabel( char* current_position );
+	char* PrepReference( char* reference );
 
 	AddrType DecodeSectionType( char id );
 
@@ -59,6 +101,8 @@ public:
 	virtual std::pair<MemorySectionIdentifier, size_t> NextSection();
 
 	virtual llarray ReadSectionImage();
+	virtual void* MapSectionImage( std::shared_ptr<void>* backing );
+	virtual section_source_t DeferSectionImage();
 	virtual DecodeResult* ReadStream();
 	virtual symbol_map ReadSymbols();
 
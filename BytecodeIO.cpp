@@ -1,6 +1,12 @@
 #include "stdafx.h"
 #include "BytecodeIO.h"
 
+#ifdef TARGET_POSIX
+# include <unistd.h>
+# include <sys/uio.h>
+# include <climits>
+#endif // TARGET_POSIX
+
 // -------------------------------------------------------------------------------------
 // Library		Homework
 // File			BytecodeIO.cpp
@@ -12,7 +18,231 @@ ImplementDescriptor( BytecodeHandler, "bytecode reader/writer", MOD_APPMODULE )
 
 namespace {
 	const uint32_t file_signature = *reinterpret_cast<const uint32_t*>( "BCDE" );
+	const uint32_t file_signature_v2 = *reinterpret_cast<const uint32_t*>( "BCD2" );
 	const uint32_t section_signature = *reinterpret_cast<const uint32_t*>( "SEC_" );
+
+	// Dispatch caches are only meaningful within the process which filled them.
+	// Only dirty commands are written, so that clean mapped pages stay shared.
+	void ClearDispatchCaches( Processor::Command* commands, size_t count )
+	{
+		for( Processor::Command* cmd = commands; cmd != commands + count; ++cmd ) {
+			if( cmd->cached_executor || cmd->cached_handle ) {
+				cmd->cached_executor = nullptr;
+				cmd->cached_handle = nullptr;
+			}
+		}
+	}
+
+	size_t AlignUp( size_t value, size_t align )
+	{
+		return ( value + align - 1 ) & ~( align - 1 );
+	}
+
+	struct OutputPiece
+	{
+		const void* data;
+		size_t size;
+	};
+
+	// Write the pieces in order at the current position of the file.
+	void WritePieces( FILE* file, const std::vector<OutputPiece>& pieces )
+	{
+#ifdef TARGET_POSIX
+# ifdef IOV_MAX
+		static const size_t batch_limit = IOV_MAX;
+# else
+		static const size_t batch_limit = 16; // POSIX minimum
+# endif
+
+		// Anything buffered shall precede our output.
+		fflush( file );
+		int fd = fileno( file );
+
+		std::vector<iovec> batch;
+		size_t next = 0;
+
+		while( next < pieces.size() ) {
+			batch.clear();
+			for( ; next < pieces.size() && batch.size() < batch_limit; ++next ) {
+				if( pieces[next].size ) {
+					iovec vec = { const_cast<void*>( pieces[next].data ), pieces[next].size };
+					batch.push_back( vec );
+				}
+			}
+
+			// Writes may be partial (a single call is limited to ~2 GiB on Linux).
+			iovec* first = batch.data();
+			iovec* last = batch.data() + batch.size();
+			while( first != last ) {
+				ssize_t result = writev( fd, first, std::min<size_t>( last - first, batch_limit ) );
+				if( result < 0 && errno == EINTR ) {
+					continue;
+				}
+
+				s_cassert( result > 0, "Cannot write the file: %s", result ? strerror( errno ) : "nothing written" );
+
+				size_t written = result;
+				while( first != last && written >= first->iov_len ) {
+					written -= first->iov_len;
+					++first;
+				}
+
+				if( written ) {
+					first->iov_base = reinterpret_cast<char*>( first->iov_base ) + written;
+					first->iov_len -= written;
+				}
+			}
+		}
+#else // TARGET_POSIX
+		for( const OutputPiece& piece: pieces ) {
+			s_cassert( fwrite( piece.data, 1, piece.size, file ) == piece.size, "Cannot write the file" );
+		}
+#endif // TARGET_POSIX
+	}
+
+#ifdef TARGET_POSIX
+	/*
+	 * Payload read with pread() from a private descriptor of the input file,
+	 * so that it outlives both the reader and the caller's FILE.
+	 */
+	class FileSectionSource : public Processor::SectionSource
+	{
+		int fd_;
+		size_t offset_; // of the payload in the file
+		size_t size_;
+
+	public:
+		FileSectionSource( int fd, size_t offset, size_t size ) :
+			fd_( fd ),
+			offset_( offset ),
+			size_( size )
+		{
+		}
+
+		FileSectionSource( const FileSectionSource& ) = delete;
+		FileSectionSource& operator=( const FileSectionSource& ) = delete;
+
+		virtual ~FileSectionSource()
+		{
+			close( fd_ );
+		}
+
+		virtual void Read( size_t offset, size_t bytes, void* dest )
+		{
+			s_cassert( offset + bytes <= size_, "Reading [%zu; %zu) beyond payload size %zu",
+			           offset, offset + bytes, size_ );
+
+			char* ptr = reinterpret_cast<char*>( dest );
+			while( bytes ) {
+				ssize_t result = pread( fd_, ptr, bytes, offset_ + offset );
+				if( result < 0 && errno == EINTR ) {
+					continue;
+				}
+
+				s_cassert( result > 0, "Cannot read section payload at %zu: %s", offset_ + offset,
+				           result ? strerror( errno ) : "unexpected end of file" );
+				ptr += result;
+				offset += result;
+				bytes -= result;
+			}
+		}
+	};
+#endif // TARGET_POSIX
+
+	/*
+	 * v2 encoding of commands and references: fixed-width fields, no pointers.
+	 */
+
+	struct ValueRecord
+	{
+		uint64_t bits; // int_t or fp_t
+		uint8_t type;
+		uint8_t reserved[7];
+	} PACKED;
+
+	struct ReferenceComponentRecord
+	{
+		uint64_t target; // symbol hash or memory address
+		uint8_t target_type;
+		uint8_t indirection_section;
+		uint8_t reserved[6];
+	} PACKED;
+
+	struct ReferenceRecord
+	{
+		uint8_t global_section;
+		uint8_t has_second_component;
+		uint8_t reserved[6];
+		ReferenceComponentRecord components[2];
+	} PACKED;
+
+	// Record of a stripped symbol table (SEC_SYMBOL_TABLE); records are sorted by hash.
+	struct SymbolRecord
+	{
+		uint64_t hash;
+		uint8_t is_resolved;
+		uint8_t reserved[7];
+		ReferenceRecord ref;
+	} PACKED;
+
+	struct CommandRecord
+	{
+		uint32_t id;
+		uint8_t type;
+		uint8_t arg_type;
+		uint8_t reserved[2];
+		union {
+			ValueRecord value;
+			ReferenceRecord ref;
+		} arg;
+	} PACKED;
+
+	void PackValue( const Processor::calc_t& value, ValueRecord& record )
+	{
+		memcpy( &record.bits, &value.integer, sizeof( record.bits ) );
+		record.type = value.type;
+	}
+
+	void UnpackValue( const ValueRecord& record, Processor::calc_t& value )
+	{
+		s_cassert( record.type <= Processor::Value::V_MAX, "Invalid value type: %hhu", record.type );
+
+		memcpy( &value.integer, &record.bits, sizeof( record.bits ) );
+		value.type = static_cast<Processor::Value::Type>( record.type );
+	}
+
+	void PackReference( const Processor::Reference& ref, ReferenceRecord& record )
+	{
+		record.global_section = ref.global_section;
+		record.has_second_component = ref.has_second_component;
+
+		for( unsigned i = 0; i < 2; ++i ) {
+			record.components[i].target = ref.components[i].target.memory_address;
+			record.components[i].target_type = ref.components[i].target.type;
+			record.components[i].indirection_section = ref.components[i].indirection_section;
+		}
+	}
+
+	void UnpackReference( const ReferenceRecord& record, Processor::Reference& ref )
+	{
+		s_cassert( record.global_section < Processor::S_MAX, "Invalid reference section: %hhu", record.global_section );
+
+		ref.global_section = static_cast<Processor::AddrType>( record.global_section );
+		ref.has_second_component = record.has_second_component;
+
+		for( unsigned i = 0; i < 2; ++i ) {
+			const ReferenceComponentRecord& component = record.components[i];
+
+			s_cassert( component.target_type <= Processor::Reference::BaseRef::BRT_MEMORY_REF &&
+			           component.indirection_section < Processor::S_MAX,
+			           "Invalid reference component: type %hhu section %hhu",
+			           component.target_type, component.indirection_section );
+
+			ref.components[i].target.memory_address = component.target;
+			ref.components[i].target.type = static_cast<Processor::Reference::BaseRef::BaseRefType>( component.target_type );
+			ref.components[i].indirection_section = static_cast<Processor::AddrType>( component.indirection_section );
+		}
+	}
 }
 
 namespace ProcessorImplementation
@@ -22,9 +252,16 @@ using namespace Processor;
 BytecodeHandler::BytecodeHandler() :
 	reading_file_( nullptr ),
 	writing_file_( nullptr ),
-	count_sections_read_( 0 )
+	mapping_(),
+	read_position_( 0 ),
+	file_version_( 0 ),
+	section_count_( 0 ),
+	count_sections_read_( 0 ),
+	next_header_offset_( 0 ),
+	directory_(),
+	pending_sections_(),
+	code_records_()
 {
-	mem_init( current_file_ );
 	mem_init( current_section_ );
 }
 
@@ -45,30 +282,113 @@ bool BytecodeHandler::_Verify() const
 	if( reading_file_ )
 		verify_statement( !ferror( reading_file_ ), "Error in reading stream" );
 
+	if( mapping_ )
+		verify_statement( read_position_ <= mapping_->Size(), "Read position %zu beyond mapped file size %zu",
+		                  read_position_, mapping_->Size() );
+
 	return 1;
 }
 
+void BytecodeHandler::ReadRaw( void* dest, size_t bytes )
+{
+	if( mapping_ ) {
+		cassert( read_position_ + bytes <= mapping_->Size(),
+		         "Unexpected end of file at %zu (reading %zu bytes)", read_position_, bytes );
+		memcpy( dest, mapping_->Data() + read_position_, bytes );
+		read_position_ += bytes;
+	} else {
+		size_t bytes_read = fread( dest, 1, bytes, reading_file_ );
+		cassert( bytes_read == bytes, "Unexpected end of file (read %zu of %zu bytes)", bytes_read, bytes );
+	}
+}
+
+void BytecodeHandler::SeekTo( size_t offset )
+{
+	if( mapping_ ) {
+		cassert( offset <= mapping_->Size(), "Seeking to %zu beyond file size %zu", offset, mapping_->Size() );
+		read_position_ = offset;
+	} else {
+		int result = fseek( reading_file_, offset, SEEK_SET );
+		cassert( !result, "Cannot seek to %zu: %s", offset, strerror( errno ) );
+	}
+}
+
 void BytecodeHandler::ReadFileInfo()
 {
-	fread( &current_file_, sizeof( current_file_ ), 1, reading_file_ );
-	cassert( current_file_.signature == file_signature, "Invalid file signature: %08x (%4s)", current_file_.signature, &current_file_.signature );
-	msg( E_INFO, E_DEBUG, "%hhu sections in file", current_file_.section_count );
+	uint32_t signature;
+	ReadRaw( &signature, sizeof( signature ) );
+
+	if( signature == file_signature ) {
+		FileHeader header;
+		header.signature = signature;
+		ReadRaw( &header.section_count, sizeof( header ) - sizeof( signature ) );
+
+		file_version_ = 1;
+		section_count_ = header.section_count;
+		next_header_offset_ = sizeof( header );
+	} else if( signature == file_signature_v2 ) {
+		FileHeaderV2 header;
+		header.signature = signature;
+		ReadRaw( &header.version, sizeof( header ) - sizeof( signature ) );
+
+		cassert( header.version == 2, "Unsupported bytecode format version: %hu", header.version );
+		cassert( header.calc_size == sizeof( calc_t ),
+		         "Incompatible DATA cell size: %u (expected %zu)", header.calc_size, sizeof( calc_t ) );
+
+		file_version_ = 2;
+		section_count_ = header.section_count;
+		directory_.resize( section_count_ );
+		if( section_count_ ) {
+			ReadRaw( directory_.data(), sizeof( DirectoryEntry ) * section_count_ );
+		}
+	} else {
+		casshole( "Invalid file signature: %08x (%.4s)", signature, reinterpret_cast<const char*>( &signature ) );
+	}
+
+	msg( E_INFO, E_DEBUG, "Format v%u, %zu sections in file", file_version_, section_count_ );
 	count_sections_read_ = 0;
 }
 
 void BytecodeHandler::ReadSectionInfo()
 {
-	fread( &current_section_, sizeof( current_section_ ), 1, reading_file_ );
-	cassert( current_section_.signature == section_signature,
-	         "Invalid section signature: %08x (%4s)",
-	         current_section_.signature, &current_section_.signature );
-	cassert( current_section_.section_type < SEC_MAX,
+	if( file_version_ == 1 ) {
+		SectionHeader header;
+		SeekTo( next_header_offset_ );
+		ReadRaw( &header, sizeof( header ) );
+
+		cassert( header.signature == section_signature,
+		         "Invalid section signature: %08x (%.4s)",
+		         header.signature, reinterpret_cast<const char*>( &header.signature ) );
+
+		current_section_.type = header.section_type;
+		current_section_.offset = next_header_offset_ + sizeof( header );
+		current_section_.size_bytes = header.size_bytes;
+		current_section_.size_entries = header.size_entries;
+		current_section_.checksum = 0;
+		current_section_.encoding = PE_RAW;
+
+		next_header_offset_ = current_section_.offset + current_section_.size_bytes;
+	} else {
+		const DirectoryEntry& entry = directory_[count_sections_read_];
+
+		cassert( entry.offset % payload_alignment == 0, "Misaligned section payload at %zu",
+		         static_cast<size_t>( entry.offset ) );
+		cassert( entry.encoding <= PE_LZ, "Invalid section encoding #: %hhu", entry.encoding );
+
+		current_section_.type = static_cast<MemorySectionType>( entry.section_type );
+		current_section_.offset = entry.offset;
+		current_section_.size_bytes = entry.size_bytes;
+		current_section_.size_entries = entry.size_entries;
+		current_section_.checksum = entry.checksum;
+		current_section_.encoding = static_cast<PayloadEncoding>( entry.encoding );
+	}
+
+	cassert( current_section_.type < SEC_MAX,
 	         "Invalid section type #: %u",
-	         current_section_.section_type );
+	         current_section_.type );
 	msg( E_INFO, E_VERBOSE, "Reading section: %s (bytes: %zu entities: %zu)",
-		 ProcDebug::Print( current_section_.section_type ).c_str(),
-		 static_cast<size_t>( current_section_.size_bytes ),
-		 static_cast<size_t>( current_section_.size_entries ) );
+		 ProcDebug::Print( current_section_.type ).c_str(),
+		 current_section_.size_bytes, current_section_.size_entries );
 	++count_sections_read_;
 }
 
@@ -78,6 +398,16 @@ FileType BytecodeHandler::RdSetup( FILE* file )
 	verify_method;
 
 	rewind( reading_file_ );
+
+	mapping_.reset( new MappedFile( reading_file_ ) );
+	if( mapping_->IsMapped() ) {
+		msg( E_INFO, E_DEBUG, "Reading from a file mapping (%zu bytes)", mapping_->Size() );
+	} else {
+		msg( E_INFO, E_DEBUG, "Cannot map the file - reading the stream" );
+		mapping_.reset();
+	}
+	read_position_ = 0;
+
 	ReadFileInfo();
 
 	return FT_BINARY;
@@ -94,7 +424,14 @@ void BytecodeHandler::RdReset()
 		reading_file_ = nullptr;
 		count_sections_read_ = 0;
 
-		mem_init( current_file_ );
+		// Images adopted by the MMU keep their own references to the mapping.
+		mapping_.reset();
+		read_position_ = 0;
+
+		file_version_ = 0;
+		section_count_ = 0;
+		next_header_offset_ = 0;
+		directory_.clear();
 		mem_init( current_section_ );
 	}
 }
@@ -106,8 +443,12 @@ void BytecodeHandler::WrReset()
 	if( writing_file_ ) {
 		msg( E_INFO, E_DEBUG, "Resetting writing file" );
 
-		fclose( writing_file_ );
+		// Buffered output is only written out here: the file is complete only if this succeeds.
+		bool failed = ferror( writing_file_ );
+		failed = fclose( writing_file_ ) || failed;
 		writing_file_ = nullptr;
+
+		cassert( !failed, "Could not write the output file: %s", strerror( errno ) );
 	}
 }
 
@@ -133,78 +474,586 @@ void BytecodeHandler::Write( ctx_t id )
 
 void BytecodeHandler::InternalWriteFile()
 {
-	// We write code, data, bytepool and symbols
+	// We write symbols, data, bytepool and code (last, to be streamed in chunks; see ProcessorAPI::LoadStreamBegin())
 	static const size_t writing_section_count = 4;
 	static const MemorySectionType writing_sections[writing_section_count] =
 	{
-		SEC_CODE_IMAGE,
+		SEC_SYMBOL_MAP,
 		SEC_DATA_IMAGE,
 		SEC_BYTEPOOL_IMAGE,
-		SEC_SYMBOL_MAP
+		SEC_CODE_IMAGE
 	};
 
-	FileHeader hdr;
-	hdr.signature = file_signature;
-	hdr.section_count = -1;
-	fwrite( &hdr, sizeof( hdr ), 1, writing_file_ );
-
-	size_t sections_actually_written = 0;
+	pending_sections_.clear();
 	Offsets limits = proc_->MMU()->QuerySectionLimits();
 
+	// Compiling materializes the reserved DATA, after which it is no longer reported as reserved.
+	calc_t reserve_pattern;
+	size_t reserved = proc_->MMU()->QueryReservedData( &reserve_pattern );
+
+	llarray native_image;
+	if( proc_->WriterOptions() & MASK( WO_NATIVE_IMAGE ) ) {
+		native_image = ExportNativeImage();
+	}
+
 	for( size_t i = 0; i < writing_section_count; ++i ) {
 		if( writing_sections[i] == SEC_SYMBOL_MAP ) {
-			WriteSymbols( proc_->MMU()->DumpSymbolImage() );
-			++sections_actually_written;
+			const symbol_map& symbols = proc_->MMU()->DumpSymbolImage();
+
+			// Symbols stripped in memory have no names to compute their hashes from,
+			// so they are kept in the table form (with the names that are left).
+			if( proc_->WriterOptions() & MASK( WO_STRIP_SYMBOLS ) ) {
+				WriteSymbolTable( symbols, proc_->WriterOptions() & MASK( WO_SYMBOL_NAMES ) );
+			} else if( std::any_of( symbols.begin(), symbols.end(),
+			                        []( const symbol_map::value_type& record ) { return record.second.first.empty(); } ) ) {
+				WriteSymbolTable( symbols, true );
+			} else {
+				WriteSymbols( symbols );
+			}
+		} else if( writing_sections[i] == SEC_DATA_IMAGE ) {
+			WriteData( limits.Data(), reserved, reserve_pattern );
+		} else if( writing_sections[i] == SEC_CODE_IMAGE ) {
+			WriteCode( limits.Code() );
 		} else {
 			MemorySectionIdentifier id( writing_sections[i] );
 			if( size_t limit = limits.at( id ) ) {
-				llarray section_data = proc_->MMU()->DumpSection( id, 0, limit );
-				PutSection( id.SectionType(), section_data, limit );
-				++sections_actually_written;
+				if( const void* image = proc_->MMU()->ViewSection( id, 0, limit ) ) {
+					PutSectionInPlace( id.SectionType(), image, limit, limit );
+				} else {
+					PutSection( id.SectionType(), proc_->MMU()->DumpSection( id, 0, limit ), limit );
+				}
 			}
 		}
 	}
-	
-	// Update header
-	fseek( writing_file_, 0, SEEK_SET );
-	hdr.section_count = sections_actually_written;
-	fwrite( &hdr, sizeof( hdr ), 1, writing_file_ );
-	fseek( writing_file_, 0, SEEK_END );
+
+	// Native image goes after the code, so that it is imported when the context is complete.
+	if( native_image.size() ) {
+		msg( E_INFO, E_VERBOSE, "Writing native image: %zu bytes", native_image.size() );
+		PutSection( SEC_NATIVE_IMAGE, native_image, native_image.size() );
+	}
+
+	FlushSections();
+}
+
+llarray BytecodeHandler::ExportNativeImage()
+{
+	IBackend* backend = proc_->Backend();
+	if( !backend ) {
+		msg( E_WARNING, E_USER, "Not writing the native image: no backend is attached" );
+		return llarray();
+	}
+
+	size_t chk = proc_->LogicProvider()->ChecksumState();
+	if( !backend->ImageIsOK( chk ) ) {
+		backend->CompileBuffer( chk );
+		cassert( backend->ImageIsOK( chk ), "Backend reported compile error" );
+	}
+
+	return backend->ExportImage( chk );
 }
 
 std::pair< MemorySectionIdentifier, size_t > BytecodeHandler::NextSection()
 {
 	verify_method;
 
-	if( count_sections_read_ >= current_file_.section_count ) {
+	if( count_sections_read_ >= section_count_ ) {
 		return std::make_pair( MemorySectionIdentifier(), size_t( 0 ) );
 	} else {
 		ReadSectionInfo();
-		return std::make_pair( MemorySectionIdentifier( current_section_.section_type ),
-							   size_t( current_section_.size_entries ) );
+		return std::make_pair( MemorySectionIdentifier( current_section_.type ),
+							   current_section_.size_entries );
 	}
 }
 
-llarray BytecodeHandler::ReadSectionImage()
+void BytecodeHandler::VerifyPayload( const char* payload ) const
 {
+	if( file_version_ >= 2 ) {
+		uint64_t checksum = hasher_xroll( payload, current_section_.size_bytes, 0 );
+		cassert( checksum == current_section_.checksum,
+		         "Checksum mismatch in section %s at %zu: %016llx (expected %016llx)",
+		         ProcDebug::Print( current_section_.type ).c_str(), current_section_.offset,
+		         static_cast<unsigned long long>( checksum ),
+		         static_cast<unsigned long long>( current_section_.checksum ) );
+	}
+}
+
+size_t BytecodeHandler::EntrySize() const
+{
+	switch( current_section_.type ) {
+	case SEC_CODE_IMAGE:
+		return ( file_version_ >= 2 ) ? sizeof( CommandRecord ) : sizeof( Command );
+
+	case SEC_DATA_IMAGE:
+		return sizeof( calc_t );
+
+	case SEC_BYTEPOOL_IMAGE:
+		return 1;
+
+	case SEC_SYMBOL_TABLE:
+		return sizeof( SymbolRecord );
+
+	case SEC_SYMBOL_MAP:
+	case SEC_SYMBOL_NAMES:
+	case SEC_DATA_RESERVE:
+	case SEC_NATIVE_IMAGE:
+	case SEC_STACK_IMAGE:
+		return 0;
+
+	case SEC_MAX:
+	default:
+		casshole( "Switch error" );
+		return 0;
+	}
+}
+
+llarray BytecodeHandler::ReadPayload()
+{
+	llarray stored;
+	const char* payload;
+
+	if( mapping_ ) {
+		payload = MapPayload();
+	} else {
+		stored.resize( current_section_.size_bytes );
+
+		SeekTo( current_section_.offset );
+		ReadRaw( stored, current_section_.size_bytes );
+		VerifyPayload( stored );
+		payload = stored;
+	}
+
+	if( current_section_.encoding == PE_RAW ) {
+		return mapping_ ? llarray( payload, current_section_.size_bytes ) : stored;
+	}
+
+	uint64_t size;
+	cassert( current_section_.size_bytes >= sizeof( size ), "Truncated compressed section" );
+	memcpy( &size, payload, sizeof( size ) );
+
+	// The size comes from the file: check it before allocating.
+	size_t compressed_size = current_section_.size_bytes - sizeof( size );
+	size_t entry_size = EntrySize();
+	if( entry_size ) {
+		cassert( size % entry_size == 0 && size / entry_size == current_section_.size_entries,
+		         "Invalid decoded size of section %s at %zu: %llu bytes for %zu entities",
+		         ProcDebug::Print( current_section_.type ).c_str(), current_section_.offset,
+		         static_cast<unsigned long long>( size ), current_section_.size_entries );
+	}
+	cassert( size <= Compression::DecompressBound( compressed_size ),
+	         "Invalid decoded size of section %s at %zu: %llu bytes from %zu compressed",
+	         ProcDebug::Print( current_section_.type ).c_str(), current_section_.offset,
+	         static_cast<unsigned long long>( size ), compressed_size );
+
 	llarray ret;
-	ret.resize( current_section_.size_bytes );
-	fread( ret, 1, current_section_.size_bytes, reading_file_ );
+	ret.resize( size );
+
+	bool decoded = Compression::Decompress( payload + sizeof( size ), compressed_size, ret, size );
+	cassert( decoded, "Corrupt compressed section %s at %zu",
+	         ProcDebug::Print( current_section_.type ).c_str(), current_section_.offset );
+
+	msg( E_INFO, E_DEBUG, "Decompressed section: %zu -> %zu bytes", current_section_.size_bytes, ret.size() );
 	return ret;
 }
 
+char* BytecodeHandler::MapPayload()
+{
+	cassert( mapping_, "Reading file is not mapped" );
+	cassert( current_section_.offset + current_section_.size_bytes <= mapping_->Size(),
+	         "Section payload at %zu (bytes: %zu) exceeds file size %zu",
+	         current_section_.offset, current_section_.size_bytes, mapping_->Size() );
+
+	char* payload = mapping_->Data() + current_section_.offset;
+	VerifyPayload( payload );
+
+	read_position_ = current_section_.offset + current_section_.size_bytes;
+	return payload;
+}
+
+llarray BytecodeHandler::ReadSectionImage()
+{
+	verify_method;
+
+	llarray ret = ReadPayload();
+
+	if( current_section_.type == SEC_CODE_IMAGE ) {
+		if( file_version_ == 1 ) {
+			ClearDispatchCaches( reinterpret_cast<Command*>( static_cast<char*>( ret ) ), current_section_.size_entries );
+		} else {
+			cassert( ret.size() == current_section_.size_entries * sizeof( CommandRecord ),
+			         "Invalid CODE section size: %zu bytes for %zu commands",
+			         ret.size(), current_section_.size_entries );
+
+			const CommandRecord* records = reinterpret_cast<const CommandRecord*>( static_cast<const char*>( ret ) );
+			std::vector<Command> commands( current_section_.size_entries );
+
+			for( size_t i = 0; i < commands.size(); ++i ) {
+				const CommandRecord& record = records[i];
+				Command& cmd = commands[i];
+
+				cassert( record.type <= Value::V_MAX, "Invalid type of command %zu: %hhu", i, record.type );
+
+				cmd.id = record.id;
+				cmd.type = static_cast<Value::Type>( record.type );
+
+				switch( record.arg_type ) {
+				case A_NONE:
+					break;
+
+				case A_VALUE:
+					UnpackValue( record.arg.value, cmd.arg.value );
+					break;
+
+				case A_REFERENCE:
+					UnpackReference( record.arg.ref, cmd.arg.ref );
+					break;
+
+				default:
+					casshole( "Invalid argument type of command %zu: %hhu", i, record.arg_type );
+					break;
+				}
+			}
+
+			return llarray( commands.data(), sizeof( Command ) * commands.size() );
+		}
+	}
+
+	return ret;
+}
+
+void* BytecodeHandler::MapSectionImage( std::shared_ptr<void>* backing )
+{
+	verify_method;
+	cassert( backing, "NULL backing storage pointer" );
+
+	if( !mapping_ || current_section_.encoding != PE_RAW ) {
+		return nullptr;
+	}
+
+	size_t entry_size, alignment;
+	switch( current_section_.type ) {
+	case SEC_CODE_IMAGE:
+		// v2 commands are encoded and have to be decoded.
+		if( file_version_ >= 2 ) {
+			return nullptr;
+		}
+
+		entry_size = sizeof( Command );
+		alignment = alignof( Command );
+		break;
+
+	case SEC_DATA_IMAGE:
+		entry_size = sizeof( calc_t );
+		alignment = alignof( calc_t );
+		break;
+
+	case SEC_BYTEPOOL_IMAGE:
+		entry_size = alignment = 1;
+		break;
+
+	case SEC_SYMBOL_MAP:
+	case SEC_DATA_RESERVE:
+	case SEC_NATIVE_IMAGE:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
+	case SEC_STACK_IMAGE:
+		return nullptr;
+
+	case SEC_MAX:
+	default:
+		casshole( "Switch error" );
+		return nullptr;
+	}
+
+	cassert( current_section_.size_bytes == current_section_.size_entries * entry_size,
+	         "Invalid section size: %zu bytes for %zu entities",
+	         current_section_.size_bytes, current_section_.size_entries );
+
+	if( ( reinterpret_cast<uintptr_t>( mapping_->Data() ) + current_section_.offset ) % alignment ) {
+		msg( E_INFO, E_DEBUG, "Section payload at %zu is misaligned - it will be copied", current_section_.offset );
+		return nullptr;
+	}
+
+	char* payload = MapPayload();
+
+	if( current_section_.type == SEC_CODE_IMAGE ) {
+		ClearDispatchCaches( reinterpret_cast<Command*>( payload ), current_section_.size_entries );
+	}
+
+	msg( E_INFO, E_DEBUG, "Mapping section payload at %zu in place", current_section_.offset );
+
+	*backing = mapping_;
+	return payload;
+}
+
+section_source_t BytecodeHandler::DeferSectionImage()
+{
+	verify_method;
+
+#ifdef TARGET_POSIX
+	if( current_section_.encoding != PE_RAW ||
+	    ( current_section_.type != SEC_DATA_IMAGE && current_section_.type != SEC_BYTEPOOL_IMAGE ) ) {
+		return section_source_t();
+	}
+
+	size_t entry_size = ( current_section_.type == SEC_DATA_IMAGE ) ? sizeof( calc_t ) : 1;
+	cassert( current_section_.size_bytes == current_section_.size_entries * entry_size,
+	         "Invalid section size: %zu bytes for %zu entities",
+	         current_section_.size_bytes, current_section_.size_entries );
+
+	struct stat file_info;
+	if( fstat( fileno( reading_file_ ), &file_info ) || !S_ISREG( file_info.st_mode ) ||
+	    current_section_.offset + current_section_.size_bytes > static_cast<size_t>( file_info.st_size ) ) {
+		return section_source_t();
+	}
+
+	int fd = dup( fileno( reading_file_ ) );
+	if( fd < 0 ) {
+		msg( E_WARNING, E_VERBOSE, "Cannot duplicate the file descriptor: %s", strerror( errno ) );
+		return section_source_t();
+	}
+
+	msg( E_INFO, E_DEBUG, "Deferring section payload at %zu (bytes: %zu)",
+	     current_section_.offset, current_section_.size_bytes );
+
+	return section_source_t( new FileSectionSource( fd, current_section_.offset, current_section_.size_bytes ) );
+#else // TARGET_POSIX
+	return section_source_t();
+#endif // TARGET_POSIX
+}
+
 void BytecodeHandler::PutSection( MemorySectionType type, const llarray& data, size_t entities_count )
 {
-	SectionHeader hdr;
-	hdr.signature = section_signature;
-	hdr.section_type = type;
-	hdr.size_bytes = data.size();
-	hdr.size_entries = entities_count;
-	fwrite( &hdr, sizeof( hdr ), 1, writing_file_ );
-	fwrite( data, 1, data.size(), writing_file_ );
-	
-	msg( E_INFO, E_VERBOSE, "Written section: %s (bytes: %zu entities: %zu)",
-		 ProcDebug::Print( type ).c_str(), data.size(), entities_count );
+	PendingSection section;
+	section.type = type;
+	section.storage = data;
+	section.payload = nullptr;
+	section.size_bytes = data.size();
+	section.size_entries = entities_count;
+	section.encoding = PE_RAW;
+
+	CompressSection( section );
+	pending_sections_.push_back( std::move( section ) );
+}
+
+void BytecodeHandler::PutSectionInPlace( MemorySectionType type, const void* data, size_t bytes, size_t entities_count )
+{
+	PendingSection section;
+	section.type = type;
+	section.payload = reinterpret_cast<const char*>( data );
+	section.size_bytes = bytes;
+	section.size_entries = entities_count;
+	section.encoding = PE_RAW;
+
+	CompressSection( section );
+	pending_sections_.push_back( std::move( section ) );
+}
+
+void BytecodeHandler::CompressSection( PendingSection& section )
+{
+	// Keep the compressed payload only if it saves at least 1/8 (in-place use is lost).
+	if( !( proc_->WriterOptions() & MASK( WO_COMPRESS ) ) || !section.size_bytes ) {
+		return;
+	}
+
+	uint64_t size = section.size_bytes;
+	size_t limit = size - size / 8;
+
+	llarray compressed;
+	compressed.resize( sizeof( size ) + Compression::CompressBound( size ) );
+	memcpy( compressed, &size, sizeof( size ) );
+
+	size_t compressed_size = Compression::Compress( section.Payload(), size,
+	                                                static_cast<char*>( compressed ) + sizeof( size ),
+	                                                compressed.size() - sizeof( size ) );
+	if( compressed_size && sizeof( size ) + compressed_size < limit ) {
+		compressed.resize( sizeof( size ) + compressed_size );
+
+		msg( E_INFO, E_DEBUG, "Compressed section %s: %zu -> %zu bytes",
+		     ProcDebug::Print( section.type ).c_str(), section.size_bytes, compressed.size() );
+
+		section.storage = compressed;
+		section.payload = nullptr;
+		section.size_bytes = compressed.size();
+		section.encoding = PE_LZ;
+	}
+}
+
+void BytecodeHandler::FlushSections()
+{
+	verify_method;
+
+	static const char padding[payload_alignment] = {};
+
+	FileHeaderV2 hdr;
+	mem_init( hdr );
+	hdr.signature = file_signature_v2;
+	hdr.version = 2;
+	hdr.section_count = pending_sections_.size();
+	hdr.calc_size = sizeof( calc_t );
+
+	cassert( hdr.section_count == pending_sections_.size(), "Too many sections: %zu", pending_sections_.size() );
+
+	// Lay out the payloads after the directory.
+	std::vector<DirectoryEntry> directory( pending_sections_.size() );
+	size_t offset = AlignUp( sizeof( hdr ) + sizeof( DirectoryEntry ) * directory.size(), payload_alignment );
+
+	for( size_t i = 0; i < pending_sections_.size(); ++i ) {
+		const PendingSection& section = pending_sections_[i];
+		DirectoryEntry& entry = directory[i];
+
+		mem_init( entry );
+		entry.offset = offset;
+		entry.size_bytes = section.size_bytes;
+		entry.size_entries = section.size_entries;
+		entry.checksum = hasher_xroll( section.Payload(), section.size_bytes, 0 );
+		entry.section_type = section.type;
+		entry.encoding = section.encoding;
+
+		offset = AlignUp( offset + section.size_bytes, payload_alignment );
+	}
+
+	// Header, directory, then each payload preceded by its padding.
+	std::vector<OutputPiece> pieces;
+	pieces.reserve( 2 + 2 * pending_sections_.size() );
+
+	OutputPiece header_piece = { &hdr, sizeof( hdr ) };
+	OutputPiece directory_piece = { directory.data(), sizeof( DirectoryEntry ) * directory.size() };
+	pieces.push_back( header_piece );
+	pieces.push_back( directory_piece );
+
+	size_t position = sizeof( hdr ) + sizeof( DirectoryEntry ) * directory.size();
+	for( size_t i = 0; i < pending_sections_.size(); ++i ) {
+		const PendingSection& section = pending_sections_[i];
+
+		OutputPiece padding_piece = { padding, static_cast<size_t>( directory[i].offset ) - position };
+		OutputPiece payload_piece = { section.Payload(), section.size_bytes };
+		pieces.push_back( padding_piece );
+		pieces.push_back( payload_piece );
+		position = directory[i].offset + section.size_bytes;
+
+		msg( E_INFO, E_VERBOSE, "Writing section: %s (offset: %zu bytes: %zu entities: %zu)",
+			 ProcDebug::Print( section.type ).c_str(), static_cast<size_t>( directory[i].offset ),
+			 section.size_bytes, section.size_entries );
+	}
+
+	WritePieces( writing_file_, pieces );
+	msg( E_INFO, E_VERBOSE, "Written %zu sections: %zu bytes", pending_sections_.size(), position );
+
+	pending_sections_.clear();
+	code_records_ = llarray();
+}
+
+void BytecodeHandler::WriteCode( size_t limit )
+{
+	verify_method;
+
+	if( !limit ) {
+		return;
+	}
+
+	const Command* commands = reinterpret_cast<const Command*>( proc_->MMU()->ViewSection( SEC_CODE_IMAGE, 0, limit ) );
+
+	const CommandTraits* return_traits = proc_->CommandSet()->DecodeCommand( "ret" );
+	cid_t return_id = return_traits ? return_traits->id : 0;
+
+	// The directory holds at most 64k entries.
+	size_t chunk_commands = limit / 4096;
+	if( chunk_commands < code_chunk_commands ) {
+		chunk_commands = code_chunk_commands;
+	}
+
+	// The chunks are written from here.
+	code_records_.resize( sizeof( CommandRecord ) * limit );
+	CommandRecord* records = reinterpret_cast<CommandRecord*>( static_cast<char*>( code_records_ ) );
+	size_t chunk_begin = 0;
+	for( size_t i = 0; i < limit; ++i ) {
+		const Command& cmd = commands[i];
+		CommandRecord& record = records[i];
+
+		const CommandTraits* traits = proc_->CommandSet()->DecodeCommand( cmd.id );
+		cassert( traits, "Invalid command ID at %zu: %hu", i, cmd.id );
+
+		mem_init( record );
+		record.id = cmd.id;
+		record.type = cmd.type;
+		record.arg_type = traits->arg_type;
+
+		switch( traits->arg_type ) {
+		case A_NONE:
+			break;
+
+		case A_VALUE:
+			PackValue( cmd.arg.value, record.arg.value );
+			break;
+
+		case A_REFERENCE:
+			PackReference( cmd.arg.ref, record.arg.ref );
+			break;
+
+		default:
+			casshole( "Switch error" );
+			break;
+		}
+
+		// End the chunk after a return (i. e. a function), once it is large enough.
+		if( ( return_traits && cmd.id == return_id && i + 1 - chunk_begin >= chunk_commands ) || i + 1 == limit ) {
+			PutSectionInPlace( SEC_CODE_IMAGE, records + chunk_begin,
+			                   sizeof( CommandRecord ) * ( i + 1 - chunk_begin ), i + 1 - chunk_begin );
+			chunk_begin = i + 1;
+		}
+	}
+}
+
+void BytecodeHandler::WriteData( size_t limit, size_t reserved, calc_t pattern )
+{
+	verify_method;
+
+	size_t explicit_count = limit - reserved;
+
+	// Host buffers are overlaid on a copy.
+	llarray section_data;
+	const calc_t* cells = nullptr;
+	if( explicit_count ) {
+		cells = reinterpret_cast<const calc_t*>( proc_->MMU()->ViewSection( SEC_DATA_IMAGE, 0, explicit_count ) );
+		if( !cells ) {
+			section_data = proc_->MMU()->DumpSection( SEC_DATA_IMAGE, 0, explicit_count );
+			cells = reinterpret_cast<const calc_t*>( static_cast<const char*>( section_data ) );
+		}
+	}
+
+	// Fold the trailing run of cells equal to the reservation pattern into the reservation.
+	// Without a reservation, a trailing run of zero-initialised cells becomes one.
+	bool can_fold = reserved;
+	if( !reserved && explicit_count && !cells[explicit_count - 1].integer ) {
+		pattern = cells[explicit_count - 1];
+		can_fold = true;
+	}
+
+	size_t folded = 0;
+	while( can_fold && folded < explicit_count &&
+	       cells[explicit_count - folded - 1].type == pattern.type &&
+	       cells[explicit_count - folded - 1].integer == pattern.integer ) {
+		++folded;
+	}
+
+	// Not worth a separate section.
+	if( !reserved && folded * sizeof( calc_t ) <= sizeof( DirectoryEntry ) + payload_alignment ) {
+		folded = 0;
+	}
+
+	explicit_count -= folded;
+	reserved += folded;
+
+	if( explicit_count && section_data.size() ) {
+		section_data.resize( sizeof( calc_t ) * explicit_count );
+		PutSection( SEC_DATA_IMAGE, section_data, explicit_count );
+	} else if( explicit_count ) {
+		PutSectionInPlace( SEC_DATA_IMAGE, cells, sizeof( calc_t ) * explicit_count, explicit_count );
+	}
+
+	if( reserved ) {
+		PutSection( SEC_DATA_RESERVE, llarray( &pattern, sizeof( pattern ) ), reserved );
+	}
 }
 
 void BytecodeHandler::WriteSymbols( const symbol_map& symbols )
@@ -214,7 +1063,7 @@ void BytecodeHandler::WriteSymbols( const symbol_map& symbols )
 	llarray temp;
 	for( const symbol_map::value_type& symbol_record: symbols ) {
 		// Write name
-		const std::string& name = symbol_record.second.first;
+		const SymbolName& name = symbol_record.second.first;
 		const Symbol& symbol = symbol_record.second.second;
 		temp.append( name.size(), name.c_str() );
 		temp.append( 1, "\0" );
@@ -226,24 +1075,135 @@ void BytecodeHandler::WriteSymbols( const symbol_map& symbols )
 
 		temp.append( 1, &is_resolved );
 		if( is_resolved ) {
-			temp.append( sizeof( symbol.ref ), &symbol.ref );
+			ReferenceRecord record;
+			mem_init( record );
+			PackReference( symbol.ref, record );
+			temp.append( sizeof( record ), &record );
 		}
 	}
 
 	PutSection( Processor::SEC_SYMBOL_MAP, temp, symbols.size() );
 }
 
+void BytecodeHandler::WriteSymbolTable( const symbol_map& symbols, bool with_names )
+{
+	verify_method;
+
+	std::vector<const symbol_map::value_type*> sorted;
+	sorted.reserve( symbols.size() );
+	for( const symbol_map::value_type& symbol_record: symbols ) {
+		sorted.push_back( &symbol_record );
+	}
+	std::sort( sorted.begin(), sorted.end(),
+	           []( const symbol_map::value_type* lhs, const symbol_map::value_type* rhs ) { return lhs->first < rhs->first; } );
+
+	llarray table, names;
+
+	for( const symbol_map::value_type* symbol_record: sorted ) {
+		const Symbol& symbol = symbol_record->second.second;
+
+		SymbolRecord record;
+		mem_init( record );
+		record.hash = symbol_record->first;
+		record.is_resolved = symbol.is_resolved;
+		if( symbol.is_resolved ) {
+			PackReference( symbol.ref, record.ref );
+		}
+		table.append( sizeof( record ), &record );
+
+		const SymbolName& name = symbol_record->second.first;
+		names.append( name.size(), name.c_str() );
+		names.append( 1, "\0" );
+	}
+
+	msg( E_INFO, E_VERBOSE, "Writing stripped symbol table: %zu symbols", sorted.size() );
+	PutSection( SEC_SYMBOL_TABLE, table, sorted.size() );
+
+	if( with_names ) {
+		PutSection( SEC_SYMBOL_NAMES, names, sorted.size() );
+	}
+}
+
+symbol_map BytecodeHandler::ReadSymbolTable()
+{
+	// Names are looked up in the directory; the loader skips their section itself.
+	llarray names;
+	for( const DirectoryEntry& entry: directory_ ) {
+		if( entry.section_type == SEC_SYMBOL_NAMES ) {
+			cassert( entry.size_entries == current_section_.size_entries,
+			         "Symbol names do not match the symbol table: %llu names for %zu symbols",
+			         static_cast<unsigned long long>( entry.size_entries ), current_section_.size_entries );
+
+			SectionInfo table_section = current_section_;
+			current_section_.type = SEC_SYMBOL_NAMES;
+			current_section_.offset = entry.offset;
+			current_section_.size_bytes = entry.size_bytes;
+			current_section_.size_entries = entry.size_entries;
+			current_section_.checksum = entry.checksum;
+			current_section_.encoding = static_cast<PayloadEncoding>( entry.encoding );
+
+			names = ReadPayload();
+			current_section_ = table_section;
+			break;
+		}
+	}
+
+	llarray table = ReadPayload();
+	cassert( table.size() == current_section_.size_entries * sizeof( SymbolRecord ),
+	         "Invalid symbol table size: %zu bytes for %zu symbols", table.size(), current_section_.size_entries );
+
+	const SymbolRecord* records = reinterpret_cast<const SymbolRecord*>( static_cast<const char*>( table ) );
+	const char* name = names.size() ? static_cast<const char*>( names ) : "";
+	const char* names_end = name + names.size();
+
+	symbol_map ret;
+	ret.reserve( current_section_.size_entries );
+	for( size_t i = 0; i < current_section_.size_entries; ++i ) {
+		const SymbolRecord& record = records[i];
+
+		Symbol sym( static_cast<size_t>( record.hash ) );
+		if( record.is_resolved ) {
+			UnpackReference( record.ref, sym.ref );
+			sym.is_resolved = true;
+		}
+
+		size_t length = 0;
+		if( names.size() ) {
+			const char* end = reinterpret_cast<const char*>( memchr( name, '\0', names_end - name ) );
+			cassert( end, "Truncated symbol names section" );
+			length = end - name;
+		}
+
+		cverify( ret.insert( sym.hash, name, length, sym ).second, "Duplicate symbol in the table: hash %zx", sym.hash );
+		name += names.size() ? length + 1 : 0;
+	}
+
+	msg( E_INFO, E_DEBUG, "Read stripped symbol table: %zu symbols (%s)", ret.size(), names.size() ? "with names" : "without names" );
+	return ret;
+}
+
 symbol_map BytecodeHandler::ReadSymbols()
 {
 	verify_method;
 
+	if( current_section_.type == SEC_SYMBOL_TABLE ) {
+		return ReadSymbolTable();
+	}
+
 	llarray temp;
 	symbol_map ret;
 
-	temp.resize( current_section_.size_bytes );
-	fread( temp, 1, current_section_.size_bytes, reading_file_ );
+	// Parse the mapping directly, if there is one.
+	char* begin;
+	if( mapping_ && current_section_.encoding == PE_RAW ) {
+		begin = MapPayload();
+	} else {
+		temp = ReadPayload();
+		begin = temp;
+	}
 
-	char* ptr = temp;
+	char* ptr = begin;
+	ret.reserve( current_section_.size_entries );
 	for( size_t i = 0; i < current_section_.size_entries; ++i ) {
 		char* name = ptr;
 		size_t len = strlen( name );
@@ -251,10 +1211,19 @@ symbol_map BytecodeHandler::ReadSymbols()
 
 		char is_resolved = *ptr++;
 		if( is_resolved ) {
-			Reference* ref = reinterpret_cast<Reference*>( ptr );
-			ptr += sizeof( Reference );
+			Reference ref;
+
+			if( file_version_ == 1 ) {
+				memcpy( &ref, ptr, sizeof( Reference ) );
+				ptr += sizeof( Reference );
+			} else {
+				ReferenceRecord record;
+				memcpy( &record, ptr, sizeof( record ) );
+				ptr += sizeof( record );
+				UnpackReference( record, ref );
+			}
 
-			Symbol sym( name, *ref );
+			Symbol sym( name, ref );
 			InsertSymbol( sym, name, ret );
 		} else {
 			Symbol sym( name );
@@ -262,7 +1231,7 @@ symbol_map BytecodeHandler::ReadSymbols()
 		}
 	}
 
-	cassert( ptr - current_section_.size_bytes == temp,
+	cassert( ptr - current_section_.size_bytes == begin,
 			 "Failed to deserialize symbols - did not read the whole section" );
 	return ret;
 }
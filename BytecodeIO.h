@@ -5,6 +5,8 @@
 
 #include "Interfaces.h"
 #include "Linker.h"
+#include "MappedFile.h"
+#include "Compression.h"
 
 // -------------------------------------------------------------------------------------
 // Library		Homework
@@ -19,8 +21,33 @@ namespace ProcessorImplementation
 {
 using namespace Processor;
 
+/*
+ * Two file formats are read:
+ * - v1 ("BCDE"): a header followed by sections (a header each) to be read in order.
+ * - v2 ("BCD2"): a header and a section directory followed by payloads, each aligned
+ *   to payload_alignment and checksummed. Commands are stored in a pointer-free encoding;
+ *   DATA and BYTEPOOL payloads are kept in the in-memory format and can be used in place
+ *   unless compressed (see WO_COMPRESS).
+ * Only v2 is written. The layout is computed up front and the file is emitted at once
+ * (with writev() where available); DATA and BYTEPOOL payloads are written straight from the MMU.
+ * Code goes last, split into several CODE sections, each ending with a return,
+ * so that a context can be executed before the file is loaded completely.
+ * It may be followed by the native image exported by the backend (see WO_NATIVE_IMAGE).
+ * With WO_STRIP_SYMBOLS, the symbol map is written as a table of fixed-size records
+ * sorted by hash, and the names are either dropped or written separately.
+ * A symbol map already stripped in memory is always written so, since its hashes cannot be recomputed.
+ */
 class INTERPRETER_API BytecodeHandler : LogBase( BytecodeHandler ), public IReader, public IWriter
 {
+	static const size_t payload_alignment = 64;
+	static const size_t code_chunk_commands = 1024; // minimum, see WriteCode()
+
+	enum PayloadEncoding
+	{
+		PE_RAW = 0,
+		PE_LZ // 64-bit decoded size followed by a Compression block
+	};
+
 	struct FileHeader
 	{
 		uint32_t signature;
@@ -35,21 +62,92 @@ class INTERPRETER_API BytecodeHandler : LogBase( BytecodeHandler ), public IRead
 		Processor::MemorySectionType section_type : 8;
 	} PACKED;
 
+	struct FileHeaderV2
+	{
+		uint32_t signature;
+		uint16_t version;
+		uint16_t section_count;
+		uint32_t calc_size; // sizeof( calc_t ) of the writer; DATA cells are stored as is
+		uint32_t reserved;
+	} PACKED;
+
+	struct DirectoryEntry
+	{
+		uint64_t offset; // from the beginning of the file
+		uint64_t size_bytes; // as stored
+		uint64_t size_entries;
+		uint64_t checksum; // of the stored payload
+		uint8_t section_type;
+		uint8_t encoding;
+		uint8_t reserved[6];
+	} PACKED;
+
+	// Current section, in a format-independent form.
+	struct SectionInfo
+	{
+		MemorySectionType type;
+		size_t offset; // of the payload
+		size_t size_bytes; // as stored
+		size_t size_entries;
+		uint64_t checksum; // v2 only
+		PayloadEncoding encoding;
+	};
+
+	// Section to be written, collected until the directory can be laid out.
+	// The payload is either owned or referenced in place (MMU images, "code_records_").
+	struct PendingSection
+	{
+		MemorySectionType type;
+		llarray storage;
+		const char* payload; // nullptr if stored in "storage"
+		size_t size_bytes;
+		size_t size_entries;
+		PayloadEncoding encoding;
+
+		const char* Payload() const { return payload ? payload : static_cast<const char*>( storage ); }
+	};
+
 	FILE* reading_file_;
 	FILE* writing_file_;
 
-	FileHeader current_file_;
-	SectionHeader current_section_;
-	uint8_t count_sections_read_;
+	// If the input file could be mapped, it is read from the mapping (starting at "read_position_")
+	// and aligned section images are handed out in place.
+	mapped_file_t mapping_;
+	size_t read_position_;
+
+	unsigned file_version_;
+	size_t section_count_;
+	size_t count_sections_read_;
+	size_t next_header_offset_; // v1 only
+	std::vector<DirectoryEntry> directory_; // v2 only
+	SectionInfo current_section_;
 
+	std::vector<PendingSection> pending_sections_;
+	llarray code_records_; // encoded code, referenced by the pending CODE sections
+
+	void ReadRaw( void* dest, size_t bytes );
+	void SeekTo( size_t offset );
 	void ReadFileInfo();
 	void ReadSectionInfo();
 
+	size_t EntrySize() const; // of the current section as stored, or 0 if entries vary in size
+	llarray ReadPayload();
+	char* MapPayload();
+	void VerifyPayload( const char* payload ) const;
+
 	void InternalWriteFile();
 
+	void WriteCode( size_t limit );
 	void WriteSymbols( const symbol_map& symbols );
+	void WriteSymbolTable( const symbol_map& symbols, bool with_names );
+	symbol_map ReadSymbolTable();
+	void WriteData( size_t limit, size_t reserved, calc_t pattern );
+	llarray ExportNativeImage();
 
 	void PutSection( Processor::MemorySectionType type, const llarray& data, size_t entities_count );
+	void PutSectionInPlace( Processor::MemorySectionType type, const void* data, size_t bytes, size_t entities_count ); // "data" shall live until FlushSections()
+	void CompressSection( PendingSection& section );
+	void FlushSections();
 
 protected:
 	virtual bool _Verify() const;
@@ -64,6 +162,8 @@ public:
 	virtual std::pair<MemorySectionIdentifier, size_t> NextSection();
 
 	virtual llarray ReadSectionImage();
+	virtual void* MapSectionImage( std::shared_ptr<void>* backing );
+	virtual section_source_t DeferSectionImage();
 	virtual DecodeResult* ReadStream();
 	virtual symbol_map ReadSymbols();
 
@@ -39,6 +39,7 @@ void CommandSet_mkI::ResetCommandSet()
 	}
 
 	msg( E_INFO, E_DEBUG, "Successfully added %zu commands", by_id.size() );
+	proc_->InvalidateDispatch();
 }
 
 void CommandSet_mkI::AddCommand( CommandTraits && command )
@@ -52,6 +53,7 @@ void CommandSet_mkI::AddCommand( CommandTraits && command )
 
 	auto command_iresult = by_id.insert( std::make_pair( command.id, std::move( command ) ) );
 	cassert( command_iresult.second, "Command already exists: \"%s\"", command.mnemonic );
+	proc_->InvalidateDispatch();
 }
 
 void CommandSet_mkI::AddCommandImplementation( const char* mnemonic, size_t module, void* handle )
@@ -72,6 +74,7 @@ void CommandSet_mkI::AddCommandImplementation( const char* mnemonic, size_t modu
 	auto handle_iresult = cmd_iterator->second.execution_handles.insert( std::make_pair( module, handle ) );
 	cassert( handle_iresult.second, "Implementation of \"%s\" -> module %zx has already been registered",
 	         mnemonic, module );
+	proc_->InvalidateDispatch();
 }
 
 void* CommandSet_mkI::GetExecutionHandle( const CommandTraits& cmd, size_t module )
@@ -105,6 +108,24 @@ const CommandTraits* CommandSet_mkI::DecodeCommand( cid_t id ) const
 	return nullptr;
 }
 
+size_t CommandSet_mkI::Version() const
+{
+	verify_method;
+
+	size_t version = 0;
+
+	for( const std::pair<const cid_t, CommandTraits>& command_record: by_id ) {
+		const CommandTraits& traits = command_record.second;
+
+		version = hasher_xroll( &traits.id, sizeof( traits.id ), version );
+		version = hasher_xroll( traits.mnemonic, strlen( traits.mnemonic ), version );
+		version = hasher_xroll( &traits.arg_type, sizeof( traits.arg_type ), version );
+		version = hasher_xroll( &traits.is_service_command, sizeof( traits.is_service_command ), version );
+	}
+
+	return version;
+}
+
 const CommandSet_mkI::InternalCommandDescriptor CommandSet_mkI::initial_commands[] = {
 	{
 		"init",
@@ -46,6 +46,8 @@ public:
 	virtual const CommandTraits* DecodeCommand( cid_t id ) const;
 
 	virtual void* GetExecutionHandle( const CommandTraits& cmd, size_t module );
+
+	virtual size_t Version() const;
 };
 
 } // namespace ProcessorImplementation
@@ -0,0 +1,225 @@
+#include "stdafx.h"
+#include "Compression.h"
+
+// -------------------------------------------------------------------------------------
+// Library		Homework
+// File			Compression.cpp
+// Author		Ivan Shapovalov <intelfx100@gmail.com>
+// Description	Fast LZ77-family block codec for byte-code sections.
+// -------------------------------------------------------------------------------------
+
+namespace {
+
+const size_t min_match = 4;
+const size_t max_offset = 0xFFFF;
+const size_t hash_bits = 14;
+
+// Matches are not started in the last bytes of the input, so that the matcher may read ahead.
+const size_t tail_literals = 8;
+
+inline uint32_t Read32( const unsigned char* ptr )
+{
+	uint32_t value;
+	memcpy( &value, ptr, sizeof( value ) );
+	return value;
+}
+
+inline size_t Hash( uint32_t sequence )
+{
+	return ( sequence * 2654435761u ) >> ( 32 - hash_bits );
+}
+
+// Write the remainder of a nibble-encoded length.
+inline unsigned char* PutLength( unsigned char* out, size_t length )
+{
+	for( ; length >= 255; length -= 255 ) {
+		*out++ = 255;
+	}
+	*out++ = static_cast<unsigned char>( length );
+	return out;
+}
+
+inline bool GetLength( const unsigned char*& in, const unsigned char* end, size_t& length )
+{
+	unsigned char byte;
+	do {
+		if( in == end ) {
+			return false;
+		}
+		byte = *in++;
+		length += byte;
+	} while( byte == 255 );
+	return true;
+}
+
+unsigned char* PutSequence( unsigned char* out, const unsigned char* literals, size_t literal_count,
+                            size_t offset, size_t match_length )
+{
+	unsigned char* token = out++;
+	*token = ( literal_count < 15 ? literal_count : 15 ) << 4;
+	if( literal_count >= 15 ) {
+		out = PutLength( out, literal_count - 15 );
+	}
+
+	memcpy( out, literals, literal_count );
+	out += literal_count;
+
+	if( match_length ) {
+		*out++ = static_cast<unsigned char>( offset );
+		*out++ = static_cast<unsigned char>( offset >> 8 );
+
+		size_t length_code = match_length - min_match;
+		*token |= length_code < 15 ? length_code : 15;
+		if( length_code >= 15 ) {
+			out = PutLength( out, length_code - 15 );
+		}
+	}
+
+	return out;
+}
+
+} // unnamed namespace
+
+namespace Processor
+{
+
+namespace Compression
+{
+
+size_t CompressBound( size_t size )
+{
+	// Everything stored as literals in a single sequence.
+	return 1 + size / 255 + 1 + size;
+}
+
+size_t DecompressBound( size_t compressed_size )
+{
+	// A sequence never expands more than 255 times: a match of 19 bytes takes 3 bytes
+	// (token and offset), and every continuation byte adds at most 255 bytes more.
+	if( compressed_size > static_cast<size_t>( -1 ) / 255 ) {
+		return static_cast<size_t>( -1 );
+	}
+	return compressed_size * 255;
+}
+
+size_t Compress( const void* src, size_t size, void* dest, size_t capacity )
+{
+	const unsigned char* in = reinterpret_cast<const unsigned char*>( src );
+	unsigned char* out = reinterpret_cast<unsigned char*>( dest );
+	unsigned char* out_begin = out;
+
+	// Bail out on a short buffer instead of checking each write.
+	std::vector<unsigned char> scratch;
+	if( capacity < CompressBound( size ) ) {
+		scratch.resize( CompressBound( size ) );
+		out = out_begin = scratch.data();
+	}
+
+	// Positions (plus one) of the last occurrences of 4-byte sequences.
+	std::vector<uint32_t> table( 1 << hash_bits, 0 );
+
+	size_t anchor = 0, ip = 0;
+	size_t match_limit = size > tail_literals ? size - tail_literals : 0;
+
+	while( ip < match_limit ) {
+		uint32_t sequence = Read32( in + ip );
+		uint32_t& slot = table[Hash( sequence )];
+		size_t candidate = slot;
+		slot = static_cast<uint32_t>( ip + 1 );
+
+		if( !candidate || ip + 1 - candidate > max_offset || Read32( in + candidate - 1 ) != sequence ) {
+			// Skip faster through incompressible data.
+			ip += 1 + ( ( ip - anchor ) >> 6 );
+			continue;
+		}
+
+		--candidate;
+		size_t length = min_match;
+		while( ip + length < match_limit && in[candidate + length] == in[ip + length] ) {
+			++length;
+		}
+
+		out = PutSequence( out, in + anchor, ip - anchor, ip - candidate, length );
+		ip += length;
+		anchor = ip;
+	}
+
+	out = PutSequence( out, in + anchor, size - anchor, 0, 0 );
+
+	size_t result = out - out_begin;
+	if( !scratch.empty() ) {
+		if( result > capacity ) {
+			return 0;
+		}
+		memcpy( dest, out_begin, result );
+	}
+	return result;
+}
+
+bool Decompress( const void* src, size_t compressed_size, void* dest, size_t size )
+{
+	const unsigned char* in = reinterpret_cast<const unsigned char*>( src );
+	const unsigned char* in_end = in + compressed_size;
+	unsigned char* out = reinterpret_cast<unsigned char*>( dest );
+	unsigned char* out_begin = out;
+	unsigned char* out_end = out + size;
+
+	while( in < in_end ) {
+		unsigned char token = *in++;
+
+		size_t literal_count = token >> 4;
+		if( literal_count == 15 && !GetLength( in, in_end, literal_count ) ) {
+			return false;
+		}
+
+		if( literal_count > static_cast<size_t>( in_end - in ) ||
+		    literal_count > static_cast<size_t>( out_end - out ) ) {
+			return false;
+		}
+
+		memcpy( out, in, literal_count );
+		in += literal_count;
+		out += literal_count;
+
+		// The last sequence has no match.
+		if( in == in_end ) {
+			break;
+		}
+
+		if( in_end - in < 2 ) {
+			return false;
+		}
+
+		size_t offset = in[0] | ( in[1] << 8 );
+		in += 2;
+
+		size_t length = token & 0x0F;
+		if( length == 15 && !GetLength( in, in_end, length ) ) {
+			return false;
+		}
+		length += min_match;
+
+		if( !offset || offset > static_cast<size_t>( out - out_begin ) ||
+		    length > static_cast<size_t>( out_end - out ) ) {
+			return false;
+		}
+
+		const unsigned char* match = out - offset;
+		if( offset >= length ) {
+			memcpy( out, match, length );
+			out += length;
+		} else {
+			// Overlapping match (a run): copy forward byte by byte.
+			while( length-- ) {
+				*out++ = *match++;
+			}
+		}
+	}
+
+	return out == out_end;
+}
+
+} // namespace Compression
+
+} // namespace Processor
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
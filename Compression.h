@@ -0,0 +1,40 @@
+#ifndef INTERPRETER_COMPRESSION_H
+#define INTERPRETER_COMPRESSION_H
+
+#include "build.h"
+
+// -------------------------------------------------------------------------------------
+// Library		Homework
+// File			Compression.h
+// Author		Ivan Shapovalov <intelfx100@gmail.com>
+// Description	Fast LZ77-family block codec for byte-code sections.
+// -------------------------------------------------------------------------------------
+
+namespace Processor
+{
+
+/*
+ * A block is a sequence of (literals, match) pairs, the last one having no match.
+ * Each pair starts with a token: literal count in the high nibble, match length - 4
+ * in the low one; 15 means "continued in the following bytes" (each adds up to 255).
+ * A match is a 16-bit little-endian backward offset into the already decoded output.
+ * The decoded size is not stored in the block and shall be kept by the caller.
+ */
+namespace Compression
+{
+
+INTERPRETER_API size_t CompressBound( size_t size ); // Worst-case compressed size
+INTERPRETER_API size_t DecompressBound( size_t compressed_size ); // Largest size a block may decode to
+
+// Returns the compressed size, or 0 if the result does not fit into "capacity".
+INTERPRETER_API size_t Compress( const void* src, size_t size, void* dest, size_t capacity );
+
+// Returns false if the block is malformed or does not decode to exactly "size" bytes.
+INTERPRETER_API bool Decompress( const void* src, size_t compressed_size, void* dest, size_t size );
+
+} // namespace Compression
+
+} // namespace Processor
+
+#endif // INTERPRETER_COMPRESSION_H
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -110,6 +110,22 @@ enum ProcessorFlags
 	F_INVALIDFP // Invalid Floating-Point Flag - set if last result was infinite or NAN
 };
 
+enum LinkerOptions
+{
+	LO_MERGE_STRINGS = 0, // Intern identical bytepool strings (and string suffixes) when linking
+	LO_LAZY_SECTIONS, // Read DATA and BYTEPOOL of loaded byte-code files on first access
+	LO_MAX
+};
+
+enum WriterOptions
+{
+	WO_COMPRESS = 0, // Compress sections of written images where it pays off
+	WO_NATIVE_IMAGE, // Embed the native image of the written context (compiled by the attached backend)
+	WO_STRIP_SYMBOLS, // Write symbols as a compact table without names
+	WO_SYMBOL_NAMES, // With WO_STRIP_SYMBOLS, write the names into a separate debug section
+	WO_MAX
+};
+
 enum Register
 {
 	R_A = 0,
@@ -155,6 +171,10 @@ enum MemorySectionType
 	SEC_DATA_IMAGE,
 	SEC_BYTEPOOL_IMAGE,
 	SEC_SYMBOL_MAP,
+	SEC_DATA_RESERVE, // Zero-initialised tail of the DATA section, stored as count + fill pattern
+	SEC_NATIVE_IMAGE, // Relocatable native code compiled by a backend (files only)
+	SEC_SYMBOL_TABLE, // Stripped symbol map: hashes and references only, sorted by hash (files only)
+	SEC_SYMBOL_NAMES, // Names of a stripped symbol map, in its order (files only)
 	SEC_STACK_IMAGE,
 	SEC_MAX
 };
@@ -22,6 +22,7 @@ void ProcessorAPI::Attach( IModuleBase* module )
 	}
 
 	bool was_attach = false;
+	InvalidateDispatch();
 
 	if( IBackend* backend = dynamic_cast<IBackend*>( module ) ) {
 		Attach_( backend );
@@ -79,6 +80,7 @@ void ProcessorAPI::Detach( const IModuleBase* module )
 	}
 
 	bool was_detach = false;
+	InvalidateDispatch();
 
 	if( shadow_backend_ == module ) {
 		shadow_backend_ = backend_ = nullptr;
@@ -296,8 +298,15 @@ ProcessorAPI::ProcessorAPI() :
 	shadow_cset_( nullptr ),
 	shadow_logic_( nullptr ),
 	initialise_completed( false ),
+	linker_options_( 0 ),
+	dispatch_generation_( 0 ),
+	linker_jobs_( 1 ),
+	writer_options_( 0 ),
+	module_cache_(),
 	nem_(),
-	current_execution_context_()
+	current_execution_context_(),
+	stream_(),
+	modules_()
 {
 	memset( executors_, 0, Value::V_MAX );
 	memset( shadow_executors_, 0, Value::V_MAX );
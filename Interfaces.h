@@ -58,6 +58,11 @@ class INTERPRETER_API ProcessorAPI : LogBase( ProcessorAPI )
 	IModuleBase*	shadow_logic_;
 
 	bool initialise_completed;
+	mask_t linker_options_;
+	size_t dispatch_generation_;
+	size_t linker_jobs_;
+	mask_t writer_options_;
+	std::string module_cache_; // directory, empty if disabled
 
 	NativeExecutionManager nem_;
 
@@ -72,6 +77,25 @@ class INTERPRETER_API ProcessorAPI : LogBase( ProcessorAPI )
 
 	Context current_execution_context_;
 
+	// Binary file being loaded section by section (see LoadStreamBegin()).
+	struct StreamState
+	{
+		ctx_t context; // 0 if nothing is being streamed
+		size_t code_loaded; // commands in the context's code section
+	} stream_;
+
+	// Module merged into a context by MergeContexts(), kept for ReplaceModule().
+	struct LinkedModule
+	{
+		ctx_t id; // of the context it was merged from
+		Offsets at, limits; // where it is placed and how much it takes
+		std::vector<size_t> defined_symbols; // hashes
+	};
+	std::map<ctx_t, std::vector<LinkedModule> > modules_; // merged context -> its modules
+
+	void LoadBinarySection( IReader* reader, const std::pair<MemorySectionIdentifier, size_t>& section_info );
+	void LoadContents( IReader* reader, FileType file_type );
+
 protected:
 	virtual bool _Verify() const;
 
@@ -109,6 +133,20 @@ public:
 
 	NativeExecutionManager& ExecutionManager() { return nem_; }
 
+	// Command dispatch (executor and handle) cached outside of the commands themselves is valid
+	// as long as the generation is the same; it changes on (de)attaching modules and on command set changes.
+	size_t	DispatchGeneration() const { return dispatch_generation_; }
+	void	InvalidateDispatch() { ++dispatch_generation_; }
+
+	void	SetLinkerOptions( mask_t options ) { linker_options_ = options; } // Mask of LinkerOptions applied by Load() and MergeContexts()
+	mask_t	LinkerOptions() const { return linker_options_; }
+
+	void	SetLinkerJobs( size_t jobs ) { linker_jobs_ = jobs; } // Threads used by MergeContexts() to link (1 to link sequentially)
+	size_t	LinkerJobs() const { return linker_jobs_; }
+
+	void	SetWriterOptions( mask_t options ) { writer_options_ = options; } // Mask of WriterOptions applied by Dump()
+	mask_t	WriterOptions() const { return writer_options_; }
+
 	void	Flush(); // Completely reset and reinitialise the system
 	void	Reset(); // Reset current execution context
 	void	Clear(); // Clear current execution buffers (implies Reset())
@@ -121,6 +159,68 @@ public:
 	void	Compile(); // Invoke backend to compile the bytecode
 	calc_t	Exec(); // Execute current system state whatever it is now
 
+	MemoryUsage QueryMemoryUsage( ctx_t id ); // Query memory taken by a context buffer, the stacks and the native images
+
+	// Map a host array over the DATA region or the bytepool string named by a symbol of the current context.
+	void	MapHostBuffer( const char* symbol, void* buffer, size_t count, Value::Type type = Value::V_MAX );
+	void	UnmapHostBuffer( const char* symbol );
+
+	// Drop the symbols of a linked context which are not needed to run it, keeping the given ones
+	// (for production images; see ILinker::StripSymbols() and WO_STRIP_SYMBOLS).
+	void	StripSymbols( ctx_t id, const std::vector<std::string>& exported );
+
+	// Drop the code and the data of a linked context which cannot be reached from its entry point
+	// and the given symbols (see ILinker::EliminateDeadCode()). Symbols used by the host shall be given.
+	void	EliminateDeadCode( ctx_t id, const std::vector<std::string>& exported );
+
+	// Profile-driven data layout: count DATA accesses in a training run (see ILogic::SetDataProfiling()),
+	// save the counts by data symbol as "<count> <symbol>" lines, and reorder the data of a linked context
+	// so that the accessed objects come first (see ILinker::ReorderData()).
+	void	DumpDataProfile( ctx_t id, FILE* file );
+	void	ReorderData( ctx_t id, FILE* profile );
+
+	// Replace a module of a merged context (identified by the ID of the context it was merged from)
+	// with the one loaded from a file, without merging everything again. The module is placed over its
+	// old ranges if it fits there or if they are the last ones, or else appended; the symbols it used to
+	// define are re-linked to the new definitions, and the native image of the merged context is dropped.
+	// If the new module does not link (e.g. it redefines a symbol of another module), the merged context
+	// is left as it was. Ranges left behind are not reused, so a module which keeps growing while others
+	// follow it grows the context until it is merged again. Not available for contexts merged with
+	// LO_MERGE_STRINGS or stripped. Addresses stored in data are not updated. The reader shall be attached.
+	void	ReplaceModule( ctx_t module, FILE* file );
+
+	// Share a loaded program between instances: export it once, then instantiate it
+	// in any number of ProcessorAPI objects. Each instance has its own data, registers and stacks.
+	program_image_t	ExportImage( ctx_t id );
+	ctx_t	Instantiate( const program_image_t& image ); // Load the image into a new context
+
+	// Stream a binary file into a new context: LoadStreamBegin() returns as soon as the first code chunk
+	// (and everything written before it) is loaded, so the context may be executed right away.
+	// Exec() loads further sections whenever execution leaves the loaded code; LoadStreamStep() loads
+	// one section in the meantime and returns false once the file is complete. The reader shall stay attached.
+	ctx_t	LoadStreamBegin( FILE* file );
+	bool	LoadStreamStep();
+	bool	IsStreaming() const { return stream_.context; }
+
+	// Save the complete machine state (all context buffers, the stacks, the call stack and the current context)
+	// into a file of this build's in-memory format, and replace the current state with a saved one.
+	// Restore() maps the file and uses the images in place; context IDs are reassigned, and
+	// the current context ID is returned. Host buffers and native images are not saved.
+	void	Snapshot( FILE* file );
+	ctx_t	Restore( FILE* file );
+
+	// Cache of byte-code for modules loaded from sources (e.g. assembly) in a directory. An entry is keyed by
+	// the hashes of the source contents, of the command set version and of the linker options.
+	// OpenCachedModule() sets "entry" to the path of the entry for a source file and returns the entry
+	// opened, to be loaded with a byte-code reader, or nullptr on a miss; the source is left open and in place.
+	// If the entry fails to load, DiscardCachedModule() removes it and the source is to be loaded instead.
+	// CacheModule() writes a context loaded from the source with the attached byte-code writer;
+	// failing to write it is not an error.
+	void	SetModuleCache( const char* directory ); // nullptr to disable; the directory is created if needed
+	FILE*	OpenCachedModule( FILE* source, std::string* entry );
+	void	DiscardCachedModule( const std::string& entry );
+	void	CacheModule( ctx_t id, const std::string& entry );
+
 	void DumpExecutionContext( std::string* ctx_dump );
 };
 
@@ -172,6 +272,10 @@ public:
 	virtual void	Write( const DirectReference& ref, calc_t value ) = 0; // Use DATA reference to write
 	virtual void	UpdateType( const DirectReference& ref, Value::Type type ) = 0; // Use DATA reference to rewrite its type
 
+	// DATA accesses through the above may be counted by context buffer and address (compiled code is not counted).
+	virtual void	SetDataProfiling( bool enable ) = 0; // Start or stop counting; the counts are kept
+	virtual std::vector<size_t> QueryDataProfile( ctx_t ctx ) const = 0; // Access counts by DATA address (may be shorter than the section)
+
 	// Stack management commands operate on the stack corresponding to the last command executed
 	// and are designed for usage by the execution unit modules (or external inspection code).
 	virtual size_t	StackSize() = 0; // Calculation stack "count of elements" operation
@@ -184,6 +288,8 @@ public:
 	virtual void    SaveCurrentContext() = 0; // Saves the current context (state and buffer) onto the call stack
 	virtual void    RestoreCurrentContext() = 0; // Restores the current context from the call stack
 	virtual void    ClearContextStack() = 0; // Clears the call stack
+	virtual std::vector<Context> QueryContextStack() const = 0; // Returns a copy of the call stack, bottom first
+	virtual void    SetContextStack( const std::vector<Context>& stack ) = 0; // Replaces the call stack (bottom first)
 
 	virtual void	ExecuteSingleCommand( Command& command ) = 0; // Execute a single command
 	virtual std::string	DumpCommand( Command& command ) const = 0; // Decode and log a single command
@@ -212,6 +318,10 @@ public:
 
 	// Returns handle for given command and implementation.
 	virtual void* GetExecutionHandle( const CommandTraits& cmd, size_t module ) = 0;
+
+	// Returns a hash of the registered commands (IDs, mnemonics and argument kinds).
+	// Byte-code produced with one version may be decoded differently with another one.
+	virtual size_t Version() const = 0;
 };
 
 // many would want to do a shared R/W handler to share some routines
@@ -229,6 +339,14 @@ public:
 	// Reads current section image into "destination".
 	virtual llarray ReadSectionImage() = 0;
 
+	// Returns current section image in place (writable, valid while "backing" is held),
+	// or nullptr if the reader cannot provide it; then ReadSectionImage() shall be used.
+	virtual void* MapSectionImage( std::shared_ptr<void>* backing ) = 0;
+
+	// Returns a source to read current section image from on demand (valid after the reader is reset),
+	// or nullptr if the reader cannot provide it. Payload checksums are not verified then.
+	virtual section_source_t DeferSectionImage() = 0;
+
 	// Reads current section symbol map into "destination".
 	virtual symbol_map ReadSymbols() = 0;
 
@@ -258,6 +376,7 @@ public:
 	virtual void			SelectContextBuffer( ctx_t id ) = 0; // Select a different context buffer. NOTE: Do not use this function, see ILogic.
 	virtual void			ReleaseContextBuffer( ctx_t id ) = 0; // Release a context buffer; deselect if selected
 	virtual void			ResetContextBuffer( ctx_t id ) = 0; // Clear a context buffer (was ResetBuffers())
+	virtual std::vector<ctx_t> QueryContextBuffers() const = 0; // List allocated context buffers in ascending order
 
 	virtual size_t			QueryStackTop( Value::Type type ) const = 0; // Get absolute value of a stack's top (0 means stack is empty)
 	virtual void            SetStackTop( Value::Type type, ssize_t adjust ) = 0; // Set a stack top relative to its current value
@@ -265,22 +384,49 @@ public:
 	virtual calc_t&			AStackFrame( Value::Type type, ssize_t offset ) = 0; // Access calculation stack relative to context's stack frame pointer
 	virtual calc_t&			AStackTop( Value::Type type, size_t offset ) = 0; // Access calculation stack relative to its top
 	virtual calc_t&			ARegister( Register reg_id ) = 0; // Access register
-	virtual Command&		ACommand( size_t ip ) = 0; // Access CODE section
+	virtual Command&		ACommand( size_t ip ) = 0; // Access CODE section. NOTE: Do not modify commands if IsCodeShared().
 	virtual calc_t&			AData( size_t addr ) = 0; // Access DATA section
-	virtual symbol_type&	ASymbol( size_t hash ) = 0; // Access symbol buffer
+	virtual const symbol_type& ASymbol( size_t hash ) = 0; // Access symbol buffer
 	virtual char*			ABytepool( size_t offset ) = 0; // Access byte pool
 
 	virtual Offsets			QuerySectionLimits() const = 0; // Query current section sizes (limits)
+	virtual size_t			QueryReservedData( calc_t* pattern ) const = 0; // Query count (and fill pattern) of not yet materialised trailing DATA cells
+	virtual void			MaterializeReservedData() = 0; // Allocate the reserved trailing DATA cells now (e. g. before their addresses are taken)
+	virtual MemoryUsage		QueryMemoryUsage( ctx_t id ) const = 0; // Query memory taken by a context buffer and the stacks
+
+	// Host buffers are accessed in place by the interpreter and by compiled code.
+	// A mapped DATA cell has a fixed type and is not addressable through AData(); use ReadData()/WriteData()/ADataPayload().
+	// Compiled images embed the buffer addresses, so (re)mapping changes the state checksum.
+	virtual void			MapHostBuffer( MemorySectionIdentifier section, size_t address,
+	                                       void* buffer, size_t count, Value::Type type ) = 0; // Map a host array over a DATA or BYTEPOOL range
+	virtual void			UnmapHostBuffer( MemorySectionIdentifier section, size_t address ) = 0; // Remove a mapping starting at the given address
+	virtual std::vector<HostBuffer> QueryHostBuffers( MemorySectionIdentifier section ) const = 0; // List mappings of the current context buffer
+
+	virtual calc_t			ReadData( size_t addr ) = 0; // Read a DATA cell, whether mapped or not
+	virtual void			WriteData( size_t addr, const calc_t& value ) = 0; // Write a DATA cell, whether mapped or not (type-checked)
+	virtual void*			ADataPayload( size_t addr, Value::Type* type = nullptr ) = 0; // Access raw int_t/fp_t storage of a DATA cell
+	virtual void			SetDataType( size_t addr, Value::Type type ) = 0; // Set type of a DATA cell; a mapped cell keeps its own
 
 	virtual llarray			DumpSection( MemorySectionIdentifier section, size_t address,
 	                                     size_t count ) = 0;
+	virtual const void*		ViewSection( MemorySectionIdentifier section, size_t address,
+	                                     size_t count ) = 0; // Access a CODE, DATA or BYTEPOOL range in place (until modified), or nullptr if host buffers overlay it or it is not contiguous
 	virtual void			ModifySection( MemorySectionIdentifier section, size_t address,
 	                                       const void* data, size_t count, bool insert = false ) = 0;
+	virtual void			ResizeSection( MemorySectionIdentifier section, size_t count ) = 0; // Truncate or extend (with empty data) a CODE, DATA or BYTEPOOL image
 	virtual void			AppendSection( MemorySectionIdentifier section,
-	                                       const void* data, size_t count ) = 0;
+	                                       const void* data, size_t count ) = 0; // For SEC_DATA_RESERVE, "data" is a single calc_t fill pattern
+	virtual void			AdoptSection( MemorySectionIdentifier section, void* data, size_t count,
+	                                      const std::shared_ptr<void>& backing ) = 0; // Use external storage as an empty CODE, DATA or BYTEPOOL image in place (copied on resize)
+	virtual void			DeferSection( MemorySectionIdentifier section, size_t count,
+	                                      const section_source_t& source ) = 0; // Use an empty DATA or BYTEPOOL image read from "source" page by page on first access
 
 	virtual void			ShiftImages( const Offsets& offsets ) = 0; // Shift forth all sections by specified offset, filling space with empty data.
-	virtual void			PasteFromContext( ctx_t id ) = 0; // Paste the specified context over the current one
+	virtual void			PasteFromContext( ctx_t id, const Offsets& at ) = 0; // Paste the specified context over the current one at given offsets
+
+	virtual program_image_t	ExportImage( ctx_t id ) = 0; // Freeze a copy of the context buffer into a shareable program image
+	virtual ctx_t			InstantiateImage( const program_image_t& image ) = 0; // Allocate a context buffer sharing the image's code and symbols
+	virtual bool			IsCodeShared() const = 0; // Whether the current context buffer executes a shared image (its code is read-only)
 
 	virtual void			SetSymbolImage( symbol_map&& symbols ) = 0; //
 	virtual symbol_map		DumpSymbolImage() const = 0; // Write symbol map to image
@@ -313,6 +459,15 @@ public:
 	virtual bool		ImageIsOK( size_t chk ) = 0;
 	virtual abi_native_fn_t
 						GetImage( size_t chk ) = 0;
+	virtual MemoryCounter
+						QueryImageMemory() const = 0; // Memory taken by all native images
+
+	// A compiled image may be saved in a relocatable form and imported into another process
+	// for a context with the same code; an imported image is relocated and mapped by CompileBuffer().
+	virtual llarray		ExportImage( size_t chk ) = 0;
+	virtual bool		ImportImage( size_t chk, const void* image, size_t size ) = 0; // Returns false if the image is not for this backend
+
+	virtual void		ReleaseImage( size_t chk ) = 0; // Drop the image (if any) compiled for a checksum
 
 	static IBackend* BackendForCurrentProcessor();
 };
@@ -334,14 +489,47 @@ public:
 	// Use provided offsets for auto-placement.
 	virtual void DirectLink_HandleReference( Reference& ref, const Offsets& limits ) = 0;
 
-	// Relocate the temporary image:
-	// - adjust symbols and (possibly) references
-	virtual void Relocate( const Offsets& offsets ) = 0;
+	// Relocate an image pasted into the current context at given offsets:
+	// - adjust its symbols and the direct references of its "code_count" commands (starting at offsets.Code())
+	virtual void Relocate( symbol_map& symbols, const Offsets& offsets, size_t code_count ) = 0;
+
+	// Intern identical strings and string suffixes in the bytepool of the current context,
+	// rewriting direct bytepool references of the code and the symbols.
+	// The pool is kept as is unless it consists of NUL-terminated strings, each referenced
+	// only by plain addresses of its start.
+	// Only for a context just built by Load() or MergeContexts(): addresses taken at run time are not tracked.
+	virtual void MergeStrings() = 0;
 
 	// Collect symbols from another linked source and append them to the temporary image.
 	// Do not auto-place.
 	virtual void MergeLink_Add( symbol_map&& symbols ) = 0;
 
+	// Relocate images pasted into the current context and merge-link their symbols, with the same result as
+	// Relocate() and MergeLink_Add() called for each of them in order, on up to "jobs" threads: the images
+	// are relocated independently, then their symbol maps are merged pairwise. Redefinitions are reported at once.
+	virtual void MergeLink_AddParallel( std::vector<symbol_map>&& symbols, const std::vector<Offsets>& offsets,
+	                                    const std::vector<size_t>& code_counts, size_t jobs ) = 0;
+
+	// Replace references to plainly defined symbols in the code of the current context with their addresses,
+	// then drop defined symbols which are neither exported (given by hash) nor referenced any more.
+	// The context shall not be merged into another one afterwards.
+	virtual void StripSymbols( const std::vector<size_t>& exported ) = 0;
+
+	// Drop the commands and the data of the current context which are not reachable from the first command
+	// and the exported symbols (given by hash), compacting the sections; calls, jumps and data references
+	// are followed. A section accessed at computed addresses is kept as is. Symbols defined in dropped
+	// ranges are dropped as well. The context shall not be executing.
+	virtual void EliminateDeadCode( const std::vector<size_t>& exported ) = 0;
+
+	// Sum DATA access counts (by address) of the current context over its data objects, that is, ranges
+	// between the addresses of data symbols. Returns the count of each data symbol (by hash).
+	virtual std::unordered_map<size_t, size_t> AggregateDataProfile( const std::vector<size_t>& counts ) = 0;
+
+	// Reorder the data objects of the current context so that the ones with the highest counts
+	// (given by symbol hash, see AggregateDataProfile()) come first, rewriting DATA references and symbols.
+	// Nothing is moved if DATA is accessed at computed addresses or host buffers are mapped.
+	virtual void ReorderData( const std::unordered_map<size_t, size_t>& profile ) = 0;
+
 	// Retrieve a direct reference for given arbitrary reference.
 	// If "partial_resolution" is not null, the reference shall be resolved statically: that is,
 	// 1) no indirections and dynamic symbols shall be resolved,
@@ -1,6 +1,11 @@
 #include "stdafx.h"
 #include "Linker.h"
 
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <numeric>
+
 // -------------------------------------------------------------------------------------
 // Library		Homework
 // File			Linker.cpp
@@ -12,6 +17,332 @@ namespace
 {
 	using namespace Processor;
 
+	// Insert a symbol record, replacing a usage already present with a definition.
+	// Returns false on redefinition.
+	bool LinkInto( symbol_map& target, const symbol_map::value_type& symbol_record )
+	{
+		const Symbol& symbol = symbol_record.second.second;
+		std::pair<symbol_map::iterator, bool> result = target.insert( symbol_record );
+
+		if( !result.second ) {
+			Symbol& existing = result.first->second.second;
+
+			if( existing.is_resolved ) {
+				return !symbol.is_resolved;
+			} else if( symbol.is_resolved ) {
+				existing = symbol;
+			}
+		}
+
+		return true;
+	}
+
+	// Link all records of "source" into "target", collecting the names of redefined symbols.
+	void LinkAllInto( symbol_map& target, const symbol_map& source, std::vector<std::string>& redefinitions )
+	{
+		target.reserve( target.size() + source.size() );
+		for( const symbol_map::value_type& symbol_record: source ) {
+			if( !LinkInto( target, symbol_record ) ) {
+				redefinitions.push_back( symbol_record.second.first.c_str() );
+			}
+		}
+	}
+
+	// Whether all symbols a reference depends on (through aliases) are defined.
+	bool IsDefined( const Reference& ref, const symbol_map& symbols, unsigned depth = 0 )
+	{
+		static const unsigned max_alias_depth = 64;
+		if( depth > max_alias_depth ) {
+			return false; // an alias loop
+		}
+
+		for( unsigned i = 0; i <= ref.has_second_component; ++i ) {
+			const Reference::BaseRef& bref = ref.components[i].target;
+
+			if( bref.type == Reference::BaseRef::BRT_DEFINITION ) {
+				return false;
+			}
+
+			if( bref.type == Reference::BaseRef::BRT_SYMBOL ) {
+				symbol_map::const_iterator it = symbols.find( bref.symbol_hash );
+				if( it == symbols.end() || !it->second.second.is_resolved ||
+				    !IsDefined( it->second.second.ref, symbols, depth + 1 ) ) {
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// Whether a symbol is defined as a plain address in the given section,
+	// or as a plain alias of such a symbol (so that it follows the address when it is moved).
+	bool IsMovable( const Symbol& symbol, AddrType section, const symbol_map& symbols, unsigned depth = 0 )
+	{
+		static const unsigned max_alias_depth = 64;
+		const Reference& ref = symbol.ref;
+		const Reference::SingleRef& sref = ref.components[0];
+
+		if( !symbol.is_resolved || depth > max_alias_depth ||
+		    ref.has_second_component || sref.indirection_section != S_NONE ) {
+			return false;
+		}
+
+		if( sref.target.type == Reference::BaseRef::BRT_MEMORY_REF ) {
+			return ref.global_section == section;
+		}
+
+		if( sref.target.type == Reference::BaseRef::BRT_SYMBOL &&
+		    ( ref.global_section == S_NONE || ref.global_section == section ) ) {
+			symbol_map::const_iterator it = symbols.find( sref.target.symbol_hash );
+			return it != symbols.end() && IsMovable( it->second.second, section, symbols, depth + 1 );
+		}
+
+		return false;
+	}
+
+	// Whether a symbol names a data object, that is, is defined as a plain DATA address.
+	bool IsDataObject( const Symbol& symbol, const symbol_map& symbols )
+	{
+		return IsMovable( symbol, S_DATA, symbols ) &&
+		       symbol.ref.components[0].target.type == Reference::BaseRef::BRT_MEMORY_REF;
+	}
+
+	// Beginnings of the data objects (ranges between the addresses of data symbols) of a DATA section
+	// of the given size: ascending, starting with 0; empty if the section is.
+	std::vector<size_t> DataObjects( const symbol_map& symbols, size_t size )
+	{
+		std::vector<size_t> begin( 1, 0 );
+
+		for( const symbol_map::value_type& symbol_record: symbols ) {
+			const Symbol& symbol = symbol_record.second.second;
+			if( IsDataObject( symbol, symbols ) ) {
+				begin.push_back( symbol.ref.components[0].target.memory_address );
+			}
+		}
+
+		std::sort( begin.begin(), begin.end() );
+		begin.erase( std::unique( begin.begin(), begin.end() ), begin.end() );
+		while( !begin.empty() && begin.back() >= size ) {
+			begin.pop_back();
+		}
+
+		return begin;
+	}
+
+	// Index of the data object containing an address (see DataObjects()).
+	size_t DataObjectOf( const std::vector<size_t>& begin, size_t address )
+	{
+		return std::upper_bound( begin.begin(), begin.end(), address ) - begin.begin() - 1;
+	}
+
+	/*
+	 * Liveness of the CODE or DATA section for dead code elimination.
+	 * The section is kept or dropped by units: single commands, or data objects
+	 * (ranges between the addresses of data symbols).
+	 */
+	struct SectionLiveness
+	{
+		size_t size;
+		bool dynamic; // addressed at computed addresses, thus kept as is
+		std::vector<size_t> unit_begin; // ascending, starting with 0; empty if each address is a unit
+		std::vector<bool> live; // per address
+
+		struct Run
+		{
+			size_t begin, end, new_begin;
+		};
+		std::vector<Run> runs; // live ranges, see Layout()
+
+		explicit SectionLiveness( size_t section_size ) :
+			size( section_size ),
+			dynamic( false ),
+			unit_begin(),
+			live( section_size, false ),
+			runs()
+		{
+		}
+
+		// Mark the units covering [first; last] live, appending the newly live addresses to "marked" (if not null).
+		void Mark( size_t first, size_t last, std::vector<size_t>* marked = nullptr )
+		{
+			last = std::min( last, size - 1 );
+
+			for( size_t address = first; address <= last && address < size; ) {
+				size_t begin = address, end = address + 1;
+
+				if( !unit_begin.empty() ) {
+					std::vector<size_t>::const_iterator unit = std::upper_bound( unit_begin.begin(), unit_begin.end(), address ) - 1;
+					begin = *unit;
+					end = ( unit + 1 == unit_begin.end() ) ? size : *( unit + 1 );
+				}
+
+				if( !live[begin] ) {
+					for( size_t i = begin; i < end; ++i ) {
+						live[i] = true;
+						if( marked ) {
+							marked->push_back( i );
+						}
+					}
+				}
+
+				address = end;
+			}
+		}
+
+		// Lay out the live ranges one after another; returns the new size.
+		size_t Layout()
+		{
+			runs.clear();
+			size_t new_size = 0;
+
+			for( size_t address = 0; address < size; ) {
+				if( !live[address] ) {
+					++address;
+					continue;
+				}
+
+				Run run = { address, address, new_size };
+				while( run.end < size && live[run.end] ) {
+					++run.end;
+				}
+
+				new_size += run.end - run.begin;
+				runs.push_back( run );
+				address = run.end;
+			}
+
+			return new_size;
+		}
+
+		// New address of a live address (or of the end of the section).
+		size_t Map( size_t address ) const
+		{
+			if( address >= size ) {
+				return runs.empty() ? 0 : runs.back().new_begin + ( runs.back().end - runs.back().begin );
+			}
+
+			size_t lo = 0, hi = runs.size();
+			while( hi - lo > 1 ) {
+				size_t mid = ( lo + hi ) / 2;
+				if( runs[mid].begin <= address ) {
+					lo = mid;
+				} else {
+					hi = mid;
+				}
+			}
+
+			s_cassert( !runs.empty() && runs[lo].begin <= address && address < runs[lo].end,
+			           "Mapping a dead address %zu", address );
+			return runs[lo].new_begin + ( address - runs[lo].begin );
+		}
+	};
+
+	// Run "task" for each index below "count" on up to "jobs" threads (including the calling one).
+	// The first exception thrown by a task is rethrown once all threads are done.
+	template <typename Task>
+	void ParallelFor( size_t count, size_t jobs, const Task& task )
+	{
+		jobs = std::min( jobs, count );
+		if( jobs <= 1 ) {
+			for( size_t i = 0; i < count; ++i ) {
+				task( i );
+			}
+			return;
+		}
+
+		std::atomic<size_t> next( 0 );
+		std::exception_ptr error;
+		std::mutex error_mutex;
+
+		auto worker = [&]() {
+			for( size_t i = next++; i < count; i = next++ ) {
+				try {
+					task( i );
+				} catch( ... ) {
+					std::lock_guard<std::mutex> lock( error_mutex );
+					if( !error ) {
+						error = std::current_exception();
+					}
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for( size_t i = 1; i < jobs; ++i ) {
+			threads.push_back( std::thread( worker ) );
+		}
+
+		worker();
+
+		for( std::thread& thread: threads ) {
+			thread.join();
+		}
+
+		if( error ) {
+			std::rethrow_exception( error );
+		}
+	}
+
+	// Returns the component of a reference holding a direct bytepool address
+	// (as placed by the linker for string literals), or nullptr.
+	Reference::BaseRef* DirectBytepoolTarget( Reference& ref )
+	{
+		Reference::SingleRef& sref = ref.components[0];
+
+		if( ref.global_section != S_BYTEPOOL ||
+		    sref.indirection_section != S_NONE ||
+		    sref.target.type != Reference::BaseRef::BRT_MEMORY_REF ) {
+			return nullptr;
+		}
+
+		return &sref.target;
+	}
+
+	// Replaces a symbol component of a reference with the address of the symbol, if the symbol
+	// is defined as a plain address. Returns false if the component shall keep the symbol.
+	bool InlineSymbol( Reference& ref, unsigned component, const Symbol& symbol )
+	{
+		const Reference& definition = symbol.ref;
+		const Reference::SingleRef& def_sref = definition.components[0];
+
+		if( !symbol.is_resolved ||
+		    definition.has_second_component ||
+		    definition.global_section == S_NONE || definition.global_section >= S_MAX ||
+		    def_sref.indirection_section != S_NONE ||
+		    def_sref.target.type != Reference::BaseRef::BRT_MEMORY_REF ) {
+			return false;
+		}
+
+		// The section of the symbol is applied the same way as by UATLinker::Resolve().
+		Reference::SingleRef& sref = ref.components[component];
+		if( sref.indirection_section == S_NONE ) {
+			if( ref.global_section != S_NONE ) {
+				return false;
+			}
+			ref.global_section = definition.global_section;
+		} else {
+			if( sref.indirection_section != S_MAX ) {
+				return false;
+			}
+			sref.indirection_section = definition.global_section;
+		}
+
+		sref.target = def_sref.target;
+		return true;
+	}
+
+	bool IsReversedLess( const std::string& lhs, const std::string& rhs )
+	{
+		return std::lexicographical_compare( lhs.rbegin(), lhs.rend(), rhs.rbegin(), rhs.rend() );
+	}
+
+	bool IsSuffix( const std::string& suffix, const std::string& str )
+	{
+		return suffix.size() <= str.size() &&
+		       std::equal( suffix.rbegin(), suffix.rend(), str.rbegin() );
+	}
+
 } // unnamed namespace
 
 namespace ProcessorImplementation
@@ -74,9 +405,10 @@ void UATLinker::DirectLink_Add( symbol_map&& symbols, const Offsets& limits )
 
 	char sym_nm_buf[STATIC_LENGTH];
 
+	temporary_map.reserve( temporary_map.size() + symbols.size() );
 	for( symbol_map::value_type & symbol_record: symbols ) {
 		Symbol& symbol			= symbol_record.second.second;
-		const std::string& name	= symbol_record.second.first;
+		const SymbolName& name	= symbol_record.second.first;
 		size_t hash				= symbol.hash;
 
 		snprintf( sym_nm_buf, STATIC_LENGTH, "\"%s\" (hash %zx)", name.c_str(), hash );
@@ -95,7 +427,7 @@ void UATLinker::DirectLink_Add( symbol_map&& symbols, const Offsets& limits )
 			msg( E_INFO, E_DEBUG, "Usage of symbol %s", sym_nm_buf );
 		}
 
-		temporary_map.insert( symbol_record );
+		LinkSymbol( symbol_record );
 	}
 
 	msg( E_INFO, E_DEBUG, "(Direct link) add completed" );
@@ -129,7 +461,7 @@ DirectReference UATLinker::Resolve( const Reference& reference, bool* partial_re
 		/* resolve main base address of the component */
 		if( bref.type == Reference::BaseRef::BRT_SYMBOL ) {
 			msg( E_INFO, E_DEBUG, "[Component %u]: reference to symbol, hash %zx", i, bref.symbol_hash );
-			symbol_type& referenced_symbol = proc_->MMU()->ASymbol( bref.symbol_hash );
+			const symbol_type& referenced_symbol = proc_->MMU()->ASymbol( bref.symbol_hash );
 			cverify( referenced_symbol.second.is_resolved, "Undefined symbol requested at runtime: \"%s\"",
 					 referenced_symbol.first.c_str() );
 			tmp_reference = Resolve( referenced_symbol.second.ref, partial_resolution );
@@ -194,14 +526,15 @@ void UATLinker::DirectLink_Init()
 	verify_method;
 
 	msg( E_INFO, E_DEBUG, "Starting link session" );
-	temporary_map.clear();
+	temporary_map = proc_->MMU()->DumpSymbolImage();
 
-	symbol_map source = proc_->MMU()->DumpSymbolImage();
+	msg( E_INFO, E_DEBUG, "Inserted existing symbols (count: %zu)", temporary_map.size() );
+}
 
-	msg( E_INFO, E_DEBUG, "Inserting existing symbols (count: %zu)", source.size() );
-	for( symbol_map::value_type& source_sym: source ) {
-		temporary_map.insert( source_sym );
-	}
+void UATLinker::LinkSymbol( const symbol_map::value_type& symbol_record )
+{
+	cverify( LinkInto( temporary_map, symbol_record ), "Symbol redefinition: \"%s\" (hash %zx)",
+	         symbol_record.second.first.c_str(), symbol_record.first );
 }
 
 void UATLinker::DirectLink_Commit( bool UAT )
@@ -209,49 +542,26 @@ void UATLinker::DirectLink_Commit( bool UAT )
 	verify_method;
 
 	msg( E_INFO, E_VERBOSE, "Ending link session: linking %lu symbols", temporary_map.size() );
-	symbol_map target_map;
-
-	char sym_nm_buf[STATIC_LENGTH];
-
-	for( symbol_map::value_type& symbol_iterator: temporary_map ) {
-		symbol_type* current_symbol_record = &symbol_iterator.second;
-		size_t hash                        = current_symbol_record->second.hash;
-		auto existing_record               = target_map.find( hash );
 
-		snprintf( sym_nm_buf, STATIC_LENGTH, "\"%s\" (hash %zx)",
-		          current_symbol_record->first.c_str(), hash );
+	// Duplicates have been resolved on insertion (see LinkSymbol()).
+	for( const symbol_map::value_type& symbol_record: temporary_map ) {
+		const Symbol& symbol = symbol_record.second.second;
 
-		cassert( hash == symbol_iterator.first,
-		         "Internal map inconsistency in %s: hash %zx <-> key %zx",
-		         sym_nm_buf, hash, symbol_iterator.first );
-
-		Symbol& symbol = current_symbol_record->second;
+		cassert( symbol.hash == symbol_record.first,
+		         "Internal map inconsistency in \"%s\": hash %zx <-> key %zx",
+		         symbol_record.second.first.c_str(), symbol.hash, symbol_record.first );
 
 		for( int i = 0; i < 1 + symbol.ref.has_second_component; ++i ) {
 			cassert( symbol.ref.components[i].target.type != Reference::BaseRef::BRT_DEFINITION,
-					 "Unplaced symbol %s", sym_nm_buf );
-		}
-
-		// Replace any reference already present in the map.
-		if( existing_record != target_map.end() ) {
-			bool existing_is_definition = existing_record->second.second.is_resolved;
-			bool new_is_definition = symbol.is_resolved;
-
-			if( existing_is_definition ) {
-				cverify( !new_is_definition, "Symbol redefinition: %s", sym_nm_buf );
-			} else if( new_is_definition ) {
-				existing_record->second.second = symbol;
-			}
-		} else {
-			target_map.insert( symbol_iterator );
+					 "Unplaced symbol \"%s\" (hash %zx)", symbol_record.second.first.c_str(), symbol.hash );
 		}
-	} // for (temporary_map)
+	}
 
 	if( UAT ) {
 		casshole( "Not implemented" );
 	}
 
-	proc_->MMU()->SetSymbolImage( std::move( target_map ) );
+	proc_->MMU()->SetSymbolImage( std::move( temporary_map ) );
 	temporary_map.clear(); // Well, MMU should move-assign our map, but who knows...
 
 	msg( E_INFO, E_VERBOSE, "Link session completed" );
@@ -264,27 +574,34 @@ void UATLinker::RelocateReference( Reference& ref, const Offsets& offsets )
 	cassert( sref.target.type == Reference::BaseRef::BRT_MEMORY_REF, "Shall not relocate symbol references" );
 
 	MemorySectionIdentifier section( ref.global_section );
-	if( !section.isValid() ) {
-		msg( E_INFO, E_DEBUG, "Relocating: section %s - not relocating",
-		     ProcDebug::Print( ref.global_section ).c_str() );
-	} else {
-		size_t offset = offsets[section];
-		msg( E_INFO, E_DEBUG, "Relocating: section %s offset %zu",
-		     ProcDebug::Print( ref.global_section ).c_str(), offset );
-		sref.target.memory_address += offset;
+	if( section.isValid() ) {
+		sref.target.memory_address += offsets[section];
 	}
 }
 
-void UATLinker::Relocate( const Offsets& offsets )
+void UATLinker::Relocate( symbol_map& symbols, const Offsets& offsets, size_t code_count )
 {
-	msg( E_INFO, E_DEBUG, "Relocating %zu symbols", temporary_map.size() );
+	if( !offsets.Code() && !offsets.Data() && !offsets.Bytepool() ) {
+		return;
+	}
 
-	for( symbol_tmap::value_type& symbol_pair: temporary_map ) {
-		Symbol& symbol = symbol_pair.second.second;
+	size_t relocated_symbols = RelocateSymbols( symbols, offsets ), relocated_strings = 0;
 
-		msg( E_INFO, E_DEBUG, "Relocating symbol \"%s\": reference to %s",
-			 symbol_pair.second.first.c_str(),
-			 ProcDebug::PrintReference( symbol.ref, nullptr ).c_str() );
+	if( code_count ) {
+		relocated_strings = RelocateCode( &proc_->MMU()->ACommand( offsets.Code() ), code_count, offsets,
+		                                  proc_->CommandSet() );
+	}
+
+	msg( E_INFO, E_DEBUG, "Relocated %zu of %zu symbols and %zu string references in code [%zu; %zu)",
+	     relocated_symbols, symbols.size(), relocated_strings, offsets.Code(), offsets.Code() + code_count );
+}
+
+size_t UATLinker::RelocateSymbols( symbol_map& symbols, const Offsets& offsets )
+{
+	size_t relocated = 0;
+
+	for( symbol_map::value_type& symbol_pair: symbols ) {
+		Symbol& symbol = symbol_pair.second.second;
 
 		// Relocate only defined symbol records.
 		// Reason: for relocation of an image A (i. e., shifting all data in the image A)
@@ -317,8 +634,747 @@ void UATLinker::Relocate( const Offsets& offsets )
 
 		if( !do_skip ) {
 			RelocateReference( ref, offsets );
+			++relocated;
+		}
+	}
+
+	return relocated;
+}
+
+size_t UATLinker::RelocateCode( Command* commands, size_t code_count, const Offsets& offsets, const ICommandSet* cset )
+{
+	// String literals are the only direct references placed by the linker,
+	// so they are the only ones to follow the shifted bytepool.
+	if( !offsets.Bytepool() ) {
+		return 0;
+	}
+
+	size_t relocated = 0;
+
+	for( size_t i = 0; i < code_count; ++i ) {
+		Command& cmd = commands[i];
+
+		if( cset->DecodeCommand( cmd.id )->arg_type != A_REFERENCE ) {
+			continue;
+		}
+
+		if( Reference::BaseRef* target = DirectBytepoolTarget( cmd.arg.ref ) ) {
+			target->memory_address += offsets.Bytepool();
+			++relocated;
+		}
+	}
+
+	return relocated;
+}
+
+void UATLinker::MergeStrings()
+{
+	verify_method;
+
+	IMMU* mmu = proc_->MMU();
+	ICommandSet* cset = proc_->CommandSet();
+	Offsets limits = mmu->QuerySectionLimits();
+
+	if( !limits.Bytepool() ) {
+		return;
+	}
+
+	msg( E_INFO, E_VERBOSE, "Merging bytepool strings (%zu bytes)", limits.Bytepool() );
+
+	if( !mmu->QueryHostBuffers( SEC_BYTEPOOL_IMAGE ).empty() ) {
+		msg( E_WARNING, E_VERBOSE, "Not merging strings: host buffers are mapped over the bytepool" );
+		return;
+	}
+
+	// Addresses taken at run time (by "lea") cannot be rewritten, so this runs only on contexts
+	// the loader has just built (see ILinker::MergeStrings()). A context being executed is refused.
+	ctx_t buffer = mmu->CurrentContextBuffer();
+	for( const Context& ctx: proc_->LogicProvider()->QueryContextStack() ) {
+		cassert( ctx.buffer != buffer, "Attempt to merge strings of context %zu which is being executed", buffer );
+	}
+
+	llarray pool_image = mmu->DumpSection( SEC_BYTEPOOL_IMAGE, 0, limits.Bytepool() );
+	const char* pool = pool_image;
+
+	/*
+	 * Only plain references to the start of a string are followed: each referenced address starts
+	 * a string which extends up to (and including) the next NUL. Anything else (a computed or
+	 * indirect address, a symbol with an offset, an address in the middle of a string, or bytes
+	 * past a terminator nobody references, e. g. the tail of a literal with an embedded NUL)
+	 * may reach bytes which would be moved, so the pool is kept as is.
+	 */
+	std::map<size_t, std::string> strings;
+
+	std::vector<std::pair<size_t, Command> > commands;
+	symbol_map symbols = mmu->DumpSymbolImage();
+
+	// Symbols which (possibly through aliases) denote bytepool addresses.
+	std::unordered_set<size_t> pool_symbols;
+	for( bool changed = true; changed; ) {
+		changed = false;
+
+		for( const symbol_map::value_type& symbol_record: symbols ) {
+			const Reference& ref = symbol_record.second.second.ref;
+			if( !symbol_record.second.second.is_resolved || pool_symbols.count( symbol_record.first ) ) {
+				continue;
+			}
+
+			bool is_pool = ref.global_section == S_BYTEPOOL;
+			for( unsigned i = 0; i <= ref.has_second_component; ++i ) {
+				is_pool |= ref.components[i].target.type == Reference::BaseRef::BRT_SYMBOL &&
+				           pool_symbols.count( ref.components[i].target.symbol_hash );
+			}
+
+			if( is_pool ) {
+				pool_symbols.insert( symbol_record.first );
+				changed = true;
+			}
+		}
+	}
+
+	auto collect = [&]( Reference& ref ) -> bool {
+		const Reference::SingleRef& sref = ref.components[0];
+
+		bool touches_pool = ref.global_section == S_BYTEPOOL;
+		for( unsigned i = 0; i <= ref.has_second_component; ++i ) {
+			touches_pool |= ref.components[i].target.type == Reference::BaseRef::BRT_SYMBOL &&
+			                pool_symbols.count( ref.components[i].target.symbol_hash );
+		}
+
+		if( !touches_pool ) {
+			return true;
+		}
+
+		// A plain alias of a string symbol follows it.
+		if( !ref.has_second_component &&
+		    sref.indirection_section == S_NONE &&
+		    sref.target.type == Reference::BaseRef::BRT_SYMBOL &&
+		    pool_symbols.count( sref.target.symbol_hash ) ) {
+			return true;
+		}
+
+		Reference::BaseRef* target = DirectBytepoolTarget( ref );
+		if( !target || ref.has_second_component ) {
+			msg( E_WARNING, E_VERBOSE, "Not merging strings: bytepool reference %s is not a plain string address",
+			     ProcDebug::PrintReference( ref ).c_str() );
+			return false;
+		}
+
+		size_t address = target->memory_address;
+		cverify( address < limits.Bytepool(), "Bytepool reference out of range: %zu", address );
+
+		if( address && pool[address - 1] ) {
+			msg( E_WARNING, E_VERBOSE, "Not merging strings: bytepool reference into the middle of a string at %zu", address );
+			return false;
+		}
+
+		const char* end = reinterpret_cast<const char*>( memchr( pool + address, '\0', limits.Bytepool() - address ) );
+		if( !end ) {
+			msg( E_WARNING, E_VERBOSE, "Not merging strings: no terminator for bytepool string at %zu", address );
+			return false;
+		}
+
+		strings.insert( std::make_pair( address, std::string( pool + address, end + 1 ) ) );
+		return true;
+	};
+
+	for( size_t ip = 0; ip < limits.Code(); ++ip ) {
+		Command cmd = mmu->ACommand( ip );
+
+		if( cset->DecodeCommand( cmd.id )->arg_type == A_REFERENCE ) {
+			if( !collect( cmd.arg.ref ) ) {
+				return;
+			}
+			if( DirectBytepoolTarget( cmd.arg.ref ) ) {
+				commands.push_back( std::make_pair( ip, cmd ) );
+			}
+		}
+	}
+
+	for( symbol_map::value_type& symbol_record: symbols ) {
+		Symbol& symbol = symbol_record.second.second;
+		if( symbol.is_resolved && !collect( symbol.ref ) ) {
+			return;
+		}
+	}
+
+	// Every string shall be referenced at its start, otherwise its bytes may be reached
+	// past the terminator of the preceding one.
+	for( size_t address = 0; address < limits.Bytepool(); ) {
+		auto string_record = strings.find( address );
+		if( string_record == strings.end() ) {
+			msg( E_WARNING, E_VERBOSE, "Not merging strings: bytes at %zu are not referenced as a string", address );
+			return;
+		}
+		address += string_record->second.size();
+	}
+
+	// Sort unique strings by their reversed contents: then a suffix immediately precedes
+	// the strings it is a suffix of, and each string is checked only against the last one placed.
+	std::vector<std::string> unique;
+	for( const std::pair<const size_t, std::string>& string_record: strings ) {
+		unique.push_back( string_record.second );
+	}
+	std::sort( unique.begin(), unique.end(), &IsReversedLess );
+	unique.erase( std::unique( unique.begin(), unique.end() ), unique.end() );
+
+	std::map<std::string, size_t> placement;
+	std::vector<char> merged_pool;
+	const std::string* owner = nullptr;
+	size_t owner_address = 0;
+
+	for( auto it = unique.rbegin(); it != unique.rend(); ++it ) {
+		if( owner && IsSuffix( *it, *owner ) ) {
+			placement[*it] = owner_address + owner->size() - it->size();
+		} else {
+			owner = &*it;
+			owner_address = merged_pool.size();
+			placement[*it] = owner_address;
+			merged_pool.insert( merged_pool.end(), it->begin(), it->end() );
+		}
+	}
+
+	msg( E_INFO, E_VERBOSE, "Bytepool merged: %zu -> %zu bytes (%zu references, %zu strings placed)",
+	     limits.Bytepool(), merged_pool.size(), strings.size(), placement.size() );
+
+	auto relocate = [&]( Reference& ref ) {
+		if( Reference::BaseRef* target = DirectBytepoolTarget( ref ) ) {
+			target->memory_address = placement[strings[target->memory_address]];
+		}
+	};
+
+	for( std::pair<size_t, Command>& command_record: commands ) {
+		relocate( command_record.second.arg.ref );
+		mmu->ModifySection( SEC_CODE_IMAGE, command_record.first, &command_record.second, 1 );
+	}
+
+	for( symbol_map::value_type& symbol_record: symbols ) {
+		if( symbol_record.second.second.is_resolved ) {
+			relocate( symbol_record.second.second.ref );
+		}
+	}
+	mmu->SetSymbolImage( std::move( symbols ) );
+
+	mmu->ResizeSection( SEC_BYTEPOOL_IMAGE, merged_pool.size() );
+	if( !merged_pool.empty() ) {
+		mmu->ModifySection( SEC_BYTEPOOL_IMAGE, 0, merged_pool.data(), merged_pool.size() );
+	}
+}
+
+void UATLinker::StripSymbols( const std::vector<size_t>& exported )
+{
+	verify_method;
+
+	IMMU* mmu = proc_->MMU();
+	ICommandSet* cset = proc_->CommandSet();
+	Offsets limits = mmu->QuerySectionLimits();
+	symbol_map symbols = mmu->DumpSymbolImage();
+
+	msg( E_INFO, E_VERBOSE, "Stripping symbols: %zu symbols, %zu exported", symbols.size(), exported.size() );
+
+	std::unordered_set<size_t> keep;
+	for( size_t hash: exported ) {
+		symbol_map::const_iterator it = symbols.find( hash );
+		cverify( it != symbols.end(), "Exported symbol (hash %zx) does not exist", hash );
+		keep.insert( hash );
+	}
+
+	// Inline the symbols referenced by the code; keep the ones which cannot be inlined.
+	size_t inlined = 0;
+	for( size_t ip = 0; ip < limits.Code(); ++ip ) {
+		Command cmd = mmu->ACommand( ip );
+
+		if( cset->DecodeCommand( cmd.id )->arg_type != A_REFERENCE ) {
+			continue;
+		}
+
+		bool modified = false;
+		for( unsigned i = 0; i <= cmd.arg.ref.has_second_component; ++i ) {
+			const Reference::BaseRef& bref = cmd.arg.ref.components[i].target;
+			if( bref.type != Reference::BaseRef::BRT_SYMBOL ) {
+				continue;
+			}
+
+			size_t hash = bref.symbol_hash;
+			symbol_map::const_iterator it = symbols.find( hash );
+			if( it != symbols.end() && InlineSymbol( cmd.arg.ref, i, it->second.second ) ) {
+				modified = true;
+				++inlined;
+			} else {
+				keep.insert( hash );
+			}
+		}
+
+		if( modified ) {
+			mmu->ModifySection( SEC_CODE_IMAGE, ip, &cmd, 1 );
+		}
+	}
+
+	// Keep the symbols referenced by the kept ones (aliases).
+	std::vector<size_t> pending( keep.begin(), keep.end() );
+	while( !pending.empty() ) {
+		symbol_map::const_iterator it = symbols.find( pending.back() );
+		pending.pop_back();
+
+		if( it == symbols.end() || !it->second.second.is_resolved ) {
+			continue;
+		}
+
+		const Reference& ref = it->second.second.ref;
+		for( unsigned i = 0; i <= ref.has_second_component; ++i ) {
+			const Reference::BaseRef& bref = ref.components[i].target;
+			if( bref.type == Reference::BaseRef::BRT_SYMBOL && keep.insert( bref.symbol_hash ).second ) {
+				pending.push_back( bref.symbol_hash );
+			}
+		}
+	}
+
+	// Undefined symbols are kept to be reported when they are used.
+	symbol_map stripped;
+	stripped.reserve( keep.size() );
+	for( const symbol_map::value_type& symbol_record: symbols ) {
+		if( !symbol_record.second.second.is_resolved || keep.count( symbol_record.first ) ) {
+			stripped.insert( symbol_record );
+		}
+	}
+
+	msg( E_INFO, E_VERBOSE, "Symbols stripped: %zu references inlined, %zu -> %zu symbols",
+	     inlined, symbols.size(), stripped.size() );
+	mmu->SetSymbolImage( std::move( stripped ) );
+}
+
+void UATLinker::EliminateDeadCode( const std::vector<size_t>& exported )
+{
+	verify_method;
+
+	IMMU* mmu = proc_->MMU();
+	ICommandSet* cset = proc_->CommandSet();
+	Offsets limits = mmu->QuerySectionLimits();
+	symbol_map symbols = mmu->DumpSymbolImage();
+
+	if( !limits.Code() ) {
+		return;
+	}
+
+	msg( E_INFO, E_VERBOSE, "Eliminating dead code: %zu commands, %zu data cells, %zu exported symbols",
+	     limits.Code(), limits.Data(), exported.size() );
+
+	for( size_t hash: exported ) {
+		symbol_map::const_iterator it = symbols.find( hash );
+		cverify( it != symbols.end() && it->second.second.is_resolved, "Exported symbol (hash %zx) is not defined", hash );
+	}
+
+	const CommandTraits* no_fallthrough[] = {
+		cset->DecodeCommand( "jmp" ),
+		cset->DecodeCommand( "ret" ),
+		cset->DecodeCommand( "quit" )
+	};
+
+	calc_t reserve_pattern;
+	size_t reserved = mmu->QueryReservedData( &reserve_pattern );
+
+	SectionLiveness code( limits.Code() ), data( limits.Data() );
+	std::vector<size_t> worklist;
+
+	// Visit a reference of a live command or an exported symbol.
+	auto visit = [&]( const Reference& ref ) {
+		if( !IsDefined( ref, symbols ) ) {
+			code.dynamic = data.dynamic = true;
+			return;
+		}
+
+		bool is_static = true;
+		DirectReference target = Resolve( ref, &is_static );
+
+		SectionLiveness* section = ( target.section == S_CODE ) ? &code :
+		                           ( target.section == S_DATA ) ? &data : nullptr;
+		if( !section || section->dynamic ) {
+			return;
+		}
+
+		// Keep everything between the base (a symbol or the first component) and the target,
+		// so that constant offsets stay valid. Only references which can be moved are followed.
+		size_t base = target.address;
+		unsigned symbol_components = 0;
+
+		for( unsigned i = 0; i <= ref.has_second_component; ++i ) {
+			const Reference::BaseRef& bref = ref.components[i].target;
+			if( bref.type == Reference::BaseRef::BRT_SYMBOL ) {
+				const Symbol& symbol = symbols.find( bref.symbol_hash )->second.second;
+				if( !IsMovable( symbol, target.section, symbols ) ) {
+					is_static = false;
+				}
+
+				bool symbol_is_static = true;
+				base = Resolve( symbol.ref, &symbol_is_static ).address;
+				++symbol_components;
+			}
+		}
+
+		if( !symbol_components ) {
+			base = ref.components[0].target.memory_address;
+		}
+
+		if( !is_static || symbol_components > 1 ) {
+			section->dynamic = true;
+			return;
+		}
+
+		section->Mark( std::min( base, target.address ), std::max( base, target.address ),
+		               ( section == &code ) ? &worklist : nullptr );
+	};
+
+	// Computed control transfers make all code live; the analysis is then repeated for the data.
+	for( bool all_code = false; ; all_code = true ) {
+		code = SectionLiveness( limits.Code() );
+		data = SectionLiveness( limits.Data() );
+		worklist.clear();
+
+		data.unit_begin = DataObjects( symbols, data.size );
+
+		// Host buffers cannot be moved; the reserved tail is not compacted.
+		data.dynamic = !mmu->QueryHostBuffers( MemorySectionIdentifier( SEC_DATA_IMAGE ) ).empty();
+		if( reserved ) {
+			data.Mark( limits.Data() - reserved, limits.Data() - 1 );
+		}
+
+		// Execution starts at the first command.
+		code.Mark( 0, all_code ? code.size - 1 : 0, &worklist );
+		code.dynamic = all_code;
+
+		for( size_t hash: exported ) {
+			visit( symbols.find( hash )->second.second.ref );
+		}
+
+		while( !worklist.empty() ) {
+			size_t ip = worklist.back();
+			worklist.pop_back();
+
+			const Command& cmd = mmu->ACommand( ip );
+			const CommandTraits* traits = cset->DecodeCommand( cmd.id );
+			cassert( traits, "Invalid command ID at %zu: %hu", ip, cmd.id );
+
+			if( traits->arg_type == A_REFERENCE ) {
+				visit( cmd.arg.ref );
+			}
+
+			if( std::find( std::begin( no_fallthrough ), std::end( no_fallthrough ), traits ) == std::end( no_fallthrough ) ) {
+				code.Mark( ip + 1, ip + 1, &worklist );
+			}
+		}
+
+		if( !code.dynamic || all_code ) {
+			break;
+		}
+
+		msg( E_INFO, E_VERBOSE, "Computed code addresses are used: keeping all code" );
+	}
+
+	if( data.dynamic ) {
+		msg( E_INFO, E_VERBOSE, "Computed data addresses are used: keeping all data" );
+		data.Mark( 0, data.size - 1 );
+	}
+
+	size_t new_code_size = code.Layout(), new_data_size = data.Layout();
+	if( new_code_size == limits.Code() && new_data_size == limits.Data() ) {
+		msg( E_INFO, E_VERBOSE, "No dead code or data" );
+		return;
+	}
+
+	// Move a direct reference into the live ranges (references through symbols follow the symbols).
+	auto move = [&]( Reference& ref ) {
+		if( !IsDefined( ref, symbols ) ||
+		    ref.components[0].target.type == Reference::BaseRef::BRT_SYMBOL ||
+		    ( ref.has_second_component && ref.components[1].target.type == Reference::BaseRef::BRT_SYMBOL ) ) {
+			return;
+		}
+
+		bool is_static = true;
+		DirectReference target = Resolve( ref, &is_static );
+		SectionLiveness* section = ( target.section == S_CODE ) ? &code :
+		                           ( target.section == S_DATA ) ? &data : nullptr;
+
+		if( section && is_static ) {
+			ref.components[0].target.memory_address += section->Map( target.address ) - target.address;
+		}
+	};
+
+	std::vector<Command> commands;
+	commands.reserve( new_code_size );
+
+	for( size_t ip = 0; ip < limits.Code(); ++ip ) {
+		if( code.live[ip] ) {
+			commands.push_back( mmu->ACommand( ip ) );
+			if( cset->DecodeCommand( commands.back().id )->arg_type == A_REFERENCE ) {
+				move( commands.back().arg.ref );
+			}
+		}
+	}
+
+	// Drop the symbols defined in dead code or data, unless exported.
+	std::unordered_set<size_t> keep( exported.begin(), exported.end() );
+	symbol_map moved;
+	moved.reserve( symbols.size() );
+
+	for( const symbol_map::value_type& symbol_record: symbols ) {
+		Symbol symbol = symbol_record.second.second;
+		const SymbolName& name = symbol_record.second.first;
+
+		if( symbol.is_resolved && IsDefined( symbol.ref, symbols ) ) {
+			bool is_static = true;
+			DirectReference target = Resolve( symbol.ref, &is_static );
+			const SectionLiveness* section = ( target.section == S_CODE ) ? &code :
+			                                 ( target.section == S_DATA ) ? &data : nullptr;
+
+			if( section && !section->dynamic && !keep.count( symbol_record.first ) &&
+			    ( !is_static || !IsMovable( symbol, target.section, symbols ) ||
+			      ( target.address < section->size && !section->live[target.address] ) ) ) {
+				msg( E_INFO, E_DEBUG, "Dropping symbol \"%s\"", name.c_str() );
+				continue;
+			}
+
+			move( symbol.ref );
+		}
+
+		moved.insert( symbol_record.first, name.c_str(), name.size(), symbol );
+	}
+
+	size_t symbol_count = moved.size();
+
+	// Compact the sections.
+	if( new_data_size != limits.Data() ) {
+		size_t explicit_size = limits.Data() - reserved;
+		llarray image = mmu->DumpSection( SEC_DATA_IMAGE, 0, explicit_size );
+		const calc_t* cells = reinterpret_cast<const calc_t*>( static_cast<const char*>( image ) );
+
+		std::vector<calc_t> live_cells;
+		live_cells.reserve( new_data_size - reserved );
+		for( size_t i = 0; i < explicit_size; ++i ) {
+			if( data.live[i] ) {
+				live_cells.push_back( cells[i] );
+			}
+		}
+
+		mmu->ResizeSection( SEC_DATA_IMAGE, 0 ); // the reserve is dropped along
+		if( !live_cells.empty() ) {
+			mmu->AppendSection( SEC_DATA_IMAGE, live_cells.data(), live_cells.size() );
+		}
+		if( reserved ) {
+			mmu->AppendSection( SEC_DATA_RESERVE, &reserve_pattern, reserved );
 		}
 	}
+
+	mmu->ResizeSection( SEC_CODE_IMAGE, 0 );
+	mmu->AppendSection( SEC_CODE_IMAGE, commands.data(), commands.size() );
+	mmu->SetSymbolImage( std::move( moved ) );
+
+	msg( E_INFO, E_VERBOSE, "Dead code eliminated: %zu -> %zu commands, %zu -> %zu data cells, %zu -> %zu symbols",
+	     limits.Code(), new_code_size, limits.Data(), new_data_size, symbols.size(), symbol_count );
+}
+
+std::unordered_map<size_t, size_t> UATLinker::AggregateDataProfile( const std::vector<size_t>& counts )
+{
+	verify_method;
+
+	IMMU* mmu = proc_->MMU();
+	symbol_map symbols = mmu->DumpSymbolImage();
+	size_t size = mmu->QuerySectionLimits().Data();
+	std::vector<size_t> objects = DataObjects( symbols, size );
+
+	std::vector<size_t> object_counts( objects.size(), 0 );
+	for( size_t address = 0; address < std::min( counts.size(), size ); ++address ) {
+		object_counts[DataObjectOf( objects, address )] += counts[address];
+	}
+
+	std::unordered_map<size_t, size_t> result;
+	for( const symbol_map::value_type& symbol_record: symbols ) {
+		const Symbol& symbol = symbol_record.second.second;
+		if( IsDataObject( symbol, symbols ) && symbol.ref.components[0].target.memory_address < size ) {
+			result[symbol_record.first] = object_counts[DataObjectOf( objects, symbol.ref.components[0].target.memory_address )];
+		}
+	}
+
+	return result;
+}
+
+void UATLinker::ReorderData( const std::unordered_map<size_t, size_t>& profile )
+{
+	verify_method;
+
+	IMMU* mmu = proc_->MMU();
+	ICommandSet* cset = proc_->CommandSet();
+	Offsets limits = mmu->QuerySectionLimits();
+	symbol_map symbols = mmu->DumpSymbolImage();
+
+	// The reserved tail is not moved.
+	calc_t reserve_pattern;
+	size_t reserved = mmu->QueryReservedData( &reserve_pattern );
+	size_t size = limits.Data() - reserved;
+
+	std::vector<size_t> objects = DataObjects( symbols, size );
+	if( objects.size() < 2 ) {
+		return;
+	}
+
+	msg( E_INFO, E_VERBOSE, "Reordering data: %zu data cells, %zu objects, %zu profiled symbols",
+	     size, objects.size(), profile.size() );
+
+	if( !mmu->QueryHostBuffers( MemorySectionIdentifier( SEC_DATA_IMAGE ) ).empty() ) {
+		msg( E_WARNING, E_VERBOSE, "Not reordering data: host buffers are mapped" );
+		return;
+	}
+
+	// The reserved tail counts as an object of its own.
+	auto object_of = [&]( size_t address ) -> size_t {
+		return ( address < size ) ? DataObjectOf( objects, address ) : objects.size();
+	};
+
+	auto object_end = [&]( size_t index ) -> size_t {
+		return ( index + 1 < objects.size() ) ? objects[index + 1] : size;
+	};
+
+	// A DATA reference can be moved if it stays within one object and is either direct
+	// or based on a symbol which moves with the object.
+	auto is_movable = [&]( const Reference& ref ) -> bool {
+		if( !IsDefined( ref, symbols ) ) {
+			return false;
+		}
+
+		for( unsigned i = 0; i <= ref.has_second_component; ++i ) {
+			if( ref.components[i].indirection_section == S_DATA &&
+			    ref.components[i].target.type == Reference::BaseRef::BRT_MEMORY_REF ) {
+				return false;
+			}
+		}
+
+		bool is_static = true;
+		DirectReference target = Resolve( ref, &is_static );
+		if( target.section != S_DATA ) {
+			return true;
+		}
+
+		size_t base = ref.components[0].target.memory_address;
+		unsigned symbol_components = 0;
+
+		for( unsigned i = 0; i <= ref.has_second_component; ++i ) {
+			const Reference::BaseRef& bref = ref.components[i].target;
+			if( bref.type == Reference::BaseRef::BRT_SYMBOL ) {
+				const Symbol& symbol = symbols.find( bref.symbol_hash )->second.second;
+				if( !IsMovable( symbol, S_DATA, symbols ) ) {
+					return false;
+				}
+
+				bool symbol_is_static = true;
+				base = Resolve( symbol.ref, &symbol_is_static ).address;
+				++symbol_components;
+			}
+		}
+
+		return is_static && symbol_components <= 1 && object_of( base ) == object_of( target.address );
+	};
+
+	for( size_t ip = 0; ip < limits.Code(); ++ip ) {
+		const Command& cmd = mmu->ACommand( ip );
+		if( cset->DecodeCommand( cmd.id )->arg_type == A_REFERENCE && !is_movable( cmd.arg.ref ) ) {
+			msg( E_WARNING, E_VERBOSE, "Not reordering data: computed reference at %zu", ip );
+			return;
+		}
+	}
+
+	for( const symbol_map::value_type& symbol_record: symbols ) {
+		const Symbol& symbol = symbol_record.second.second;
+		if( symbol.is_resolved && !is_movable( symbol.ref ) ) {
+			msg( E_WARNING, E_VERBOSE, "Not reordering data: computed symbol \"%s\"", symbol_record.second.first.c_str() );
+			return;
+		}
+	}
+
+	// Place the accessed objects first, by descending count; otherwise keep the order of declarations.
+	std::vector<size_t> object_counts( objects.size(), 0 );
+	for( const symbol_map::value_type& symbol_record: symbols ) {
+		const Symbol& symbol = symbol_record.second.second;
+		std::unordered_map<size_t, size_t>::const_iterator count = profile.find( symbol_record.first );
+
+		if( count != profile.end() && IsDataObject( symbol, symbols ) ) {
+			size_t index = object_of( symbol.ref.components[0].target.memory_address );
+			if( index < objects.size() ) {
+				object_counts[index] = std::max( object_counts[index], count->second );
+			}
+		}
+	}
+
+	std::vector<size_t> order( objects.size() );
+	for( size_t i = 0; i < order.size(); ++i ) {
+		order[i] = i;
+	}
+
+	std::stable_sort( order.begin(), order.end(),
+	                  [&]( size_t lhs, size_t rhs ) { return object_counts[lhs] > object_counts[rhs]; } );
+
+	size_t accessed = objects.size() - std::count( object_counts.begin(), object_counts.end(), 0 );
+	if( std::is_sorted( order.begin(), order.end() ) ) {
+		msg( E_INFO, E_VERBOSE, "Data is in profile order already (%zu objects accessed)", accessed );
+		return;
+	}
+
+	std::vector<size_t> new_begin( objects.size() );
+	size_t position = 0;
+	for( size_t index: order ) {
+		new_begin[index] = position;
+		position += object_end( index ) - objects[index];
+	}
+
+	// Move a direct reference with its object (references through symbols follow the symbols).
+	auto move = [&]( Reference& ref ) -> bool {
+		if( ref.components[0].target.type == Reference::BaseRef::BRT_SYMBOL ||
+		    ( ref.has_second_component && ref.components[1].target.type == Reference::BaseRef::BRT_SYMBOL ) ) {
+			return false;
+		}
+
+		bool is_static = true;
+		DirectReference target = Resolve( ref, &is_static );
+		size_t index = object_of( target.address );
+
+		if( target.section != S_DATA || !is_static || index == objects.size() ) {
+			return false;
+		}
+
+		size_t new_address = new_begin[index] + ( target.address - objects[index] );
+		ref.components[0].target.memory_address += new_address - target.address;
+		return new_address != target.address;
+	};
+
+	for( size_t ip = 0; ip < limits.Code(); ++ip ) {
+		Command cmd = mmu->ACommand( ip );
+		if( cset->DecodeCommand( cmd.id )->arg_type == A_REFERENCE && move( cmd.arg.ref ) ) {
+			mmu->ModifySection( SEC_CODE_IMAGE, ip, &cmd, 1 );
+		}
+	}
+
+	for( symbol_map::value_type& symbol_record: symbols ) {
+		if( symbol_record.second.second.is_resolved ) {
+			move( symbol_record.second.second.ref );
+		}
+	}
+
+	llarray image = mmu->DumpSection( SEC_DATA_IMAGE, 0, size );
+	const calc_t* cells = reinterpret_cast<const calc_t*>( static_cast<const char*>( image ) );
+
+	std::vector<calc_t> reordered;
+	reordered.reserve( size );
+	for( size_t index: order ) {
+		reordered.insert( reordered.end(), cells + objects[index], cells + object_end( index ) );
+	}
+
+	mmu->ResizeSection( SEC_DATA_IMAGE, 0 ); // the reserve is dropped along
+	mmu->AppendSection( SEC_DATA_IMAGE, reordered.data(), reordered.size() );
+	if( reserved ) {
+		mmu->AppendSection( SEC_DATA_RESERVE, &reserve_pattern, reserved );
+	}
+
+	mmu->SetSymbolImage( std::move( symbols ) );
+
+	msg( E_INFO, E_VERBOSE, "Data reordered: %zu of %zu objects accessed", accessed, objects.size() );
 }
 
 void UATLinker::MergeLink_Add( symbol_map&& symbols )
@@ -326,17 +1382,91 @@ void UATLinker::MergeLink_Add( symbol_map&& symbols )
 	/*
 	 * The semantics of merge-linking.
 	 *
-	 * If the context to be merged is going to be pasted at offset == 0
-	 * (precisely like it is done in the API context merge implementation),
-	 * then we just need to merge the symbol maps.
+	 * The symbols of the context to be merged have already been relocated
+	 * to where the context is pasted (see Relocate()),
+	 * so we just need to merge the symbol maps.
 	 */
 
 	msg( E_INFO, E_DEBUG, "Merge-linking %zu symbols", symbols.size() );
 
+	temporary_map.reserve( temporary_map.size() + symbols.size() );
 	for( const symbol_map::value_type& target_sym: symbols ) {
-		temporary_map.insert( target_sym );
+		LinkSymbol( target_sym );
 	}
 }
 
+void UATLinker::MergeLink_AddParallel( std::vector<symbol_map>&& symbols, const std::vector<Offsets>& offsets,
+                                       const std::vector<size_t>& code_counts, size_t jobs )
+{
+	verify_method;
+
+	size_t count = symbols.size();
+	cassert( offsets.size() == count && code_counts.size() == count, "Inconsistent image descriptions" );
+
+	msg( E_INFO, E_VERBOSE, "Merge-linking %zu images on %zu threads", count, jobs );
+
+	// The images occupy disjoint ranges of the code, so they are relocated independently.
+	IMMU* mmu = proc_->MMU();
+	const ICommandSet* cset = proc_->CommandSet();
+	size_t code_size = mmu->QuerySectionLimits().Code();
+	Command* code = code_size ? &mmu->ACommand( 0 ) : nullptr;
+
+	// The workers do not log: the counts are reported from this thread once they are done.
+	std::vector<size_t> relocated_symbols( count ), relocated_strings( count );
+
+	ParallelFor( count, jobs, [&]( size_t i ) {
+		if( offsets[i].Code() || offsets[i].Data() || offsets[i].Bytepool() ) {
+			relocated_symbols[i] = RelocateSymbols( symbols[i], offsets[i] );
+
+			if( code_counts[i] ) {
+				s_cassert( offsets[i].Code() + code_counts[i] <= code_size, "Image %zu is out of the code", i );
+				relocated_strings[i] = RelocateCode( code + offsets[i].Code(), code_counts[i], offsets[i], cset );
+			}
+		}
+	} );
+
+	msg( E_INFO, E_DEBUG, "Relocated %zu symbols and %zu string references",
+	     std::accumulate( relocated_symbols.begin(), relocated_symbols.end(), size_t( 0 ) ),
+	     std::accumulate( relocated_strings.begin(), relocated_strings.end(), size_t( 0 ) ) );
+
+	// Merge the maps pairwise: the map of each image is merged into the one of the preceding image
+	// at the same level, so that the records keep their order.
+	std::vector< std::vector<std::string> > redefinitions( count + 1 );
+
+	for( size_t step = 1; step < count; step *= 2 ) {
+		ParallelFor( ( count + 2 * step - 1 ) / ( 2 * step ), jobs, [&]( size_t pair ) {
+			size_t target = pair * 2 * step, source = target + step;
+			if( source < count ) {
+				LinkAllInto( symbols[target], symbols[source], redefinitions[source] );
+				symbol_map().swap( symbols[source] );
+			}
+		} );
+	}
+
+	if( count ) {
+		LinkAllInto( temporary_map, symbols.front(), redefinitions[count] );
+	}
+
+	// Report everything at once.
+	size_t redefinition_count = 0, undefined_count = 0;
+	for( const std::vector<std::string>& names: redefinitions ) {
+		for( const std::string& name: names ) {
+			msg( E_CRITICAL, E_USER, "Symbol redefinition: \"%s\"", name.c_str() );
+			++redefinition_count;
+		}
+	}
+
+	for( const symbol_map::value_type& symbol_record: temporary_map ) {
+		if( !symbol_record.second.second.is_resolved ) {
+			msg( E_WARNING, E_VERBOSE, "Undefined symbol: \"%s\"", symbol_record.second.first.c_str() );
+			++undefined_count;
+		}
+	}
+
+	cverify( !redefinition_count, "%zu symbol redefinitions", redefinition_count );
+
+	msg( E_INFO, E_VERBOSE, "Merge-linked %zu symbols (%zu undefined)", temporary_map.size(), undefined_count );
+}
+
 } // namespace ProcessorImplementation
 // kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
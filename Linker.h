@@ -16,13 +16,17 @@ namespace ProcessorImplementation
 {
 using namespace Processor;
 
-typedef std::multimap<size_t, std::pair<std::string, Symbol> > symbol_tmap;
-
 class INTERPRETER_API UATLinker: public ILinker
 {
-	symbol_tmap temporary_map;
+	symbol_map temporary_map;
+
+	void LinkSymbol( const symbol_map::value_type& symbol_record );
 
+	// These do not log, since MergeLink_AddParallel() runs them on worker threads.
+	// The latter two return the count of relocated references.
 	void RelocateReference( Reference& ref, const Offsets& offsets );
+	size_t RelocateSymbols( symbol_map& symbols, const Offsets& offsets );
+	size_t RelocateCode( Command* commands, size_t code_count, const Offsets& offsets, const ICommandSet* cset );
 
 public:
 	virtual void DirectLink_Init();
@@ -31,8 +35,15 @@ public:
 	virtual void DirectLink_Commit( bool UAT );
 
 	virtual void MergeLink_Add( symbol_map&& symbols );
-
-	virtual void Relocate( const Offsets& offsets );
+	virtual void MergeLink_AddParallel( std::vector<symbol_map>&& symbols, const std::vector<Offsets>& offsets,
+	                                    const std::vector<size_t>& code_counts, size_t jobs );
+
+	virtual void Relocate( symbol_map& symbols, const Offsets& offsets, size_t code_count );
+	virtual void MergeStrings();
+	virtual void StripSymbols( const std::vector<size_t>& exported );
+	virtual void EliminateDeadCode( const std::vector<size_t>& exported );
+	virtual std::unordered_map<size_t, size_t> AggregateDataProfile( const std::vector<size_t>& counts );
+	virtual void ReorderData( const std::unordered_map<size_t, size_t>& profile );
 
 	DirectReference Resolve( const Reference& reference, bool* partial_resolution = nullptr );
 };
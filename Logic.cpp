@@ -15,6 +15,12 @@ namespace ProcessorImplementation
 {
 using namespace Processor;
 
+Logic::Logic() :
+	shared_dispatch_generation_( 0 ),
+	data_profiling_( false )
+{
+}
+
 std::string Logic::DumpCommand( Command& command ) const
 {
 	char temporary_buffer[STATIC_LENGTH];
@@ -32,35 +38,64 @@ std::string Logic::DumpCommand( Command& command ) const
 	return temporary_buffer;
 }
 
+Logic::CommandDispatch Logic::ResolveDispatch( const Command& command )
+{
+	ICommandSet* command_set = proc_->CommandSet();
+	CommandDispatch result;
+
+	const CommandTraits* command_traits = command_set->DecodeCommand( command.id );
+	cassert( command_traits, "Could not decode command (invalid ID: 0x%04hx)", command.id );
+
+	// User-supplied handle (pointer to function) should be registered with module ID 0
+	if( void* user_handle = command_set->GetExecutionHandle( *command_traits, 0 ) ) {
+		result.executor = nullptr;
+		result.handle = user_handle;
+	}
+
+	// Select conventional handle
+	else {
+		// Select valid executor based on command type and flavor
+		result.executor = proc_->Executor( command_traits->is_service_command ? Value::V_MAX : command.type );
+
+		cassert( result.executor, "Was unable to select executor for command type \"%s\"",
+		         ProcDebug::Print( command.type ).c_str() );
+
+		result.handle = command_set->GetExecutionHandle( *command_traits, result.executor->ID() );
+	}
+
+	return result;
+}
+
 void Logic::ExecuteSingleCommand( Command& command )
 {
 	verify_method;
 
-	ICommandSet* command_set = proc_->CommandSet();
 	Context& command_context = proc_->CurrentContext();
 
 	msg( E_INFO, E_DEBUG, "Executing %s", DumpCommand( command ).c_str() );
 
-	// Perform caching of executor/handle since execution must be O(1)
-	if( !command.cached_handle ) {
-		const CommandTraits* command_traits = command_set->DecodeCommand( command.id );
-		cassert( command_traits, "Could not decode command (invalid ID: 0x%04hx)", command.id );
-
-		// User-supplied handle (pointer to function) should be registered with module ID 0
-		if( void* user_handle = command_set->GetExecutionHandle( *command_traits, 0 ) ) {
-			command.cached_executor = nullptr;
-			command.cached_handle = user_handle;
-		}
+	CommandDispatch dispatch = { command.cached_executor, command.cached_handle };
 
-		// Select conventional handle
-		else {
-			// Select valid executor based on command type and flavor
-			command.cached_executor = proc_->Executor( command_traits->is_service_command ? Value::V_MAX : command.type );
-
-			cassert( command.cached_executor, "Was unable to select executor for command type \"%s\"",
-			         ProcDebug::Print( command.type ).c_str() );
-
-			command.cached_handle = command_set->GetExecutionHandle( *command_traits, command.cached_executor->ID() );
+	// Perform caching of executor/handle since execution must be O(1)
+	if( !dispatch.handle ) {
+		if( proc_->MMU()->IsCodeShared() ) {
+			if( shared_dispatch_generation_ != proc_->DispatchGeneration() ) {
+				shared_dispatch_.clear();
+				shared_dispatch_generation_ = proc_->DispatchGeneration();
+			}
+
+			uint32_t key = ( static_cast<uint32_t>( command.id ) << 2 ) | command.type;
+			auto cached = shared_dispatch_.find( key );
+
+			if( cached == shared_dispatch_.end() ) {
+				cached = shared_dispatch_.insert( std::make_pair( key, ResolveDispatch( command ) ) ).first;
+			}
+
+			dispatch = cached->second;
+		} else {
+			dispatch = ResolveDispatch( command );
+			command.cached_executor = dispatch.executor;
+			command.cached_handle = dispatch.handle;
 		}
 	}
 
@@ -68,18 +103,18 @@ void Logic::ExecuteSingleCommand( Command& command )
 	command_context.flags &= ~MASK( F_WAS_JUMP );
 
 	// Zero handle means no-op
-	if( !command.cached_handle )
+	if( !dispatch.handle )
 		return;
 
 	// Select the stack for subsequent logic operations
 	current_stack_type_ = command.type;
 
 	// Execute the command
-	if( command.cached_executor )
-		command.cached_executor->Execute( command.cached_handle, command );
+	if( dispatch.executor )
+		dispatch.executor->Execute( dispatch.handle, command );
 
 	else
-		Fcast<void(*)( ProcessorAPI*, Command& )>( command.cached_handle )( proc_, command );
+		Fcast<void(*)( ProcessorAPI*, Command& )>( dispatch.handle )( proc_, command );
 
 
 	// If there was neither exit nor jump, advance the PC
@@ -99,6 +134,7 @@ size_t Logic::ChecksumState()
 	 * Checksum contains:
 	 * - current section limits
 	 * - current code image
+	 * - mapped host buffers (their addresses are compiled in)
 	 */
 
 	IMMU* mmu = proc_->MMU();
@@ -113,6 +149,13 @@ size_t Logic::ChecksumState()
 		checksum = hasher_xroll( &mmu->ACommand( i ), sizeof( Command ), checksum );
 	}
 
+	for( MemorySectionType section: { SEC_DATA_IMAGE, SEC_BYTEPOOL_IMAGE } ) {
+		std::vector<HostBuffer> windows = mmu->QueryHostBuffers( section );
+		if( !windows.empty() ) {
+			checksum = hasher_xroll( windows.data(), sizeof( HostBuffer ) * windows.size(), checksum );
+		}
+	}
+
 	// TODO hash symbol map
 	return checksum;
 }
@@ -221,7 +264,10 @@ void Logic::UpdateType( const DirectReference& ref, Value::Type requested_type )
 		break;
 
 	case S_DATA:
-		proc_->MMU()->AData( ref.address ).type = requested_type;
+		if( data_profiling_ ) {
+			CountDataAccess( ref.address );
+		}
+		proc_->MMU()->SetDataType( ref.address, requested_type );
 		break;
 
 	case S_FRAME:
@@ -258,8 +304,11 @@ void Logic::Write( const DirectReference& ref, calc_t value )
 		break;
 
 	case S_DATA:
+		if( data_profiling_ ) {
+			CountDataAccess( ref.address );
+		}
 		// do type checking here
-		proc_->MMU()->AData( ref.address ).Assign( value );
+		proc_->MMU()->WriteData( ref.address, value );
 		break;
 
 	case S_FRAME:
@@ -302,7 +351,10 @@ calc_t Logic::Read( const DirectReference& ref )
 		          ProcDebug::PrintReference( ref ).c_str() );
 
 	case S_DATA:
-		return proc_->MMU()->AData( ref.address );
+		if( data_profiling_ ) {
+			CountDataAccess( ref.address );
+		}
+		return proc_->MMU()->ReadData( ref.address );
 
 	case S_FRAME:
 		return proc_->MMU()->AStackFrame( frame_stack_type_, ref.address );
@@ -360,6 +412,31 @@ calc_t Logic::StackTop()
 	return proc_->MMU()->AStackTop( current_stack_type_, 0 );
 }
 
+void Logic::CountDataAccess( size_t address )
+{
+	std::vector<size_t>& counts = data_profile_[proc_->MMU()->CurrentContextBuffer()];
+	if( address >= counts.size() ) {
+		counts.resize( address + 1, 0 );
+	}
+	++counts[address];
+}
+
+void Logic::SetDataProfiling( bool enable )
+{
+	verify_method;
+
+	msg( E_INFO, E_VERBOSE, "%s counting DATA accesses", enable ? "Starting" : "Stopping" );
+	data_profiling_ = enable;
+}
+
+std::vector<size_t> Logic::QueryDataProfile( ctx_t ctx ) const
+{
+	verify_method;
+
+	std::map<ctx_t, std::vector<size_t> >::const_iterator it = data_profile_.find( ctx );
+	return ( it != data_profile_.end() ) ? it->second : std::vector<size_t>();
+}
+
 void Logic::ResetCurrentContextState()
 {
 	verify_method;
@@ -408,6 +485,31 @@ void Logic::ClearContextStack()
 	call_stack_.swap( empty );
 }
 
+std::vector<Context> Logic::QueryContextStack() const
+{
+	verify_method;
+
+	std::stack<Context> copy = call_stack_;
+	std::vector<Context> result( copy.size() );
+
+	for( auto i = result.rbegin(); i != result.rend(); ++i ) {
+		*i = copy.top();
+		copy.pop();
+	}
+
+	return result;
+}
+
+void Logic::SetContextStack( const std::vector<Context>& stack )
+{
+	verify_method;
+
+	ClearContextStack();
+	for( const Context& ctx: stack ) {
+		call_stack_.push( ctx );
+	}
+}
+
 void Logic::Syscall( size_t index )
 {
 	msg( E_INFO, E_VERBOSE, "System call with index %zu", index );
@@ -23,7 +23,28 @@ class INTERPRETER_API Logic : public ILogic
 	Value::Type current_stack_type_;
 	static const Value::Type frame_stack_type_ = Value::V_INTEGER;
 
+	struct CommandDispatch
+	{
+		IExecutor* executor;
+		void* handle;
+	};
+
+	// Commands of a shared image are read-only, so their dispatch is cached here by (ID, type),
+	// as of the processor's dispatch generation.
+	std::unordered_map<uint32_t, CommandDispatch> shared_dispatch_;
+	size_t shared_dispatch_generation_;
+
+	CommandDispatch ResolveDispatch( const Command& command );
+
+	// DATA access counts by context buffer and address (see SetDataProfiling()).
+	bool data_profiling_;
+	std::map<ctx_t, std::vector<size_t> > data_profile_;
+
+	void CountDataAccess( size_t address );
+
 public:
+	Logic();
+
 	virtual void Analyze( calc_t value );
 	virtual void Syscall( size_t index );
 
@@ -37,6 +58,9 @@ public:
 	virtual void Write( const DirectReference& ref, calc_t value );
 	virtual void UpdateType( const DirectReference& ref, Value::Type requested_type );
 
+	virtual void SetDataProfiling( bool enable );
+	virtual std::vector<size_t> QueryDataProfile( ctx_t ctx ) const;
+
 	virtual size_t StackSize();
 	virtual calc_t StackTop();
 	virtual calc_t StackPop();
@@ -47,6 +71,8 @@ public:
 	virtual void SaveCurrentContext();
 	virtual void RestoreCurrentContext();
 	virtual void ClearContextStack();
+	virtual std::vector<Context> QueryContextStack() const;
+	virtual void SetContextStack( const std::vector<Context>& stack );
 
 	virtual size_t ChecksumState();
 
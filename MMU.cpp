@@ -3,8 +3,8 @@
 
 namespace {
 
-template <typename T, typename Iter>
-void PasteVector( std::vector<T>& dest, size_t address, Iter first, Iter last )
+template <typename T, typename Alloc, typename Iter>
+void PasteVector( std::vector<T, Alloc>& dest, size_t address, Iter first, Iter last )
 {
 	if( last == first ) {
 		return;
@@ -22,12 +22,95 @@ void PasteVector( std::vector<T>& dest, size_t address, Iter first, Iter last )
 	}
 }
 
+size_t SymbolMapBytes( const Processor::symbol_map& symbols )
+{
+	return symbols.MemoryUsage();
+}
+
 } // unnamed namespace
 
 namespace ProcessorImplementation
 {
 using namespace Processor;
 
+namespace {
+
+size_t HostCellSize( Value::Type type )
+{
+	return ( type == Value::V_INTEGER ) ? sizeof( int_t ) : sizeof( fp_t );
+}
+
+calc_t ReadHostCell( const HostBuffer& window, size_t addr )
+{
+	size_t index = addr - window.address;
+
+	if( window.type == Value::V_INTEGER ) {
+		return reinterpret_cast<const int_t*>( window.buffer )[index];
+	} else {
+		return reinterpret_cast<const fp_t*>( window.buffer )[index];
+	}
+}
+
+void WriteHostCell( const HostBuffer& window, size_t addr, const calc_t& value )
+{
+	size_t index = addr - window.address;
+
+	// Host cells are of a fixed type; do type checking here
+	value.Expect( window.type );
+
+	if( window.type == Value::V_INTEGER ) {
+		reinterpret_cast<int_t*>( window.buffer )[index] = value.integer;
+	} else {
+		reinterpret_cast<fp_t*>( window.buffer )[index] = value.fp;
+	}
+}
+
+} // unnamed namespace
+
+const size_t MMU::deferred_page_bytes;
+
+MMU::InternalContextBuffer::InternalContextBuffer() :
+	arena( new Arena ),
+	data( ArenaAllocator<calc_t>( arena.get() ) ),
+	commands( ArenaAllocator<Command>( arena.get() ) ),
+	data_reserved( 0 ),
+	data_reserve_pattern(),
+	data_reserve_cells( ArenaAllocator<calc_t>( arena.get() ) ),
+	bytepool( ArenaAllocator<char>( arena.get() ) ),
+	sym_table()
+{
+	data_reserve_pattern.integer = 0;
+	for( calc_t& reg: registers ) {
+		reg.integer = 0;
+	}
+}
+
+MMU::InternalContextBuffer& MMU::InternalContextBuffer::operator=( InternalContextBuffer&& rhs )
+{
+	// Swap, so that the old images are destroyed by "rhs" before their arena.
+	std::swap( arena, rhs.arena );
+	data.swap( rhs.data );
+	commands.swap( rhs.commands );
+	std::swap( data_reserved, rhs.data_reserved );
+	std::swap( data_reserve_pattern, rhs.data_reserve_pattern );
+	data_reserve_cells.swap( rhs.data_reserve_cells );
+	bytepool.swap( rhs.bytepool );
+	sym_table.swap( rhs.sym_table );
+	image.swap( rhs.image );
+	std::swap( ext_commands, rhs.ext_commands );
+	std::swap( ext_data, rhs.ext_data );
+	std::swap( ext_bytepool, rhs.ext_bytepool );
+	ext_backing.swap( rhs.ext_backing );
+	std::swap( deferred_data, rhs.deferred_data );
+	std::swap( deferred_bytepool, rhs.deferred_bytepool );
+	data_windows.swap( rhs.data_windows );
+	bytepool_windows.swap( rhs.bytepool_windows );
+	std::swap( registers, rhs.registers );
+	std::swap( usage, rhs.usage );
+	std::swap( arena_usage, rhs.arena_usage );
+	return *this;
+}
+
 MMU::MMU() :
 	stacks_(),
 	buffers_(),
@@ -49,6 +132,7 @@ void MMU::ClearStacks()
 {
 	for( unsigned i = 0; i < Value::V_MAX; ++i ) {
 		stacks_[i].clear();
+		stack_usage_[i].Update( stacks_[i].capacity() * sizeof( calc_t ) );
 	}
 }
 
@@ -88,6 +172,18 @@ void MMU::ReleaseContextBuffer( ctx_t id )
 	cassert( count_erased > 0, "Attempt to remove an inexistent context buffer ID %lu", id );
 }
 
+std::vector<ctx_t> MMU::QueryContextBuffers() const
+{
+	std::vector<ctx_t> result;
+	result.reserve( buffers_.size() );
+
+	for( const std::pair<const ctx_t, InternalContextBuffer>& buffer: buffers_ ) {
+		result.push_back( buffer.first );
+	}
+
+	return result;
+}
+
 size_t MMU::QueryStackTop( Value::Type type ) const
 {
 	cassert( type < Value::V_MAX, "Invalid stack type required: \"%s\"", ProcDebug::Print( type ).c_str() );
@@ -105,6 +201,7 @@ void MMU::SetStackTop( Value::Type type, ssize_t adjust )
 	pattern.type = type;
 	pattern.Set( type, 0, true );
 	stacks_[type].resize( stacks_[type].size() + adjust, pattern );
+	stack_usage_[type].Update( stacks_[type].capacity() * sizeof( calc_t ) );
 }
 
 calc_t& MMU::AStackTop( Value::Type type, size_t offset )
@@ -124,12 +221,13 @@ calc_t& MMU::AStackFrame( Value::Type type, ssize_t offset )
 	return stacks_[type].at( proc_->CurrentContext().frame + offset );
 }
 
-symbol_type& MMU::ASymbol( size_t hash )
+const symbol_type& MMU::ASymbol( size_t hash )
 {
 	verify_method;
 
-	auto sym_iter = CurrentBuffer().sym_table.find( hash );
-	cassert( sym_iter != CurrentBuffer().sym_table.end(), "Unknown symbol (hash %zx)", hash );
+	const symbol_map& symbols = CurrentBuffer().Symbols();
+	auto sym_iter = symbols.find( hash );
+	cassert( sym_iter != symbols.end(), "Unknown symbol (hash %zx)", hash );
 	return sym_iter->second;
 }
 
@@ -145,18 +243,312 @@ Command& MMU::ACommand( size_t ip )
 {
 	verify_method;
 
-	cassert( ip < CurrentBuffer().commands.size(),
-	         "IP overflow: %zu [max %zu]", ip, CurrentBuffer().commands.size() );
-	return CurrentBuffer().commands.at( ip );
+	const InternalContextBuffer& icb = CurrentBuffer();
+
+	cassert( ip < icb.CodeSize(),
+	         "IP overflow: %zu [max %zu]", ip, icb.CodeSize() );
+
+	// The interface returns a mutable command, but a shared image shall not be modified by the callers
+	// (see IsCodeShared(); the logic keeps the dispatch of shared commands to itself). Dropping const
+	// is well-defined here, since ExportImage() allocates the image as a non-const object.
+	return const_cast<Command&>( icb.Code()[ip] );
+}
+
+void MMU::MaterializeReserve( InternalContextBuffer& icb )
+{
+	if( icb.data_reserved && icb.data_reserve_cells.empty() ) {
+		smsg( E_INFO, E_DEBUG, "Materializing reserved data (count: %zu)", icb.data_reserved );
+
+		icb.data_reserve_cells.assign( icb.data_reserved, icb.data_reserve_pattern );
+		UpdateUsage( icb );
+	}
+}
+
+void MMU::FoldReserve( InternalContextBuffer& icb )
+{
+	if( icb.data_reserved ) {
+		smsg( E_INFO, E_DEBUG, "Folding reserved data into the image (count: %zu)", icb.data_reserved );
+
+		PrivatizeSection( icb, SEC_DATA_IMAGE );
+		if( icb.data_reserve_cells.empty() ) {
+			icb.data.resize( icb.data.size() + icb.data_reserved, icb.data_reserve_pattern );
+		} else {
+			icb.data.insert( icb.data.end(), icb.data_reserve_cells.begin(), icb.data_reserve_cells.end() );
+			arena_vector<calc_t>( icb.data_reserve_cells.get_allocator() ).swap( icb.data_reserve_cells );
+		}
+
+		icb.data_reserved = 0;
+		UpdateUsage( icb );
+	}
+}
+
+void MMU::CopyCells( InternalContextBuffer& icb, size_t address, size_t count, calc_t* dest )
+{
+	size_t explicit_end = std::min( address + count, icb.DataSize() );
+
+	if( address < explicit_end ) {
+		FaultIn( icb, SEC_DATA_IMAGE, address, explicit_end - address );
+		dest = std::copy( icb.Data() + address, icb.Data() + explicit_end, dest );
+		count -= explicit_end - address;
+		address = explicit_end;
+	}
+
+	if( count ) {
+		size_t offset = address - icb.DataSize();
+
+		if( icb.data_reserve_cells.empty() ) {
+			std::fill( dest, dest + count, icb.data_reserve_pattern );
+		} else {
+			std::copy( icb.data_reserve_cells.begin() + offset, icb.data_reserve_cells.begin() + offset + count, dest );
+		}
+	}
+}
+
+void MMU::UnshareImage( InternalContextBuffer& icb )
+{
+	if( icb.image ) {
+		smsg( E_INFO, E_DEBUG, "Unsharing program image (commands: %zu)", icb.image->commands.size() );
+
+		icb.commands.assign( icb.image->commands.begin(), icb.image->commands.end() );
+		icb.sym_table = icb.image->symbols;
+		icb.image.reset();
+
+		icb.usage[MemorySectionIdentifier( SEC_SYMBOL_MAP ).Index()].Update( SymbolMapBytes( icb.sym_table ) );
+		UpdateUsage( icb );
+	}
+}
+
+void MMU::PrivatizeSection( InternalContextBuffer& icb, MemorySectionIdentifier section )
+{
+	switch( section.SectionType() ) {
+	case SEC_CODE_IMAGE:
+		if( icb.ext_commands.base ) {
+			smsg( E_INFO, E_DEBUG, "Copying adopted CODE image (commands: %zu)", icb.ext_commands.count );
+			icb.commands.assign( icb.ext_commands.base, icb.ext_commands.base + icb.ext_commands.count );
+			icb.ext_commands = InternalContextBuffer::ExternalView<Command>();
+		}
+		break;
+
+	case SEC_DATA_IMAGE:
+		if( icb.ext_data.base ) {
+			smsg( E_INFO, E_DEBUG, "Copying adopted DATA image (cells: %zu)", icb.ext_data.count );
+			FaultIn( icb, SEC_DATA_IMAGE, 0, icb.ext_data.count );
+			icb.data.assign( icb.ext_data.base, icb.ext_data.base + icb.ext_data.count );
+			icb.ext_data = InternalContextBuffer::ExternalView<calc_t>();
+			icb.deferred_data = InternalContextBuffer::DeferredView();
+		}
+		break;
+
+	case SEC_BYTEPOOL_IMAGE:
+		if( icb.ext_bytepool.base ) {
+			smsg( E_INFO, E_DEBUG, "Copying adopted BYTEPOOL image (bytes: %zu)", icb.ext_bytepool.count );
+			FaultIn( icb, SEC_BYTEPOOL_IMAGE, 0, icb.ext_bytepool.count );
+			icb.bytepool.assign( icb.ext_bytepool.base, icb.ext_bytepool.base + icb.ext_bytepool.count );
+			icb.ext_bytepool = InternalContextBuffer::ExternalView<char>();
+			icb.deferred_bytepool = InternalContextBuffer::DeferredView();
+		}
+		break;
+
+	case SEC_SYMBOL_MAP:
+	case SEC_DATA_RESERVE:
+	case SEC_NATIVE_IMAGE:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
+	case SEC_STACK_IMAGE:
+	case SEC_MAX:
+	default:
+		s_casshole( "Cannot privatize %s: it is never adopted", ProcDebug::Print( section.SectionType() ).c_str() );
+		break;
+	}
+
+	// The storage is released once no view into it remains.
+	if( !icb.ext_commands.base && !icb.ext_data.base && !icb.ext_bytepool.base ) {
+		icb.ext_backing.clear();
+	}
+
+	UpdateUsage( icb );
+}
+
+void MMU::PrivatizeImages( InternalContextBuffer& icb )
+{
+	PrivatizeSection( icb, SEC_CODE_IMAGE );
+	PrivatizeSection( icb, SEC_DATA_IMAGE );
+	PrivatizeSection( icb, SEC_BYTEPOOL_IMAGE );
+}
+
+void MMU::UpdateUsage( InternalContextBuffer& icb )
+{
+	// An adopted image counts in full, unless it is deferred: then only the pages read so far
+	// (once all of them are, both are the same).
+	size_t ext_code_bytes = icb.ext_commands.count * sizeof( Command ),
+	       ext_data_bytes = icb.deferred_data.missing ? icb.deferred_data.loaded_bytes
+	                                                  : icb.ext_data.count * sizeof( calc_t ),
+	       ext_bytepool_bytes = icb.deferred_bytepool.missing ? icb.deferred_bytepool.loaded_bytes
+	                                                          : icb.ext_bytepool.count;
+
+	icb.usage[MemorySectionIdentifier( SEC_CODE_IMAGE ).Index()].Update( icb.commands.capacity() * sizeof( Command ) +
+	                                                                     ext_code_bytes );
+	icb.usage[MemorySectionIdentifier( SEC_DATA_IMAGE ).Index()].Update( ( icb.data.capacity() + icb.data_reserve_cells.capacity() ) * sizeof( calc_t ) +
+	                                                                     ext_data_bytes );
+	icb.usage[MemorySectionIdentifier( SEC_BYTEPOOL_IMAGE ).Index()].Update( icb.bytepool.capacity() +
+	                                                                         ext_bytepool_bytes );
+	icb.arena_usage.Update( icb.arena->Capacity() );
+}
+
+void MMU::FaultIn( InternalContextBuffer& icb, MemorySectionIdentifier section, size_t address, size_t count )
+{
+	InternalContextBuffer::DeferredView* deferred;
+	char* base;
+	size_t entry_size, limit;
+
+	switch( section.SectionType() ) {
+	case SEC_DATA_IMAGE:
+		deferred = &icb.deferred_data;
+		base = reinterpret_cast<char*>( icb.ext_data.base );
+		entry_size = sizeof( calc_t );
+		limit = icb.ext_data.count;
+		break;
+
+	case SEC_BYTEPOOL_IMAGE:
+		deferred = &icb.deferred_bytepool;
+		base = icb.ext_bytepool.base;
+		entry_size = 1;
+		limit = icb.ext_bytepool.count;
+		break;
+
+	case SEC_CODE_IMAGE:
+	case SEC_SYMBOL_MAP:
+	case SEC_DATA_RESERVE:
+	case SEC_NATIVE_IMAGE:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
+	case SEC_STACK_IMAGE:
+	case SEC_MAX:
+	default:
+		s_casshole( "Cannot fault in %s", ProcDebug::Print( section.SectionType() ).c_str() );
+		return;
+	}
+
+	if( !deferred->missing || address >= limit ) {
+		return;
+	}
+
+	size_t image_bytes = limit * entry_size,
+	       first = address * entry_size,
+	       last = std::min( address + count, limit ) * entry_size;
+	bool read = false;
+
+	for( size_t page = first / deferred_page_bytes; page * deferred_page_bytes < last; ++page ) {
+		if( deferred->loaded[page] ) {
+			continue;
+		}
+
+		size_t offset = page * deferred_page_bytes,
+		       bytes = std::min( image_bytes - offset, deferred_page_bytes );
+
+		smsg( E_INFO, E_DEBUG, "Faulting in %s page %zu (bytes: %zu)",
+		      ProcDebug::Print( section.SectionType() ).c_str(), page, bytes );
+		deferred->source->Read( offset, bytes, base + offset );
+		deferred->loaded[page] = true;
+		deferred->loaded_bytes += bytes;
+		read = true;
+
+		// Drop the source (and its file) once everything is read.
+		if( !--deferred->missing ) {
+			deferred->source.reset();
+			std::vector<bool>().swap( deferred->loaded );
+			break;
+		}
+	}
+
+	if( read ) {
+		UpdateUsage( icb );
+	}
+}
+
+void MMU::FaultInString( InternalContextBuffer& icb, size_t offset )
+{
+	// Values are read from the bytepool as well, so the first cell is read unconditionally.
+	FaultIn( icb, SEC_BYTEPOOL_IMAGE, offset, sizeof( calc_t ) );
+
+	// The length of a string is not known, so read on until its terminator.
+	while( icb.deferred_bytepool.missing && offset < icb.ext_bytepool.count ) {
+		size_t page_end = std::min( ( offset / deferred_page_bytes + 1 ) * deferred_page_bytes, icb.ext_bytepool.count );
+		FaultIn( icb, SEC_BYTEPOOL_IMAGE, offset, page_end - offset );
+
+		if( memchr( icb.ext_bytepool.base + offset, 0, page_end - offset ) ) {
+			break;
+		}
+		offset = page_end;
+	}
+}
+
+calc_t& MMU::DataCell( InternalContextBuffer& icb, size_t addr )
+{
+	// The reserved region is allocated at once on the first access to it.
+	if( addr >= icb.DataSize() ) {
+		s_cassert( addr - icb.DataSize() < icb.data_reserved,
+		           "Data section overflow: %zu [max %zu]", addr, icb.DataSize() + icb.data_reserved );
+
+		MaterializeReserve( icb );
+		return icb.data_reserve_cells[addr - icb.DataSize()];
+	}
+
+	FaultIn( icb, SEC_DATA_IMAGE, addr, 1 );
+	return icb.Data()[addr];
 }
 
 calc_t& MMU::AData( size_t addr )
 {
 	verify_method;
+	InternalContextBuffer& icb = CurrentBuffer();
+
+	cassert( !FindWindow( icb.data_windows, addr ),
+	         "Data cell %zu is mapped to a host buffer and has no value object", addr );
+	return DataCell( icb, addr );
+}
+
+calc_t MMU::ReadData( size_t addr )
+{
+	verify_method;
+	InternalContextBuffer& icb = CurrentBuffer();
+
+	if( const HostBuffer* window = FindWindow( icb.data_windows, addr ) ) {
+		return ReadHostCell( *window, addr );
+	}
+
+	return DataCell( icb, addr );
+}
+
+void MMU::WriteData( size_t addr, const calc_t& value )
+{
+	verify_method;
+	InternalContextBuffer& icb = CurrentBuffer();
+
+	if( const HostBuffer* window = FindWindow( icb.data_windows, addr ) ) {
+		WriteHostCell( *window, addr, value );
+	} else {
+		DataCell( icb, addr ).Assign( value );
+	}
+}
+
+void* MMU::ADataPayload( size_t addr, Value::Type* type )
+{
+	verify_method;
+	InternalContextBuffer& icb = CurrentBuffer();
+
+	if( const HostBuffer* window = FindWindow( icb.data_windows, addr ) ) {
+		if( type ) {
+			*type = window->type;
+		}
+		return reinterpret_cast<char*>( window->buffer ) + ( addr - window->address ) * HostCellSize( window->type );
+	}
 
-	cassert( addr < CurrentBuffer().data.size(),
-	         "Data section overflow: %zu [max %zu]", addr, CurrentBuffer().data.size() );
-	return CurrentBuffer().data.at( addr );
+	calc_t& cell = DataCell( icb, addr );
+	if( type ) {
+		*type = cell.type;
+	}
+	return &cell.integer;
 }
 
 char* MMU::ABytepool( size_t offset )
@@ -164,11 +556,163 @@ char* MMU::ABytepool( size_t offset )
 	verify_method;
 	InternalContextBuffer& icb = CurrentBuffer();
 
-	cassert( offset < icb.bytepool.size(),
+	cassert( offset < icb.BytepoolSize(),
 	         "Cannot reference bytepool address %zu [allocated size %zu]",
-	         offset, icb.bytepool.size() );
+	         offset, icb.BytepoolSize() );
+
+	if( const HostBuffer* window = FindWindow( icb.bytepool_windows, offset ) ) {
+		return reinterpret_cast<char*>( window->buffer ) + ( offset - window->address );
+	}
+
+	FaultInString( icb, offset );
+	return icb.Bytepool() + offset;
+}
+
+void MMU::SetDataType( size_t addr, Value::Type type )
+{
+	verify_method;
+	InternalContextBuffer& icb = CurrentBuffer();
+
+	if( const HostBuffer* window = FindWindow( icb.data_windows, addr ) ) {
+		cverify( window->type == type, "Cannot change type of data cell %zu to %s: it is mapped to a host buffer of %s",
+		         addr, ProcDebug::Print( type ).c_str(), ProcDebug::Print( window->type ).c_str() );
+	} else {
+		DataCell( icb, addr ).type = type;
+	}
+}
+
+std::vector<HostBuffer>& MMU::Windows( InternalContextBuffer& icb, MemorySectionIdentifier section )
+{
+	switch( section.SectionType() ) {
+	case SEC_DATA_IMAGE:
+		return icb.data_windows;
+
+	case SEC_BYTEPOOL_IMAGE:
+		return icb.bytepool_windows;
+
+	case SEC_CODE_IMAGE:
+	case SEC_SYMBOL_MAP:
+	case SEC_DATA_RESERVE:
+	case SEC_NATIVE_IMAGE:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
+	case SEC_STACK_IMAGE:
+	case SEC_MAX:
+	default:
+		s_casshole( "Host buffers can only be mapped over DATA or BYTEPOOL, not over %s",
+		            ProcDebug::Print( section.SectionType() ).c_str() );
+		break;
+	}
+
+	return icb.data_windows; /* for GCC not to complain */
+}
+
+const HostBuffer* MMU::FindWindow( const std::vector<HostBuffer>& windows, size_t addr )
+{
+	if( windows.empty() ) {
+		return nullptr;
+	}
+
+	// The last window starting at or before "addr".
+	auto it = std::upper_bound( windows.begin(), windows.end(), addr,
+	                            []( size_t a, const HostBuffer& w ) { return a < w.address; } );
+	if( it == windows.begin() ) {
+		return nullptr;
+	}
+
+	--it;
+	return it->Contains( addr ) ? &*it : nullptr;
+}
+
+void MMU::OverlayWindows( const std::vector<HostBuffer>& windows, size_t address, size_t count, calc_t* dest )
+{
+	for( const HostBuffer& window: windows ) {
+		size_t first = std::max( address, window.address ),
+		       last = std::min( address + count, window.address + window.count );
+
+		for( size_t i = first; i < last; ++i ) {
+			dest[i - address] = ReadHostCell( window, i );
+		}
+	}
+}
+
+void MMU::WriteThroughWindows( const std::vector<HostBuffer>& windows, size_t address, size_t count, const calc_t* src )
+{
+	for( const HostBuffer& window: windows ) {
+		size_t first = std::max( address, window.address ),
+		       last = std::min( address + count, window.address + window.count );
+
+		for( size_t i = first; i < last; ++i ) {
+			WriteHostCell( window, i, src[i - address] );
+		}
+	}
+}
+
+void MMU::MapHostBuffer( MemorySectionIdentifier section, size_t address,
+                         void* buffer, size_t count, Value::Type type )
+{
+	verify_method;
+
+	InternalContextBuffer& icb = CurrentBuffer();
+	std::vector<HostBuffer>& windows = Windows( icb, section );
+
+	cassert( buffer, "NULL host buffer pointer" );
+	cverify( count, "Cannot map an empty host buffer" );
+
+	size_t limit;
+	if( section.SectionType() == SEC_DATA_IMAGE ) {
+		cverify( type == Value::V_INTEGER || type == Value::V_FLOAT,
+		         "Host buffer over DATA shall have a definite type" );
+		limit = icb.DataSize() + icb.data_reserved;
+	} else {
+		type = Value::V_MAX;
+		limit = icb.BytepoolSize();
+	}
 
-	return icb.bytepool + offset;
+	cverify( address + count <= limit,
+	         "Host buffer [%zu; %zu) does not fit into %s (limit %zu)",
+	         address, address + count, ProcDebug::Print( section.SectionType() ).c_str(), limit );
+
+	auto it = std::upper_bound( windows.begin(), windows.end(), address,
+	                            []( size_t a, const HostBuffer& w ) { return a < w.address; } );
+	cverify( ( it == windows.end() || address + count <= it->address ) &&
+	         ( it == windows.begin() || ( it - 1 )->address + ( it - 1 )->count <= address ),
+	         "Host buffer [%zu; %zu) overlaps an existing mapping", address, address + count );
+
+	msg( E_INFO, E_DEBUG, "Mapping host buffer %p (count: %zu) -> %s at %zu in buffer %zu",
+	     buffer, count, ProcDebug::Print( section.SectionType() ).c_str(), address, CurrentContextBuffer() );
+
+	// Zeroed along with the padding, since the windows are hashed into the state checksum.
+	HostBuffer window;
+	mem_init( window );
+	window.address = address;
+	window.count = count;
+	window.buffer = buffer;
+	window.type = type;
+	windows.insert( it, window );
+}
+
+void MMU::UnmapHostBuffer( MemorySectionIdentifier section, size_t address )
+{
+	verify_method;
+
+	std::vector<HostBuffer>& windows = Windows( CurrentBuffer(), section );
+
+	auto it = std::find_if( windows.begin(), windows.end(),
+	                        [address]( const HostBuffer& w ) { return w.address == address; } );
+	cverify( it != windows.end(), "No host buffer is mapped at %s:%zu",
+	         ProcDebug::Print( section.SectionType() ).c_str(), address );
+
+	msg( E_INFO, E_DEBUG, "Unmapping host buffer %p from %s at %zu in buffer %zu",
+	     it->buffer, ProcDebug::Print( section.SectionType() ).c_str(), address, CurrentContextBuffer() );
+	windows.erase( it );
+}
+
+std::vector<HostBuffer> MMU::QueryHostBuffers( MemorySectionIdentifier section ) const
+{
+	verify_method;
+
+	return Windows( const_cast<InternalContextBuffer&>( CurrentBuffer() ), section );
 }
 
 Offsets MMU::QuerySectionLimits() const
@@ -176,15 +720,31 @@ Offsets MMU::QuerySectionLimits() const
 	Offsets ret;
 	const InternalContextBuffer& icb = CurrentBuffer();
 
-	ret.Code() = icb.commands.size();
-	ret.Data() = icb.data.size();
-	ret.Bytepool() = icb.bytepool.size();
+	ret.Code() = icb.CodeSize();
+	ret.Data() = icb.DataSize() + icb.data_reserved;
+	ret.Bytepool() = icb.BytepoolSize();
 	for( unsigned i = 0; i < Value::V_MAX; ++i ) {
 		ret.Stack( static_cast<Value::Type>( i ) ) = stacks_[i].size();
 	}
 	return ret;
 }
 
+size_t MMU::QueryReservedData( calc_t* pattern ) const
+{
+	const InternalContextBuffer& icb = CurrentBuffer();
+
+	if( pattern ) {
+		*pattern = icb.data_reserve_pattern;
+	}
+	return icb.data_reserve_cells.empty() ? icb.data_reserved : 0;
+}
+
+void MMU::MaterializeReservedData()
+{
+	verify_method;
+	MaterializeReserve( CurrentBuffer() );
+}
+
 void MMU::AppendSection( MemorySectionIdentifier section, const void* image, size_t count )
 {
 	verify_method;
@@ -195,7 +755,9 @@ void MMU::AppendSection( MemorySectionIdentifier section, const void* image, siz
 		msg( E_INFO, E_DEBUG, "Adding text (count: %zu) -> buffer %zu",
 		     count, CurrentContextBuffer() );
 
-		std::vector<Command>& text_dest = CurrentBuffer().commands;
+		UnshareImage( CurrentBuffer() );
+		PrivatizeSection( CurrentBuffer(), SEC_CODE_IMAGE );
+		arena_vector<Command>& text_dest = CurrentBuffer().commands;
 		const Command* tmp_image = reinterpret_cast<const Command*>( image );
 
 		text_dest.insert( text_dest.end(), tmp_image, tmp_image + count );
@@ -206,18 +768,45 @@ void MMU::AppendSection( MemorySectionIdentifier section, const void* image, siz
 		msg( E_INFO, E_DEBUG, "Adding data (count: %zu) -> buffer %zu",
 		     count, CurrentContextBuffer() );
 
-		std::vector<calc_t>& data_dest = CurrentBuffer().data;
+		FoldReserve( CurrentBuffer() );
+		PrivatizeSection( CurrentBuffer(), SEC_DATA_IMAGE );
+
+		arena_vector<calc_t>& data_dest = CurrentBuffer().data;
 		const calc_t* tmp_image = reinterpret_cast<const calc_t*>( image );
 
 		data_dest.insert( data_dest.end(), tmp_image, tmp_image + count );
 		break;
 	}
 
+	case SEC_DATA_RESERVE: {
+		msg( E_INFO, E_DEBUG, "Reserving data (count: %zu) -> buffer %zu",
+		     count, CurrentContextBuffer() );
+
+		InternalContextBuffer& icb = CurrentBuffer();
+		const calc_t* pattern = reinterpret_cast<const calc_t*>( image );
+
+		// Only a single fill pattern can be kept unmaterialized.
+		if( icb.data_reserved &&
+		    ( !icb.data_reserve_cells.empty() ||
+		      icb.data_reserve_pattern.type != pattern->type ||
+		      icb.data_reserve_pattern.integer != pattern->integer ) ) {
+			FoldReserve( icb );
+		}
+
+		icb.data_reserve_pattern = *pattern;
+		icb.data_reserved += count;
+		break;
+	}
+
 	case SEC_BYTEPOOL_IMAGE: {
 		msg( E_INFO, E_DEBUG, "Adding raw data (bytes: %zu) -> buffer %zu",
 		     count, CurrentContextBuffer() );
 
-		CurrentBuffer().bytepool.append( count, image );
+		PrivatizeSection( CurrentBuffer(), SEC_BYTEPOOL_IMAGE );
+		arena_vector<char>& bytepool_dest = CurrentBuffer().bytepool;
+		const char* tmp_image = reinterpret_cast<const char*>( image );
+
+		bytepool_dest.insert( bytepool_dest.end(), tmp_image, tmp_image + count );
 		break;
 	}
 
@@ -238,19 +827,28 @@ void MMU::AppendSection( MemorySectionIdentifier section, const void* image, siz
 		for( unsigned i = 0; i < Value::V_MAX; ++i ) {
 			msg( E_INFO, E_DEBUG, "Done: read %zu elements of type \"%s\"",
 				 stats[i], ProcDebug::Print( static_cast<Value::Type>( i ) ).c_str() );
+			stack_usage_[i].Update( stacks_[i].capacity() * sizeof( calc_t ) );
 		}
 		break;
 	}
 
 	case SEC_SYMBOL_MAP:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
 		casshole( "Cannot do binary operations on symbol map section" );
 		break;
 
+	case SEC_NATIVE_IMAGE:
+		casshole( "Cannot do binary operations on native image section" );
+		break;
+
 	case SEC_MAX:
 	default:
 		casshole( "Switch error" );
 		break;
 	}
+
+	UpdateUsage( CurrentBuffer() );
 }
 
 void MMU::ModifySection( MemorySectionIdentifier section, size_t address,
@@ -266,11 +864,21 @@ void MMU::ModifySection( MemorySectionIdentifier section, size_t address,
 		msg( E_INFO, E_DEBUG, "%s text (count: %zu) -> buffer %zu at %zu",
 			 dbg_op, count, CurrentContextBuffer(), address );
 
-		std::vector<Command>& text_dest = CurrentBuffer().commands;
+		InternalContextBuffer& icb = CurrentBuffer();
+		UnshareImage( icb );
+
+		// Adopted images are written in place as long as their size is kept.
+		if( insert || address + count > icb.ext_commands.count ) {
+			PrivatizeSection( icb, SEC_CODE_IMAGE );
+		}
+
+		arena_vector<Command>& text_dest = icb.commands;
 		const Command* tmp_image = reinterpret_cast<const Command*>( image );
 
 		if( insert ) {
 			text_dest.insert( text_dest.begin() + address, tmp_image, tmp_image + count );
+		} else if( icb.ext_commands.base ) {
+			std::copy( tmp_image, tmp_image + count, icb.ext_commands.base + address );
 		} else {
 			PasteVector( text_dest, address, tmp_image, tmp_image + count );
 		}
@@ -281,13 +889,30 @@ void MMU::ModifySection( MemorySectionIdentifier section, size_t address,
 		msg( E_INFO, E_DEBUG, "%s data (count: %zu) -> buffer %zu at %zu",
 		     dbg_op, count, CurrentContextBuffer(), address );
 
-		std::vector<calc_t>& data_dest = CurrentBuffer().data;
+		InternalContextBuffer& icb = CurrentBuffer();
+		if( insert || address + count > icb.DataSize() ) {
+			FoldReserve( icb );
+		}
+
+		if( insert || address + count > icb.ext_data.count ) {
+			PrivatizeSection( icb, SEC_DATA_IMAGE );
+		}
+
+		arena_vector<calc_t>& data_dest = icb.data;
+		const std::vector<HostBuffer>& windows = icb.data_windows;
 		const calc_t* tmp_image = reinterpret_cast<const calc_t*>( image );
 
 		if( insert ) {
+			cassert( windows.empty(), "Cannot insert into DATA with host buffers mapped" );
 			data_dest.insert( data_dest.begin() + address, tmp_image, tmp_image + count );
 		} else {
-			PasteVector( data_dest, address, tmp_image, tmp_image + count );
+			if( icb.ext_data.base ) {
+				FaultIn( icb, SEC_DATA_IMAGE, address, count );
+				std::copy( tmp_image, tmp_image + count, icb.ext_data.base + address );
+			} else {
+				PasteVector( data_dest, address, tmp_image, tmp_image + count );
+			}
+			WriteThroughWindows( windows, address, count, tmp_image );
 		}
 		break;
 	}
@@ -296,10 +921,36 @@ void MMU::ModifySection( MemorySectionIdentifier section, size_t address,
 		msg( E_INFO, E_DEBUG, "%s raw data (bytes: %zu) -> buffer %zu at %zu",
 		     dbg_op, count, CurrentContextBuffer(), address );
 
+		InternalContextBuffer& icb = CurrentBuffer();
+
+		if( insert || address + count > icb.ext_bytepool.count ) {
+			PrivatizeSection( icb, SEC_BYTEPOOL_IMAGE );
+		}
+
+		arena_vector<char>& bytepool_dest = icb.bytepool;
+		const std::vector<HostBuffer>& windows = icb.bytepool_windows;
+		const char* tmp_image = reinterpret_cast<const char*>( image );
+
 		if( insert ) {
-			CurrentBuffer().bytepool.insert( address, count, image );
+			cassert( windows.empty(), "Cannot insert into BYTEPOOL with host buffers mapped" );
+			bytepool_dest.insert( bytepool_dest.begin() + address, tmp_image, tmp_image + count );
 		} else {
-			CurrentBuffer().bytepool.paste( address, count, image );
+			if( icb.ext_bytepool.base ) {
+				FaultIn( icb, SEC_BYTEPOOL_IMAGE, address, count );
+				std::copy( tmp_image, tmp_image + count, icb.ext_bytepool.base + address );
+			} else {
+				PasteVector( bytepool_dest, address, tmp_image, tmp_image + count );
+			}
+
+			for( const HostBuffer& window: windows ) {
+				size_t first = std::max( address, window.address ),
+				       last = std::min( address + count, window.address + window.count );
+
+				if( first < last ) {
+					memcpy( reinterpret_cast<char*>( window.buffer ) + ( first - window.address ),
+					        tmp_image + ( first - address ), last - first );
+				}
+			}
 		}
 		break;
 	}
@@ -313,14 +964,177 @@ void MMU::ModifySection( MemorySectionIdentifier section, size_t address,
 	}
 
 	case SEC_SYMBOL_MAP:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
 		casshole( "Cannot do binary operations on symbol map section" );
 		break;
 
+	case SEC_DATA_RESERVE:
+		casshole( "Cannot do binary operations on data reservation section" );
+		break;
+
+	case SEC_NATIVE_IMAGE:
+		casshole( "Cannot do binary operations on native image section" );
+		break;
+
+	case SEC_MAX:
+	default:
+		casshole( "Switch error" );
+		break;
+	}
+
+	UpdateUsage( CurrentBuffer() );
+}
+
+void MMU::ResizeSection( MemorySectionIdentifier section, size_t count )
+{
+	verify_method;
+
+	InternalContextBuffer& icb = CurrentBuffer();
+
+	msg( E_INFO, E_DEBUG, "Resizing %s -> %zu in buffer %zu",
+	     ProcDebug::Print( section.SectionType() ).c_str(), count, CurrentContextBuffer() );
+
+	switch( section.SectionType() ) {
+	case SEC_CODE_IMAGE:
+		UnshareImage( icb );
+		PrivatizeSection( icb, SEC_CODE_IMAGE );
+		icb.commands.resize( count );
+		break;
+
+	case SEC_DATA_IMAGE:
+		cassert( icb.data_windows.empty(), "Cannot resize DATA with host buffers mapped" );
+		FoldReserve( icb );
+		PrivatizeSection( icb, SEC_DATA_IMAGE );
+		icb.data.resize( count );
+		break;
+
+	case SEC_BYTEPOOL_IMAGE:
+		cassert( icb.bytepool_windows.empty(), "Cannot resize BYTEPOOL with host buffers mapped" );
+		PrivatizeSection( icb, SEC_BYTEPOOL_IMAGE );
+		icb.bytepool.resize( count );
+		break;
+
+	case SEC_STACK_IMAGE:
+	case SEC_SYMBOL_MAP:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
+	case SEC_DATA_RESERVE:
+	case SEC_NATIVE_IMAGE:
+		casshole( "Cannot resize %s", ProcDebug::Print( section.SectionType() ).c_str() );
+		break;
+
 	case SEC_MAX:
 	default:
 		casshole( "Switch error" );
 		break;
 	}
+
+	UpdateUsage( icb );
+}
+
+void MMU::AdoptSection( MemorySectionIdentifier section, void* image, size_t count,
+                        const std::shared_ptr<void>& backing )
+{
+	verify_method;
+	cassert( image, "NULL section image pointer" );
+
+	InternalContextBuffer& icb = CurrentBuffer();
+
+	msg( E_INFO, E_DEBUG, "Adopting %s in place (count: %zu) -> buffer %zu",
+	     ProcDebug::Print( section.SectionType() ).c_str(), count, CurrentContextBuffer() );
+
+	switch( section.SectionType() ) {
+	case SEC_CODE_IMAGE:
+		cassert( !icb.CodeSize(), "Cannot adopt CODE into a non-empty image" );
+		UnshareImage( icb );
+		icb.ext_commands.base = reinterpret_cast<Command*>( image );
+		icb.ext_commands.count = count;
+		break;
+
+	case SEC_DATA_IMAGE:
+		cassert( !icb.DataSize() && !icb.data_reserved, "Cannot adopt DATA into a non-empty image" );
+		icb.ext_data.base = reinterpret_cast<calc_t*>( image );
+		icb.ext_data.count = count;
+		break;
+
+	case SEC_BYTEPOOL_IMAGE:
+		cassert( !icb.BytepoolSize(), "Cannot adopt BYTEPOOL into a non-empty image" );
+		icb.ext_bytepool.base = reinterpret_cast<char*>( image );
+		icb.ext_bytepool.count = count;
+		break;
+
+	case SEC_STACK_IMAGE:
+	case SEC_SYMBOL_MAP:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
+	case SEC_DATA_RESERVE:
+	case SEC_NATIVE_IMAGE:
+		casshole( "Cannot adopt %s", ProcDebug::Print( section.SectionType() ).c_str() );
+		break;
+
+	case SEC_MAX:
+	default:
+		casshole( "Switch error" );
+		break;
+	}
+
+	if( std::find( icb.ext_backing.begin(), icb.ext_backing.end(), backing ) == icb.ext_backing.end() ) {
+		icb.ext_backing.push_back( backing );
+	}
+
+	UpdateUsage( icb );
+}
+
+void MMU::DeferSection( MemorySectionIdentifier section, size_t count, const section_source_t& source )
+{
+	verify_method;
+	cassert( source, "NULL section source" );
+	cverify( count, "Cannot defer an empty section" );
+
+	InternalContextBuffer::DeferredView* deferred;
+	size_t entry_size;
+
+	switch( section.SectionType() ) {
+	case SEC_DATA_IMAGE:
+		deferred = &CurrentBuffer().deferred_data;
+		entry_size = sizeof( calc_t );
+		break;
+
+	case SEC_BYTEPOOL_IMAGE:
+		deferred = &CurrentBuffer().deferred_bytepool;
+		entry_size = 1;
+		break;
+
+	case SEC_CODE_IMAGE:
+	case SEC_SYMBOL_MAP:
+	case SEC_DATA_RESERVE:
+	case SEC_NATIVE_IMAGE:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
+	case SEC_STACK_IMAGE:
+	case SEC_MAX:
+	default:
+		casshole( "Cannot defer %s", ProcDebug::Print( section.SectionType() ).c_str() );
+		return;
+	}
+
+	msg( E_INFO, E_DEBUG, "Deferring %s (count: %zu) -> buffer %zu",
+	     ProcDebug::Print( section.SectionType() ).c_str(), count, CurrentContextBuffer() );
+
+	// Zeroed storage is not touched (and thus not committed) until its pages are read.
+	std::shared_ptr<void> storage( calloc( count, entry_size ), free );
+	cassert( storage, "Cannot allocate %zu bytes for a deferred %s", count * entry_size,
+	         ProcDebug::Print( section.SectionType() ).c_str() );
+
+	// Set up the view first, so that the storage is not accounted as loaded.
+	size_t pages = ( count * entry_size + deferred_page_bytes - 1 ) / deferred_page_bytes;
+	deferred->source = source;
+	deferred->loaded.assign( pages, false );
+	deferred->missing = pages;
+	deferred->loaded_bytes = 0;
+
+	AdoptSection( section, storage.get(), count, storage );
 }
 
 void MMU::SetSymbolImage( symbol_map&& symbols )
@@ -329,7 +1143,11 @@ void MMU::SetSymbolImage( symbol_map&& symbols )
 
 	msg( E_INFO, E_DEBUG, "Setting symbol map (records: %zu) -> buffer %zu",
 		 symbols.size(), CurrentContextBuffer() );
-	CurrentBuffer().sym_table = std::move( symbols );
+
+	InternalContextBuffer& icb = CurrentBuffer();
+	UnshareImage( icb );
+	icb.sym_table = std::move( symbols );
+	icb.usage[MemorySectionIdentifier( SEC_SYMBOL_MAP ).Index()].Update( SymbolMapBytes( icb.sym_table ) );
 }
 
 symbol_map MMU::DumpSymbolImage() const
@@ -339,8 +1157,8 @@ symbol_map MMU::DumpSymbolImage() const
 	const InternalContextBuffer& ctx = CurrentBuffer();
 
 	msg( E_INFO, E_DEBUG, "Dumping symbol map (buffer %zu) -> %zu records",
-		 CurrentContextBuffer(), ctx.sym_table.size() );
-	return CurrentBuffer().sym_table;
+		 CurrentContextBuffer(), ctx.Symbols().size() );
+	return ctx.Symbols();
 }
 
 llarray MMU::DumpSection( MemorySectionIdentifier section, size_t address, size_t count )
@@ -354,30 +1172,55 @@ llarray MMU::DumpSection( MemorySectionIdentifier section, size_t address, size_
 		msg( E_INFO, E_DEBUG, "Dumping text (buffer %zu) -> range %zu:%zu",
 		     CurrentContextBuffer(), address, count );
 
-		cassert( address + count <= icb.commands.size(),
-				 "Invalid range requested (section limit: %zu)", icb.commands.size() );
+		cassert( address + count <= icb.CodeSize(),
+				 "Invalid range requested (section limit: %zu)", icb.CodeSize() );
 
-		return llarray( icb.commands.data() + address, sizeof( Command ) * count );
+		return llarray( icb.Code() + address, sizeof( Command ) * count );
 	}
 
 	case SEC_DATA_IMAGE: {
 		msg( E_INFO, E_DEBUG, "Dumping data (buffer %zu) -> range %zu:%zu",
 		     CurrentContextBuffer(), address, count );
 
-		cassert( address + count <= icb.data.size(),
-				 "Invalid range requested (section limit: %zu)", icb.data.size() );
+		cassert( address + count <= icb.DataSize() + icb.data_reserved,
+				 "Invalid range requested (section limit: %zu)", icb.DataSize() + icb.data_reserved );
 
-		return llarray( icb.data.data() + address, sizeof( calc_t ) * count );
+		if( !icb.data_windows.empty() || address + count > icb.DataSize() ) {
+			std::vector<calc_t> cells( count );
+			CopyCells( icb, address, count, cells.data() );
+			OverlayWindows( icb.data_windows, address, count, cells.data() );
+			return llarray( cells.data(), sizeof( calc_t ) * count );
+		}
+
+		FaultIn( icb, SEC_DATA_IMAGE, address, count );
+		return llarray( icb.Data() + address, sizeof( calc_t ) * count );
 	}
 
 	case SEC_BYTEPOOL_IMAGE: {
 		msg( E_INFO, E_DEBUG, "Dumping bytepool (buffer %zu) -> range %zu:%zu",
 		     CurrentContextBuffer(), address, count );
 
-		cassert( address + count <= icb.bytepool.size(),
-				 "Invalid range requested (section limit: %zu)", icb.data.size() );
+		cassert( address + count <= icb.BytepoolSize(),
+				 "Invalid range requested (section limit: %zu)", icb.BytepoolSize() );
+		FaultIn( icb, SEC_BYTEPOOL_IMAGE, address, count );
+
+		if( !icb.bytepool_windows.empty() ) {
+			std::vector<char> bytes( icb.Bytepool() + address, icb.Bytepool() + address + count );
 
-		return llarray( icb.bytepool + address, count );
+			for( const HostBuffer& window: icb.bytepool_windows ) {
+				size_t first = std::max( address, window.address ),
+				       last = std::min( address + count, window.address + window.count );
+
+				if( first < last ) {
+					memcpy( bytes.data() + ( first - address ),
+					        reinterpret_cast<const char*>( window.buffer ) + ( first - window.address ), last - first );
+				}
+			}
+
+			return llarray( bytes.data(), count );
+		}
+
+		return llarray( icb.Bytepool() + address, count );
 	}
 
 	case SEC_STACK_IMAGE: {
@@ -394,9 +1237,19 @@ llarray MMU::DumpSection( MemorySectionIdentifier section, size_t address, size_
 	}
 
 	case SEC_SYMBOL_MAP:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
 		casshole( "Cannot do binary operations on symbol map section" );
 		break;
 
+	case SEC_DATA_RESERVE:
+		casshole( "Cannot do binary operations on data reservation section" );
+		break;
+
+	case SEC_NATIVE_IMAGE:
+		casshole( "Cannot do binary operations on native image section" );
+		break;
+
 	case SEC_MAX:
 	default:
 		casshole( "Switch error" );
@@ -404,6 +1257,60 @@ llarray MMU::DumpSection( MemorySectionIdentifier section, size_t address, size_
 	}
 }
 
+const void* MMU::ViewSection( MemorySectionIdentifier section, size_t address, size_t count )
+{
+	verify_method;
+
+	InternalContextBuffer& icb = CurrentBuffer();
+
+	switch( section.SectionType() ) {
+	case SEC_CODE_IMAGE:
+		cassert( address + count <= icb.CodeSize(),
+				 "Invalid range requested (section limit: %zu)", icb.CodeSize() );
+		return icb.Code() + address;
+
+	case SEC_DATA_IMAGE:
+		cassert( address + count <= icb.DataSize() + icb.data_reserved,
+				 "Invalid range requested (section limit: %zu)", icb.DataSize() + icb.data_reserved );
+
+		if( !icb.data_windows.empty() ) {
+			return nullptr;
+		}
+
+		// The reserved region is stored apart from the rest of the image.
+		if( address + count <= icb.DataSize() ) {
+			FaultIn( icb, SEC_DATA_IMAGE, address, count );
+			return icb.Data() + address;
+		} else if( address >= icb.DataSize() && !icb.data_reserve_cells.empty() ) {
+			return icb.data_reserve_cells.data() + ( address - icb.DataSize() );
+		}
+
+		return nullptr;
+
+	case SEC_BYTEPOOL_IMAGE:
+		cassert( address + count <= icb.BytepoolSize(),
+				 "Invalid range requested (section limit: %zu)", icb.BytepoolSize() );
+		FaultIn( icb, SEC_BYTEPOOL_IMAGE, address, count );
+		return icb.bytepool_windows.empty() ? icb.Bytepool() + address : nullptr;
+
+	case SEC_STACK_IMAGE:
+	case SEC_SYMBOL_MAP:
+	case SEC_SYMBOL_TABLE:
+	case SEC_SYMBOL_NAMES:
+	case SEC_DATA_RESERVE:
+	case SEC_NATIVE_IMAGE:
+		casshole( "Cannot view section %s in place", ProcDebug::Print( section.SectionType() ).c_str() );
+		break;
+
+	case SEC_MAX:
+	default:
+		casshole( "Switch error" );
+		break;
+	}
+
+	return nullptr;
+}
+
 void MMU::ShiftImages( const Offsets& offsets )
 {
 	verify_method;
@@ -411,17 +1318,24 @@ void MMU::ShiftImages( const Offsets& offsets )
 	msg( E_INFO, E_DEBUG, "Shifting sections in context %zu", CurrentContextBuffer() );
 
 	InternalContextBuffer& icb = CurrentBuffer();
+	cassert( icb.data_windows.empty() && icb.bytepool_windows.empty(),
+	         "Cannot shift images with host buffers mapped" );
 
+	UnshareImage( icb );
+	PrivatizeImages( icb );
 	icb.commands.insert( icb.commands.begin(), offsets.Code(), Command() );
 	icb.data.insert( icb.data.begin(), offsets.Data(), calc_t() );
-	icb.bytepool.insert( 0, offsets.Bytepool(), nullptr );
+	icb.bytepool.insert( icb.bytepool.begin(), offsets.Bytepool(), 0 );
+
+	UpdateUsage( icb );
 }
 
-void MMU::PasteFromContext( ctx_t id )
+void MMU::PasteFromContext( ctx_t id, const Offsets& at )
 {
 	verify_method;
 	ctx_t main_ctx = CurrentContextBuffer();
-	msg( E_INFO, E_DEBUG, "Pasting context %zu -> %zu", id, main_ctx );
+	msg( E_INFO, E_DEBUG, "Pasting context %zu -> %zu (code at %zu, data at %zu, bytepool at %zu)",
+	     id, main_ctx, at.Code(), at.Data(), at.Bytepool() );
 
 	Debug::API::ClrObjectFlag( this, Debug::OF_USEVERIFY );
 	InternalContextBuffer& dest = CurrentBuffer();
@@ -430,9 +1344,125 @@ void MMU::PasteFromContext( ctx_t id )
 	SelectContextBuffer( main_ctx );
 	Debug::API::SetObjectFlag( this, Debug::OF_USEVERIFY );
 
-	PasteVector( dest.commands, 0, src.commands.begin(), src.commands.end() );
-	PasteVector( dest.data, 0, src.data.begin(), src.data.end() );
-	dest.bytepool.paste( 0, src.bytepool.size(), src.bytepool );
+	cassert( src.data_windows.empty() && src.bytepool_windows.empty(),
+	         "Cannot paste context %zu with host buffers mapped", id );
+
+	FaultIn( src, SEC_DATA_IMAGE, 0, src.DataSize() );
+	FaultIn( src, SEC_BYTEPOOL_IMAGE, 0, src.BytepoolSize() );
+
+	// The pasted cells shall land in the explicit image of the destination.
+	if( at.Data() + src.DataSize() + src.data_reserved > dest.DataSize() ) {
+		FoldReserve( dest );
+	}
+
+	UnshareImage( dest );
+	PrivatizeImages( dest );
+	PasteVector( dest.commands, at.Code(), src.Code(), src.Code() + src.CodeSize() );
+	PasteVector( dest.data, at.Data(), src.Data(), src.Data() + src.DataSize() );
+
+	// Fill the source's reserved region without materializing it in the source,
+	// unless it becomes the reserved tail of the destination as it is.
+	if( src.data_reserved ) {
+		size_t reserve_begin = at.Data() + src.DataSize(), reserve_end = reserve_begin + src.data_reserved;
+
+		if( reserve_begin == dest.data.size() && !dest.data_reserved && src.data_reserve_cells.empty() ) {
+			dest.data_reserved = src.data_reserved;
+			dest.data_reserve_pattern = src.data_reserve_pattern;
+		} else {
+			if( dest.data.size() < reserve_end ) {
+				dest.data.resize( reserve_end );
+			}
+			CopyCells( src, src.DataSize(), src.data_reserved, dest.data.data() + reserve_begin );
+		}
+	}
+
+	PasteVector( dest.bytepool, at.Bytepool(), src.Bytepool(), src.Bytepool() + src.BytepoolSize() );
+
+	UpdateUsage( dest );
+}
+
+program_image_t MMU::ExportImage( ctx_t id )
+{
+	verify_method;
+
+	auto it = buffers_.find( id );
+	cassert( it != buffers_.end(), "Exporting an inexistent context buffer ID %lu", id );
+	InternalContextBuffer& icb = it->second;
+
+	cverify( icb.data_windows.empty() && icb.bytepool_windows.empty(),
+	         "Cannot export context buffer ID %lu with host buffers mapped", id );
+
+	msg( E_INFO, E_DEBUG, "Exporting context buffer ID %lu as a program image (commands: %zu)", id, icb.CodeSize() );
+
+	std::shared_ptr<ProgramImage> image( new ProgramImage );
+
+	image->commands.assign( icb.Code(), icb.Code() + icb.CodeSize() );
+	for( Command& cmd: image->commands ) {
+		cmd.cached_executor = nullptr;
+		cmd.cached_handle = nullptr;
+	}
+
+	FaultIn( icb, SEC_DATA_IMAGE, 0, icb.DataSize() );
+	FaultIn( icb, SEC_BYTEPOOL_IMAGE, 0, icb.BytepoolSize() );
+
+	image->data.assign( icb.Data(), icb.Data() + icb.DataSize() );
+	image->data_reserve_pattern = icb.data_reserve_pattern;
+	if( icb.data_reserve_cells.empty() ) {
+		image->data_reserved = icb.data_reserved;
+	} else {
+		image->data.insert( image->data.end(), icb.data_reserve_cells.begin(), icb.data_reserve_cells.end() );
+		image->data_reserved = 0;
+	}
+	image->bytepool.assign( icb.Bytepool(), icb.Bytepool() + icb.BytepoolSize() );
+	image->symbols = icb.Symbols();
+
+	return image;
+}
+
+ctx_t MMU::InstantiateImage( const program_image_t& image )
+{
+	verify_method;
+	cassert( image, "NULL program image" );
+
+	ctx_t id = AllocateContextBuffer();
+	InternalContextBuffer& icb = buffers_.find( id )->second;
+
+	msg( E_INFO, E_DEBUG, "Instantiating program image (commands: %zu) -> buffer %zu", image->commands.size(), id );
+
+	icb.image = image;
+	icb.data.assign( image->data.begin(), image->data.end() );
+	icb.data_reserved = image->data_reserved;
+	icb.data_reserve_pattern = image->data_reserve_pattern;
+	icb.bytepool.assign( image->bytepool.begin(), image->bytepool.end() );
+
+	UpdateUsage( icb );
+	return id;
+}
+
+bool MMU::IsCodeShared() const
+{
+	return CurrentBuffer().image != nullptr;
+}
+
+MemoryUsage MMU::QueryMemoryUsage( ctx_t id ) const
+{
+	verify_method;
+
+	MemoryUsage result;
+
+	if( id ) {
+		auto it = buffers_.find( id );
+		cassert( it != buffers_.end(), "Querying memory usage of an inexistent context buffer ID %lu", id );
+
+		std::copy( it->second.usage, it->second.usage + SEC_COUNT, result.sections );
+		result.arena = it->second.arena_usage;
+	}
+
+	for( unsigned i = 0; i < Value::V_MAX; ++i ) {
+		result.at( MemorySectionIdentifier( SEC_STACK_IMAGE, static_cast<Value::Type>( i ) ) ) = stack_usage_[i];
+	}
+
+	return result;
 }
 
 void MMU::ResetContextBuffer( ctx_t id )
@@ -513,10 +1543,10 @@ bool MMU::_Verify() const
 		auto it = buffers_.find( current_ctx.buffer );
 		verify_statement( it != buffers_.end(), "Inexistent context buffer ID %lu is selected in the core", current_ctx.buffer );
 
-		verify_statement( !it->second.commands.size() ||
-		                  current_ctx.ip < it->second.commands.size(),
+		verify_statement( !it->second.CodeSize() ||
+		                  current_ctx.ip < it->second.CodeSize(),
 		                  "Invalid instruction pointer [%zu]: max %zu",
-		                  current_ctx.ip, it->second.commands.size() );
+		                  current_ctx.ip, it->second.CodeSize() );
 	}
 
 	return 1;
@@ -526,13 +1556,14 @@ void MMU::VerifyReference( const DirectReference& ref, Value::Type frame_stack_t
 {
 	switch( ref.section ) {
 	case S_CODE:
-		cverify( ref.address < CurrentBuffer().commands.size(),
-		         "Invalid reference [TEXT:%zu] : limit %zu", ref.address, CurrentBuffer().commands.size() );
+		cverify( ref.address < CurrentBuffer().CodeSize(),
+		         "Invalid reference [TEXT:%zu] : limit %zu", ref.address, CurrentBuffer().CodeSize() );
 		break;
 
 	case S_DATA:
-		cverify( ref.address < CurrentBuffer().data.size(),
-		         "Invalid reference [DATA:%zu] : limit %zu", ref.address, CurrentBuffer().data.size() );
+		cverify( ref.address < CurrentBuffer().DataSize() + CurrentBuffer().data_reserved,
+		         "Invalid reference [DATA:%zu] : limit %zu",
+		         ref.address, CurrentBuffer().DataSize() + CurrentBuffer().data_reserved );
 		break;
 
 	case S_REGISTER:
@@ -567,9 +1598,9 @@ void MMU::VerifyReference( const DirectReference& ref, Value::Type frame_stack_t
 	}
 
 	case S_BYTEPOOL:
-		cverify( ref.address < CurrentBuffer().bytepool.size(),
+		cverify( ref.address < CurrentBuffer().BytepoolSize(),
 		         "Invalid reference [BYTEPOOL:%zu] : allocated %zu bytes",
-		         ref.address, CurrentBuffer().bytepool.size() );
+		         ref.address, CurrentBuffer().BytepoolSize() );
 		break;
 
 	case S_NONE:
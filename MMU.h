@@ -4,6 +4,7 @@
 #include "build.h"
 
 #include "Interfaces.h"
+#include "Arena.h"
 
 // -------------------------------------------------------------------------------------
 // Library		Homework
@@ -19,16 +20,89 @@ using namespace Processor;
 class INTERPRETER_API MMU : public IMMU
 {
 	struct InternalContextBuffer {
-		std::vector<calc_t> data;
-		std::vector<Command> commands;
-		llarray bytepool;
+		// Owns the storage of the images below, so it is declared first to be destroyed last.
+		std::unique_ptr<Arena> arena;
+
+		arena_vector<calc_t> data;
+		arena_vector<Command> commands;
+
+		// Reserved DATA cells logically following "data". They are allocated on first access
+		// in storage of their own, so that the image before them is neither copied nor read in;
+		// operations which need DATA contiguous fold them into "data" (see MMU::FoldReserve()).
+		size_t data_reserved;
+		calc_t data_reserve_pattern;
+		arena_vector<calc_t> data_reserve_cells; // empty until materialized
+
+		arena_vector<char> bytepool;
 
 		symbol_map sym_table;
 
+		// Shared program image; while it is set, "commands" and "sym_table" are unused
+		// and code and symbols are read from the image. Modifying them unshares the image.
+		program_image_t image;
+
+		// Images adopted in place from external storage (e.g. a private file mapping).
+		// While a view is set, the corresponding vector above is empty and unused;
+		// changing the section size copies the view into the vector (see MMU::PrivatizeSection()).
+		template <typename T>
+		struct ExternalView
+		{
+			T* base;
+			size_t count;
+
+			ExternalView() : base( nullptr ), count( 0 ) {}
+		};
+
+		ExternalView<Command> ext_commands;
+		ExternalView<calc_t> ext_data;
+		ExternalView<char> ext_bytepool;
+		std::vector<std::shared_ptr<void> > ext_backing;
+
+		// Adopted DATA or BYTEPOOL storage filled from a source on first access (see MMU::FaultIn()).
+		struct DeferredView
+		{
+			section_source_t source;
+			std::vector<bool> loaded; // by page
+			size_t missing; // count of pages not loaded yet
+			size_t loaded_bytes;
+
+			DeferredView() : missing( 0 ), loaded_bytes( 0 ) {}
+		};
+
+		DeferredView deferred_data;
+		DeferredView deferred_bytepool;
+
+		// Host buffers mapped over DATA and BYTEPOOL, sorted by address, not overlapping.
+		std::vector<HostBuffer> data_windows;
+		std::vector<HostBuffer> bytepool_windows;
+
 		calc_t registers[R_MAX];
+
+		// Stack entries are unused: stacks are accounted in MMU::stack_usage_.
+		MemoryCounter usage[SEC_COUNT];
+		MemoryCounter arena_usage;
+
+		InternalContextBuffer();
+		InternalContextBuffer( InternalContextBuffer&& rhs ) = default;
+		InternalContextBuffer& operator=( InternalContextBuffer&& rhs );
+
+		size_t CodeSize() const
+		{ return image ? image->commands.size() : ext_commands.base ? ext_commands.count : commands.size(); }
+		const Command* Code() const
+		{ return image ? image->commands.data() : ext_commands.base ? ext_commands.base : commands.data(); }
+
+		size_t DataSize() const { return ext_data.base ? ext_data.count : data.size(); }
+		calc_t* Data() { return ext_data.base ? ext_data.base : data.data(); }
+		const calc_t* Data() const { return ext_data.base ? ext_data.base : data.data(); }
+
+		size_t BytepoolSize() const { return ext_bytepool.base ? ext_bytepool.count : bytepool.size(); }
+		char* Bytepool() { return ext_bytepool.base ? ext_bytepool.base : bytepool.data(); }
+		const char* Bytepool() const { return ext_bytepool.base ? ext_bytepool.base : bytepool.data(); }
+		const symbol_map& Symbols() const { return image ? image->symbols : sym_table; }
 	};
 
 	std::vector<calc_t> stacks_[Value::V_MAX];
+	MemoryCounter stack_usage_[Value::V_MAX];
 
 	std::map<ctx_t, InternalContextBuffer> buffers_;
 	std::map<ctx_t, InternalContextBuffer>::iterator current_buffer_;
@@ -39,6 +113,24 @@ class INTERPRETER_API MMU : public IMMU
 	const InternalContextBuffer& CurrentBuffer() const
 	{ cassert( current_buffer_ != buffers_.end(), "No context buffer is selected" ); return current_buffer_->second; }
 
+	static const size_t deferred_page_bytes = 4096;
+
+	static void MaterializeReserve( InternalContextBuffer& icb );
+	static void FoldReserve( InternalContextBuffer& icb );
+	static void CopyCells( InternalContextBuffer& icb, size_t address, size_t count, calc_t* dest );
+	static void FaultIn( InternalContextBuffer& icb, MemorySectionIdentifier section, size_t address, size_t count );
+	static void FaultInString( InternalContextBuffer& icb, size_t offset );
+	static void UnshareImage( InternalContextBuffer& icb );
+	static void PrivatizeSection( InternalContextBuffer& icb, MemorySectionIdentifier section );
+	static void PrivatizeImages( InternalContextBuffer& icb );
+	static void UpdateUsage( InternalContextBuffer& icb );
+
+	static calc_t& DataCell( InternalContextBuffer& icb, size_t addr );
+	static std::vector<HostBuffer>& Windows( InternalContextBuffer& icb, MemorySectionIdentifier section );
+	static const HostBuffer* FindWindow( const std::vector<HostBuffer>& windows, size_t addr );
+	static void OverlayWindows( const std::vector<HostBuffer>& windows, size_t address, size_t count, calc_t* dest );
+	static void WriteThroughWindows( const std::vector<HostBuffer>& windows, size_t address, size_t count, const calc_t* src );
+
 	void InternalDumpCtx( const InternalContextBuffer* icb, std::string& registers, std::string& stacks ) const;
 
 	void ClearStacks();
@@ -89,6 +181,7 @@ public:
 	virtual void			SelectContextBuffer( ctx_t id );
 	virtual void			ReleaseContextBuffer( ctx_t id );
 	virtual void			ResetContextBuffer( ctx_t id );
+	virtual std::vector<ctx_t> QueryContextBuffers() const;
 
 	virtual size_t			QueryStackTop( Value::Type type ) const;
 	virtual void            SetStackTop( Value::Type type, ssize_t adjust );
@@ -98,17 +191,37 @@ public:
 	virtual calc_t&			ARegister( Register reg_id );
 	virtual Command&		ACommand( size_t ip );
 	virtual calc_t&			AData( size_t addr );
-	virtual symbol_type&	ASymbol( size_t hash );
+	virtual const symbol_type& ASymbol( size_t hash );
 	virtual char*			ABytepool( size_t offset );
 
 	virtual Offsets			QuerySectionLimits() const;
+	virtual size_t			QueryReservedData( calc_t* pattern ) const;
+	virtual void			MaterializeReservedData();
+	virtual MemoryUsage		QueryMemoryUsage( ctx_t id ) const;
+
+	virtual void			MapHostBuffer( MemorySectionIdentifier section, size_t address,
+	                                       void* buffer, size_t count, Value::Type type );
+	virtual void			UnmapHostBuffer( MemorySectionIdentifier section, size_t address );
+	virtual std::vector<HostBuffer> QueryHostBuffers( MemorySectionIdentifier section ) const;
+
+	virtual calc_t			ReadData( size_t addr );
+	virtual void			WriteData( size_t addr, const calc_t& value );
+	virtual void*			ADataPayload( size_t addr, Value::Type* type = nullptr );
+	virtual void			SetDataType( size_t addr, Value::Type type );
 
 	virtual llarray			DumpSection( MemorySectionIdentifier section, size_t address,
 	                                     size_t count );
+	virtual const void*		ViewSection( MemorySectionIdentifier section, size_t address,
+	                                     size_t count );
 	virtual void			ModifySection( MemorySectionIdentifier section, size_t address,
 	                                       const void* data, size_t count, bool insert = false );
 	virtual void			AppendSection( MemorySectionIdentifier section,
 	                                       const void* data, size_t count );
+	virtual void			ResizeSection( MemorySectionIdentifier section, size_t count );
+	virtual void			AdoptSection( MemorySectionIdentifier section, void* data, size_t count,
+	                                      const std::shared_ptr<void>& backing );
+	virtual void			DeferSection( MemorySectionIdentifier section, size_t count,
+	                                      const section_source_t& source );
 
 	virtual void			SetSymbolImage( symbol_map && symbols );
 	virtual symbol_map		DumpSymbolImage() const;
@@ -117,7 +230,11 @@ public:
 	                                         Value::Type frame_stack_type ) const;
 
 	virtual void			ShiftImages( const Offsets& offsets ); // Shift forth all sections by specified offset, filling space with empty data.
-	virtual void			PasteFromContext( ctx_t id ); // Paste the specified context over the current one
+	virtual void			PasteFromContext( ctx_t id, const Offsets& at ); // Paste the specified context over the current one at given offsets
+
+	virtual program_image_t	ExportImage( ctx_t id );
+	virtual ctx_t			InstantiateImage( const program_image_t& image );
+	virtual bool			IsCodeShared() const;
 
 	virtual void			ResetEverything();
 };
@@ -0,0 +1,76 @@
+#ifndef INTERPRETER_MAPPEDFILE_H
+#define INTERPRETER_MAPPEDFILE_H
+
+#include "build.h"
+
+#ifdef TARGET_POSIX
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif // TARGET_POSIX
+
+// -------------------------------------------------------------------------------------
+// Library		Homework
+// File			MappedFile.h
+// Author		Ivan Shapovalov <intelfx100@gmail.com>
+// Description	Private read-write mapping of an input file.
+// -------------------------------------------------------------------------------------
+
+namespace Processor
+{
+
+/*
+ * The whole file is mapped copy-on-write: pages may be modified in place,
+ * but the changes never reach the file and the untouched pages stay shared
+ * with the page cache.
+ * If mapping is impossible (unsupported platform, a pipe, an empty file),
+ * the object is left empty and the caller shall fall back to reading the file.
+ */
+class MappedFile
+{
+	char* base_;
+	size_t length_;
+
+public:
+	explicit MappedFile( FILE* file ) :
+		base_( nullptr ),
+		length_( 0 )
+	{
+#ifdef TARGET_POSIX
+		struct stat file_info;
+		if( fstat( fileno( file ), &file_info ) || !S_ISREG( file_info.st_mode ) || !file_info.st_size ) {
+			return;
+		}
+
+		void* base = mmap( nullptr, file_info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno( file ), 0 );
+		if( base == MAP_FAILED ) {
+			return;
+		}
+
+		base_ = reinterpret_cast<char*>( base );
+		length_ = file_info.st_size;
+#endif // TARGET_POSIX
+	}
+
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+
+	~MappedFile()
+	{
+#ifdef TARGET_POSIX
+		if( base_ ) {
+			munmap( base_, length_ );
+		}
+#endif // TARGET_POSIX
+	}
+
+	bool IsMapped() const { return base_; }
+	char* Data() const { return base_; }
+	size_t Size() const { return length_; }
+};
+
+typedef std::shared_ptr<MappedFile> mapped_file_t;
+
+} // namespace Processor
+
+#endif // INTERPRETER_MAPPEDFILE_H
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -19,6 +19,10 @@ const char* FileSectionType_ids[SEC_MAX] = {
 	"data image",
 	"byte-granular pool image",
 	"symbol map",
+	"data reservation",
+	"native image",
+	"stripped symbol table",
+	"symbol names",
 	"stack image"
 };
 
@@ -0,0 +1,177 @@
+#include "stdafx.h"
+#include "Interfaces.h"
+
+#ifdef TARGET_POSIX
+# include <sys/stat.h>
+# include <sys/types.h>
+# include <unistd.h>
+#endif // TARGET_POSIX
+
+// -------------------------------------------------------------------------------------
+// Library		Homework
+// File			ModuleCache.cpp
+// Author		Ivan Shapovalov <intelfx100@gmail.com>
+// Description	Byte-code cache of modules loaded from sources.
+// -------------------------------------------------------------------------------------
+
+namespace Processor
+{
+
+namespace
+{
+
+/*
+ * An entry is a plain byte-code file named "<environment>-<contents>-<size>.bc", where
+ * - environment is a hash of the cache version, the command set version, the linker options
+ *   and the in-memory structure sizes,
+ * - contents and size are a hash and the size of the source file.
+ * Entries are never updated in place: a changed source gets a new entry.
+ */
+
+const size_t module_cache_version = 1; // bump when loading a source yields a different context
+
+} // unnamed namespace
+
+void ProcessorAPI::SetModuleCache( const char* directory )
+{
+	verify_method;
+
+	if( !directory ) {
+		module_cache_.clear();
+		return;
+	}
+
+#ifdef TARGET_POSIX
+	if( mkdir( directory, 0777 ) && errno != EEXIST ) {
+		msg( E_WARNING, E_VERBOSE, "Could not create module cache directory \"%s\": %s", directory, strerror( errno ) );
+	}
+#endif // TARGET_POSIX
+
+	module_cache_ = directory;
+	msg( E_INFO, E_VERBOSE, "Using module cache in \"%s\"", directory );
+}
+
+FILE* ProcessorAPI::OpenCachedModule( FILE* source, std::string* entry )
+{
+	verify_method;
+
+	cassert( source, "Invalid source file" );
+	cassert( entry, "Invalid entry pointer" );
+
+	entry->clear();
+	if( module_cache_.empty() ) {
+		return nullptr;
+	}
+
+	// Sources which cannot be read twice (e.g. pipes) are not cached.
+	long start = ftell( source );
+	if( start < 0 || fseek( source, 0, SEEK_END ) ) {
+		msg( E_WARNING, E_VERBOSE, "Not caching a source which cannot be seeked" );
+		return nullptr;
+	}
+
+	long end = ftell( source );
+	fseek( source, start, SEEK_SET );
+
+	std::vector<char> contents( ( end > start ) ? end - start : 0 );
+	size_t read = contents.empty() ? 0 : fread( contents.data(), 1, contents.size(), source );
+	fseek( source, start, SEEK_SET );
+
+	if( read != contents.size() ) {
+		msg( E_WARNING, E_VERBOSE, "Not caching a source which could not be read: %s", strerror( errno ) );
+		return nullptr;
+	}
+
+	size_t environment[] = {
+		module_cache_version,
+		CommandSet()->Version(),
+		linker_options_,
+		sizeof( calc_t ),
+		sizeof( Command )
+	};
+
+	char name[STATIC_LENGTH];
+	snprintf( name, STATIC_LENGTH, "%016zx-%016zx-%zu.bc",
+	          hasher_xroll( environment, sizeof( environment ), 0 ),
+	          hasher_xroll( contents.data(), contents.size(), 0 ),
+	          contents.size() );
+	*entry = module_cache_ + "/" + name;
+
+	FILE* cached = fopen( entry->c_str(), "rb" );
+	if( cached ) {
+		msg( E_INFO, E_VERBOSE, "Module cache hit: \"%s\"", entry->c_str() );
+	} else {
+		msg( E_INFO, E_VERBOSE, "Module cache miss: \"%s\"", entry->c_str() );
+	}
+
+	return cached;
+}
+
+void ProcessorAPI::DiscardCachedModule( const std::string& entry )
+{
+	verify_method;
+
+	if( entry.empty() ) {
+		return;
+	}
+
+	msg( E_WARNING, E_VERBOSE, "Discarding module cache entry \"%s\"", entry.c_str() );
+
+	if( remove( entry.c_str() ) && errno != ENOENT ) {
+		msg( E_WARNING, E_VERBOSE, "Could not remove module cache entry \"%s\": %s", entry.c_str(), strerror( errno ) );
+	}
+}
+
+void ProcessorAPI::CacheModule( ctx_t id, const std::string& entry )
+{
+	verify_method;
+
+	if( entry.empty() ) {
+		return;
+	}
+
+	// The entry is written under a temporary name and renamed, so that no loader reads it partially.
+	// The name is unique among the processors of all processes sharing the cache.
+	long process = 0;
+#ifdef TARGET_POSIX
+	process = getpid();
+#endif // TARGET_POSIX
+
+	char temporary[STATIC_LENGTH];
+	snprintf( temporary, STATIC_LENGTH, "%s.%ld-%p-%zu.tmp", entry.c_str(), process, static_cast<void*>( this ), id );
+
+	FILE* file = fopen( temporary, "wb" );
+	if( !file ) {
+		msg( E_WARNING, E_VERBOSE, "Could not write module cache entry \"%s\": %s", temporary, strerror( errno ) );
+		return;
+	}
+
+	// Entries are plain byte-code, whatever is requested for dumps.
+	// Dump() closes the file and fails unless all of it has been written out.
+	mask_t writer_options = writer_options_;
+	writer_options_ = 0;
+
+	try {
+		Dump( id, file );
+	}
+
+	catch( std::exception& e ) {
+		writer_options_ = writer_options;
+		msg( E_WARNING, E_VERBOSE, "Could not write module cache entry \"%s\": %s", temporary, e.what() );
+		remove( temporary );
+		return;
+	}
+
+	writer_options_ = writer_options;
+
+	if( rename( temporary, entry.c_str() ) ) {
+		msg( E_WARNING, E_VERBOSE, "Could not write module cache entry \"%s\": %s", entry.c_str(), strerror( errno ) );
+		remove( temporary );
+		return;
+	}
+
+	msg( E_INFO, E_VERBOSE, "Cached context %zu as \"%s\"", id, entry.c_str() );
+}
+
+} // namespace Processor
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,502 @@
+#include "stdafx.h"
+#include "Interfaces.h"
+#include "MappedFile.h"
+
+// -------------------------------------------------------------------------------------
+// Library		Homework
+// File			Snapshot.cpp
+// Author		Ivan Shapovalov <intelfx100@gmail.com>
+// Description	Machine state snapshots.
+// -------------------------------------------------------------------------------------
+
+namespace Processor
+{
+
+namespace
+{
+
+/*
+ * A snapshot is a header, a record directory and the record payloads, each aligned
+ * to snapshot_alignment. Payloads are raw in-memory images (with dispatch caches of the
+ * commands cleared), so a snapshot is readable only by a build with the same structure
+ * layout; the header records the sizes to check this.
+ * Records of a context buffer are consecutive and come in the order they are restored.
+ */
+
+const uint32_t snapshot_signature = 0x50414E53; // "SNAP"
+const uint32_t snapshot_version = 2;
+const size_t snapshot_alignment = 64;
+
+enum SnapshotRecordType
+{
+	SR_CONTEXT = 0, // the current Context
+	SR_CALL_STACK, // Contexts, bottom first
+	SR_STACK, // cells of the stack selected by "data_type", bottom first
+	SR_CODE,
+	SR_DATA,
+	SR_DATA_RESERVE, // a single fill pattern; "count" is the count of reserved cells
+	SR_BYTEPOOL,
+	SR_SYMBOLS, // for each symbol: the 64-bit hash, the name (empty if stripped), a "defined" byte and (if defined) the Reference
+	SR_REGISTERS
+};
+
+struct SnapshotHeader
+{
+	uint32_t signature;
+	uint32_t version;
+	uint32_t record_count;
+	uint16_t calc_size;
+	uint16_t command_size;
+	uint16_t reference_size;
+	uint16_t context_size;
+	uint32_t reserved;
+} PACKED;
+
+struct SnapshotRecord
+{
+	uint64_t offset; // from the beginning of the file
+	uint64_t size_bytes;
+	uint64_t count;
+	uint64_t buffer; // context buffer ID at the time of the snapshot, 0 for global records
+	uint8_t type;
+	uint8_t data_type;
+	uint8_t reserved[6];
+} PACKED;
+
+struct PendingRecord
+{
+	SnapshotRecord record;
+	llarray payload;
+};
+
+size_t AlignUp( size_t value, size_t align )
+{
+	return ( value + align - 1 ) & ~( align - 1 );
+}
+
+void AddRecord( std::vector<PendingRecord>& records, SnapshotRecordType type, ctx_t buffer,
+                llarray&& payload, size_t count, Value::Type data_type = Value::V_MAX )
+{
+	records.push_back( PendingRecord() );
+	PendingRecord& pending = records.back();
+
+	mem_init( pending.record );
+	pending.record.size_bytes = payload.size();
+	pending.record.count = count;
+	pending.record.buffer = buffer;
+	pending.record.type = type;
+	pending.record.data_type = data_type;
+	pending.payload = std::move( payload );
+}
+
+llarray PackSymbols( const symbol_map& symbols )
+{
+	llarray result;
+
+	for( const symbol_map::value_type& symbol_record: symbols ) {
+		const Symbol& symbol = symbol_record.second.second;
+		char is_resolved = symbol.is_resolved;
+		uint64_t hash = symbol_record.first;
+
+		result.append( sizeof( hash ), &hash );
+		result.append( symbol_record.second.first.size() + 1, symbol_record.second.first.c_str() );
+		result.append( 1, &is_resolved );
+		if( is_resolved ) {
+			result.append( sizeof( Reference ), &symbol.ref );
+		}
+	}
+
+	return result;
+}
+
+symbol_map UnpackSymbols( const char* payload, const SnapshotRecord& record )
+{
+	symbol_map result;
+	result.reserve( record.count );
+
+	const char* ptr = payload, *end = payload + record.size_bytes;
+	for( size_t i = 0; i < record.count; ++i ) {
+		uint64_t hash;
+		s_cverify( static_cast<size_t>( end - ptr ) > sizeof( hash ), "Invalid snapshot: truncated symbol %zu", i );
+		memcpy( &hash, ptr, sizeof( hash ) );
+		ptr += sizeof( hash );
+
+		// Stripped symbols have empty names, thus the hash is not recomputed.
+		const char* name = ptr;
+		const char* name_end = reinterpret_cast<const char*>( memchr( ptr, '\0', end - ptr ) );
+		s_cverify( name_end && name_end + 1 < end, "Invalid snapshot: truncated symbol %zu", i );
+		ptr = name_end + 1;
+
+		Symbol symbol( static_cast<size_t>( hash ) );
+		if( *ptr++ ) {
+			s_cverify( ptr + sizeof( symbol.ref ) <= end, "Invalid snapshot: truncated symbol \"%s\"", name );
+			memcpy( &symbol.ref, ptr, sizeof( symbol.ref ) );
+			ptr += sizeof( symbol.ref );
+			symbol.is_resolved = true;
+		}
+
+		s_cverify( result.insert( symbol.hash, name, name_end - name, symbol ).second,
+		           "Invalid snapshot: duplicate symbol hash %zx", symbol.hash );
+	}
+
+	s_cverify( ptr == end, "Invalid snapshot: symbol records do not fill their payload" );
+	return result;
+}
+
+// Whether the record holds exactly "count" elements of the given size.
+bool HoldsElements( const SnapshotRecord& record, size_t element_size )
+{
+	return record.size_bytes % element_size == 0 && record.size_bytes / element_size == record.count;
+}
+
+// Context has a user-defined assignment, thus it is read field by field.
+void UnpackContext( const char* payload, Context* ctx )
+{
+	memcpy( &ctx->flags, payload + offsetof( Context, flags ), sizeof( ctx->flags ) );
+	memcpy( &ctx->ip, payload + offsetof( Context, ip ), sizeof( ctx->ip ) );
+	memcpy( &ctx->buffer, payload + offsetof( Context, buffer ), sizeof( ctx->buffer ) );
+	memcpy( &ctx->depth, payload + offsetof( Context, depth ), sizeof( ctx->depth ) );
+	memcpy( &ctx->frame, payload + offsetof( Context, frame ), sizeof( ctx->frame ) );
+}
+
+ctx_t RemapBuffer( const std::map<ctx_t, ctx_t>& buffers, ctx_t id )
+{
+	if( !id ) {
+		return 0;
+	}
+
+	auto new_id = buffers.find( id );
+	s_cverify( new_id != buffers.end(), "Invalid snapshot: reference to unsaved context buffer %zu", id );
+	return new_id->second;
+}
+
+} // unnamed namespace
+
+void ProcessorAPI::Snapshot( FILE* file )
+{
+	verify_method;
+
+	IMMU* mmu = MMU();
+	ILogic* logic = LogicProvider();
+
+	cassert( file, "NULL snapshot file" );
+	cassert( !stream_.context, "Cannot take a snapshot while context %zu is being streamed", stream_.context );
+
+	std::vector<PendingRecord> records;
+
+	// Execution state is taken before switching buffers (a switch saves the current context).
+	std::vector<Context> call_stack = logic->QueryContextStack();
+	AddRecord( records, SR_CONTEXT, 0, llarray( &current_execution_context_, sizeof( Context ) ), 1 );
+	AddRecord( records, SR_CALL_STACK, 0, llarray( call_stack.data(), sizeof( Context ) * call_stack.size() ),
+	           call_stack.size() );
+
+	for( unsigned i = 0; i < Value::V_MAX; ++i ) {
+		Value::Type type = static_cast<Value::Type>( i );
+		size_t top = mmu->QueryStackTop( type );
+
+		AddRecord( records, SR_STACK, 0, mmu->DumpSection( MemorySectionIdentifier( SEC_STACK_IMAGE, type ), 0, top ),
+		           top, type );
+	}
+
+	std::vector<ctx_t> buffers = mmu->QueryContextBuffers();
+	for( ctx_t id: buffers ) {
+		logic->SwitchToContextBuffer( id );
+
+		Offsets limits = mmu->QuerySectionLimits();
+		calc_t pattern;
+		size_t reserved = mmu->QueryReservedData( &pattern );
+
+		llarray code = mmu->DumpSection( SEC_CODE_IMAGE, 0, limits.Code() );
+		Command* commands = reinterpret_cast<Command*>( static_cast<char*>( code ) );
+		for( size_t i = 0; i < limits.Code(); ++i ) {
+			commands[i].cached_executor = nullptr;
+			commands[i].cached_handle = nullptr;
+		}
+
+		calc_t registers[R_MAX];
+		for( unsigned i = 0; i < R_MAX; ++i ) {
+			registers[i] = mmu->ARegister( static_cast<Register>( i ) );
+		}
+
+		symbol_map symbols = mmu->DumpSymbolImage();
+
+		AddRecord( records, SR_CODE, id, std::move( code ), limits.Code() );
+		AddRecord( records, SR_DATA, id, mmu->DumpSection( SEC_DATA_IMAGE, 0, limits.Data() - reserved ),
+		           limits.Data() - reserved );
+		AddRecord( records, SR_DATA_RESERVE, id, llarray( &pattern, sizeof( pattern ) ), reserved );
+		AddRecord( records, SR_BYTEPOOL, id, mmu->DumpSection( SEC_BYTEPOOL_IMAGE, 0, limits.Bytepool() ),
+		           limits.Bytepool() );
+		AddRecord( records, SR_SYMBOLS, id, PackSymbols( symbols ), symbols.size() );
+		AddRecord( records, SR_REGISTERS, id, llarray( registers, sizeof( registers ) ), R_MAX );
+
+		logic->RestoreCurrentContext();
+	}
+
+	// Lay out the payloads after the directory.
+	static const char padding[snapshot_alignment] = {};
+
+	SnapshotHeader hdr;
+	mem_init( hdr );
+	hdr.signature = snapshot_signature;
+	hdr.version = snapshot_version;
+	hdr.record_count = records.size();
+	hdr.calc_size = sizeof( calc_t );
+	hdr.command_size = sizeof( Command );
+	hdr.reference_size = sizeof( Reference );
+	hdr.context_size = sizeof( Context );
+
+	size_t offset = AlignUp( sizeof( hdr ) + sizeof( SnapshotRecord ) * records.size(), snapshot_alignment );
+	for( PendingRecord& pending: records ) {
+		pending.record.offset = offset;
+		offset = AlignUp( offset + pending.payload.size(), snapshot_alignment );
+	}
+
+	bool written = fwrite( &hdr, sizeof( hdr ), 1, file ) == 1;
+	for( const PendingRecord& pending: records ) {
+		written = written && fwrite( &pending.record, sizeof( SnapshotRecord ), 1, file ) == 1;
+	}
+
+	size_t position = sizeof( hdr ) + sizeof( SnapshotRecord ) * records.size();
+	for( const PendingRecord& pending: records ) {
+		size_t padding_bytes = pending.record.offset - position;
+		written = written && fwrite( padding, 1, padding_bytes, file ) == padding_bytes;
+		written = written && fwrite( pending.payload, 1, pending.payload.size(), file ) == pending.payload.size();
+		position = pending.record.offset + pending.payload.size();
+	}
+
+	cverify( written && !fflush( file ), "Failed to write the snapshot: %s", strerror( errno ) );
+	msg( E_INFO, E_VERBOSE, "Snapshot written: %zu context buffers, %zu bytes", buffers.size(), position );
+}
+
+ctx_t ProcessorAPI::Restore( FILE* file )
+{
+	verify_method;
+
+	IMMU* mmu = MMU();
+	ILogic* logic = LogicProvider();
+
+	cassert( file, "NULL snapshot file" );
+
+	// Map the file to use the images in place; otherwise read it whole.
+	std::shared_ptr<void> backing;
+	const char* base;
+	size_t size;
+
+	rewind( file );
+	mapped_file_t mapping( new MappedFile( file ) );
+	if( mapping->IsMapped() ) {
+		base = mapping->Data();
+		size = mapping->Size();
+		backing = mapping;
+	} else {
+		std::shared_ptr<std::vector<char> > contents( new std::vector<char> );
+		char chunk[STATIC_LENGTH];
+		size_t count;
+
+		while( ( count = fread( chunk, 1, sizeof( chunk ), file ) ) ) {
+			contents->insert( contents->end(), chunk, chunk + count );
+		}
+		cverify( !ferror( file ), "Failed to read the snapshot: %s", strerror( errno ) );
+
+		base = contents->data();
+		size = contents->size();
+		backing = contents;
+	}
+
+	SnapshotHeader hdr;
+	cverify( size >= sizeof( hdr ), "Invalid snapshot: file is too short (%zu bytes)", size );
+	memcpy( &hdr, base, sizeof( hdr ) );
+
+	cverify( hdr.signature == snapshot_signature, "Invalid snapshot signature: %08x", hdr.signature );
+	cverify( hdr.version == snapshot_version, "Unsupported snapshot version: %u", hdr.version );
+	cverify( hdr.calc_size == sizeof( calc_t ) && hdr.command_size == sizeof( Command ) &&
+	         hdr.reference_size == sizeof( Reference ) && hdr.context_size == sizeof( Context ),
+	         "Snapshot was taken by an incompatible build" );
+	cverify( sizeof( hdr ) + sizeof( SnapshotRecord ) * hdr.record_count <= size,
+	         "Invalid snapshot: truncated directory (%u records)", hdr.record_count );
+
+	std::vector<SnapshotRecord> records( hdr.record_count );
+	if( !records.empty() ) {
+		memcpy( records.data(), base + sizeof( hdr ), sizeof( SnapshotRecord ) * records.size() );
+	}
+
+	for( const SnapshotRecord& record: records ) {
+		cverify( record.offset % snapshot_alignment == 0 && record.offset <= size && record.size_bytes <= size - record.offset,
+		         "Invalid snapshot: record of type %hhu is out of the file", record.type );
+	}
+
+	// Validate every record and decode what is not used in place before dropping the current state,
+	// so that a broken snapshot leaves the machine as it was.
+	Context current = {};
+	std::vector<Context> call_stack;
+	std::vector<symbol_map> symbols; // of the SR_SYMBOLS records, in order
+	std::map<ctx_t, mask_t> buffer_records; // snapshot ID -> types of its records
+	mask_t global_records = 0, stacks = 0;
+	ctx_t last_buffer = 0;
+
+	for( const SnapshotRecord& record: records ) {
+		const char* payload = base + record.offset;
+
+		// Records of a buffer are restored into it as they come, so they shall be consecutive and unique.
+		mask_t* seen = &global_records;
+		if( record.buffer ) {
+			cverify( record.buffer == last_buffer || !buffer_records.count( record.buffer ),
+			         "Invalid snapshot: records of context buffer %zu are not consecutive", static_cast<size_t>( record.buffer ) );
+			last_buffer = record.buffer;
+			seen = &buffer_records[record.buffer];
+		}
+
+		cverify( record.type == SR_STACK || !( *seen & MASK( record.type ) ),
+		         "Invalid snapshot: duplicate record of type %hhu", record.type );
+		*seen |= MASK( record.type );
+
+		switch( record.type ) {
+		case SR_CONTEXT:
+			cverify( record.size_bytes == sizeof( Context ), "Invalid snapshot: context record size" );
+			UnpackContext( payload, &current );
+			break;
+
+		case SR_CALL_STACK:
+			cverify( HoldsElements( record, sizeof( Context ) ), "Invalid snapshot: call stack record size" );
+			call_stack.resize( record.count );
+			for( size_t i = 0; i < record.count; ++i ) {
+				UnpackContext( payload + sizeof( Context ) * i, &call_stack[i] );
+			}
+			break;
+
+		case SR_STACK:
+			cverify( !record.buffer && record.data_type < Value::V_MAX && !( stacks & MASK( record.data_type ) ) &&
+			         HoldsElements( record, sizeof( calc_t ) ),
+			         "Invalid snapshot: stack record" );
+			stacks |= MASK( record.data_type );
+			break;
+
+		case SR_CODE:
+		case SR_DATA:
+		case SR_BYTEPOOL: {
+			MemorySectionType section = ( record.type == SR_CODE ) ? SEC_CODE_IMAGE :
+			                            ( record.type == SR_DATA ) ? SEC_DATA_IMAGE : SEC_BYTEPOOL_IMAGE;
+			size_t element_size = ( record.type == SR_CODE ) ? sizeof( Command ) :
+			                      ( record.type == SR_DATA ) ? sizeof( calc_t ) : 1;
+
+			// A reservation is appended to the data, so it cannot come first.
+			cverify( record.buffer && HoldsElements( record, element_size ) &&
+			         ( record.type != SR_DATA || !( *seen & MASK( SR_DATA_RESERVE ) ) ),
+			         "Invalid snapshot: %s record", ProcDebug::Print( section ).c_str() );
+			break;
+		}
+
+		case SR_DATA_RESERVE:
+			cverify( record.buffer && record.size_bytes == sizeof( calc_t ), "Invalid snapshot: data reservation record" );
+			break;
+
+		case SR_SYMBOLS:
+			cverify( record.buffer, "Invalid snapshot: global symbol record" );
+			symbols.push_back( UnpackSymbols( payload, record ) );
+			break;
+
+		case SR_REGISTERS:
+			cverify( record.buffer && record.count == R_MAX && record.size_bytes == sizeof( calc_t ) * R_MAX,
+			         "Invalid snapshot: register record" );
+			break;
+
+		default:
+			cverify( false, "Invalid snapshot: unknown record type %hhu", record.type );
+			break;
+		}
+	}
+
+	for( const Context& ctx: call_stack ) {
+		cverify( !ctx.buffer || buffer_records.count( ctx.buffer ),
+		         "Invalid snapshot: reference to unsaved context buffer %zu", ctx.buffer );
+	}
+	cverify( !current.buffer || buffer_records.count( current.buffer ),
+	         "Invalid snapshot: reference to unsaved context buffer %zu", current.buffer );
+
+	// Drop the current state.
+	if( stream_.context ) {
+		msg( E_WARNING, E_VERBOSE, "Abandoning the stream of context %zu", stream_.context );
+		Reader()->RdReset();
+		stream_.context = 0;
+	}
+
+	logic->ClearContextStack();
+	logic->ResetCurrentContextState();
+	mmu->ResetEverything();
+	modules_.clear(); // context IDs are reassigned
+
+	std::map<ctx_t, ctx_t> buffers; // snapshot ID -> new ID
+	std::vector<symbol_map>::iterator next_symbols = symbols.begin();
+
+	for( const SnapshotRecord& record: records ) {
+		char* payload = const_cast<char*>( base ) + record.offset;
+
+		if( record.buffer && !buffers.count( record.buffer ) ) {
+			ctx_t id = mmu->AllocateContextBuffer();
+			buffers.insert( std::make_pair( record.buffer, id ) );
+			mmu->SelectContextBuffer( id );
+			msg( E_INFO, E_DEBUG, "Restoring context buffer %zu -> %zu", static_cast<size_t>( record.buffer ), id );
+		}
+
+		switch( record.type ) {
+		case SR_STACK: {
+			Value::Type type = static_cast<Value::Type>( record.data_type );
+			const calc_t* cells = reinterpret_cast<const calc_t*>( payload );
+			mmu->SetStackTop( type, record.count );
+			for( size_t i = 0; i < record.count; ++i ) {
+				mmu->AStackTop( type, record.count - 1 - i ) = cells[i];
+			}
+			break;
+		}
+
+		case SR_CODE:
+		case SR_DATA:
+		case SR_BYTEPOOL: {
+			MemorySectionType section = ( record.type == SR_CODE ) ? SEC_CODE_IMAGE :
+			                            ( record.type == SR_DATA ) ? SEC_DATA_IMAGE : SEC_BYTEPOOL_IMAGE;
+			if( record.count ) {
+				mmu->AdoptSection( section, payload, record.count, backing );
+			}
+			break;
+		}
+
+		case SR_DATA_RESERVE:
+			if( record.count ) {
+				mmu->AppendSection( SEC_DATA_RESERVE, payload, record.count );
+			}
+			break;
+
+		case SR_SYMBOLS:
+			mmu->SetSymbolImage( std::move( *next_symbols++ ) );
+			break;
+
+		case SR_REGISTERS: {
+			const calc_t* registers = reinterpret_cast<const calc_t*>( payload );
+			for( unsigned i = 0; i < R_MAX; ++i ) {
+				mmu->ARegister( static_cast<Register>( i ) ) = registers[i];
+			}
+			break;
+		}
+
+		default: // decoded above
+			break;
+		}
+	}
+
+	// Execution state refers to the context buffers by their old IDs.
+	for( Context& ctx: call_stack ) {
+		ctx.buffer = RemapBuffer( buffers, ctx.buffer );
+	}
+	current.buffer = RemapBuffer( buffers, current.buffer );
+
+	logic->SetContextStack( call_stack );
+	mmu->SelectContextBuffer( current.buffer );
+	current_execution_context_ = current;
+
+	msg( E_INFO, E_VERBOSE, "Snapshot restored: %zu context buffers, current %zu (ip %zu)",
+	     buffers.size(), current.buffer, current.ip );
+	return current.buffer;
+}
+
+} // namespace Processor
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,254 @@
+#ifndef INTERPRETER_SYMBOLTABLE_H
+#define INTERPRETER_SYMBOLTABLE_H
+
+#include "build.h"
+
+#include "Arena.h"
+
+// -------------------------------------------------------------------------------------
+// Library		Homework
+// File			SymbolTable.h
+// Author		Ivan Shapovalov <intelfx100@gmail.com>
+// Description	Hash-indexed symbol table with interned names.
+// -------------------------------------------------------------------------------------
+
+namespace Processor
+{
+
+/*
+ * Symbol name interned in a SymbolTable.
+ * Valid as long as the table which owns it (its copies own their own names).
+ */
+class SymbolName
+{
+	const char* data_;
+	size_t size_;
+
+public:
+	SymbolName() :
+		data_( "" ),
+		size_( 0 )
+	{
+	}
+
+	SymbolName( const char* data, size_t size ) :
+		data_( data ),
+		size_( size )
+	{
+	}
+
+	const char* c_str() const { return data_; }
+	size_t size() const { return size_; }
+	bool empty() const { return !size_; }
+};
+
+/*
+ * Map from symbol hash to a name and a value, keyed by the precomputed hash
+ * (no hash function is applied, thus distinct names with equal hashes are the same symbol).
+ *
+ * Records are stored densely in insertion order and iterated in that order;
+ * an open-addressing index (linear probing, at most half full) points into them.
+ * Names are copied once into an arena owned by the table.
+ * Records cannot be erased. Insertion invalidates iterators and references.
+ */
+template <typename T>
+class SymbolTable
+{
+public:
+	typedef std::pair<SymbolName, T> mapped_type;
+
+	struct value_type
+	{
+		size_t first; // symbol hash
+		mapped_type second;
+	};
+
+	typedef value_type* iterator;
+	typedef const value_type* const_iterator;
+
+private:
+	static const size_t min_index_size = 16;
+	static const size_t no_record = static_cast<size_t>( -1 );
+
+	std::vector<value_type> records_;
+	std::vector<size_t> index_; // record numbers; size is zero or a power of two
+	std::unique_ptr<Arena> names_;
+
+	static size_t Mix( size_t hash )
+	{
+		hash *= static_cast<size_t>( 0x9E3779B97F4A7C15ULL );
+		return hash ^ ( hash >> ( sizeof( size_t ) * 4 ) );
+	}
+
+	// Slot containing the hash or the empty slot where it would be placed.
+	size_t FindSlot( size_t hash ) const
+	{
+		size_t mask = index_.size() - 1;
+		size_t slot = Mix( hash ) & mask;
+
+		while( index_[slot] != no_record && records_[index_[slot]].first != hash ) {
+			slot = ( slot + 1 ) & mask;
+		}
+
+		return slot;
+	}
+
+	void Rehash( size_t index_size )
+	{
+		index_.assign( index_size, no_record );
+
+		for( size_t i = 0; i < records_.size(); ++i ) {
+			index_[FindSlot( records_[i].first )] = i;
+		}
+	}
+
+	SymbolName Intern( const char* name, size_t length )
+	{
+		if( !length ) {
+			return SymbolName(); // stripped
+		}
+
+		if( !names_ ) {
+			names_.reset( new Arena );
+		}
+
+		char* copy = reinterpret_cast<char*>( names_->Allocate( length + 1 ) );
+		memcpy( copy, name, length );
+		copy[length] = '\0';
+		return SymbolName( copy, length );
+	}
+
+	void InternAll()
+	{
+		names_.reset();
+
+		for( value_type& record: records_ ) {
+			record.second.first = Intern( record.second.first.c_str(), record.second.first.size() );
+		}
+	}
+
+public:
+	SymbolTable()
+	{
+	}
+
+	SymbolTable( const SymbolTable& rhs ) :
+		records_( rhs.records_ ),
+		index_( rhs.index_ )
+	{
+		InternAll();
+	}
+
+	SymbolTable( SymbolTable&& rhs ) = default;
+
+	SymbolTable& operator=( const SymbolTable& rhs )
+	{
+		if( this != &rhs ) {
+			records_ = rhs.records_;
+			index_ = rhs.index_;
+			InternAll();
+		}
+
+		return *this;
+	}
+
+	SymbolTable& operator=( SymbolTable&& rhs ) = default;
+
+	size_t size() const { return records_.size(); }
+	bool empty() const { return records_.empty(); }
+
+	iterator begin() { return records_.data(); }
+	iterator end() { return records_.data() + records_.size(); }
+	const_iterator begin() const { return records_.data(); }
+	const_iterator end() const { return records_.data() + records_.size(); }
+
+	void swap( SymbolTable& rhs )
+	{
+		records_.swap( rhs.records_ );
+		index_.swap( rhs.index_ );
+		names_.swap( rhs.names_ );
+	}
+
+	void clear()
+	{
+		records_.clear();
+		std::fill( index_.begin(), index_.end(), no_record );
+
+		if( names_ ) {
+			names_->Rewind();
+		}
+	}
+
+	// Make room for the given total count of records, so that a batch of insertions
+	// does not rehash more than once. Storage grows geometrically, thus reserving
+	// before each of many small batches stays amortized linear.
+	void reserve( size_t count )
+	{
+		if( count > records_.capacity() ) {
+			records_.reserve( std::max( count, 2 * records_.capacity() ) );
+		}
+
+		size_t index_size = index_.empty() ? min_index_size : index_.size();
+		while( index_size < 2 * count ) {
+			index_size *= 2;
+		}
+
+		if( index_size != index_.size() ) {
+			Rehash( index_size );
+		}
+	}
+
+	iterator find( size_t hash )
+	{
+		if( index_.empty() ) {
+			return end();
+		}
+
+		size_t record = index_[FindSlot( hash )];
+		return ( record == no_record ) ? end() : begin() + record;
+	}
+
+	const_iterator find( size_t hash ) const
+	{
+		return const_cast<SymbolTable*>( this )->find( hash );
+	}
+
+	// Insert unless the hash is already present; the name is copied only if inserted.
+	std::pair<iterator, bool> insert( size_t hash, const char* name, size_t length, const T& value )
+	{
+		if( index_.size() < 2 * ( records_.size() + 1 ) ) {
+			reserve( std::max( records_.size() + 1, 2 * records_.size() ) );
+		}
+
+		size_t slot = FindSlot( hash );
+		if( index_[slot] != no_record ) {
+			return std::make_pair( begin() + index_[slot], false );
+		}
+
+		value_type record = { hash, mapped_type( Intern( name, length ), value ) };
+		index_[slot] = records_.size();
+		records_.push_back( record );
+		return std::make_pair( end() - 1, true );
+	}
+
+	std::pair<iterator, bool> insert( const value_type& record )
+	{
+		return insert( record.first, record.second.first.c_str(), record.second.first.size(), record.second.second );
+	}
+
+	// Approximate heap usage.
+	size_t MemoryUsage() const
+	{
+		return records_.capacity() * sizeof( value_type ) +
+		       index_.capacity() * sizeof( size_t ) +
+		       ( names_ ? names_->Capacity() : 0 );
+	}
+};
+
+template <typename T> const size_t SymbolTable<T>::min_index_size;
+template <typename T> const size_t SymbolTable<T>::no_record;
+
+} // namespace Processor
+
+#endif // INTERPRETER_SYMBOLTABLE_H
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -4,6 +4,7 @@
 #include "build.h"
 
 #include "Value.h"
+#include "SymbolTable.h"
 
 // -------------------------------------------------------------------------------------
 // Library		Homework
@@ -101,6 +102,9 @@ public:
 	Offsets( const Offsets& rhs ) : Offsets( rhs.offsets_ )
 	{}
 
+	Offsets& operator=( const Offsets& rhs )
+	{ memcpy( offsets_, rhs.offsets_, sizeof( *offsets_ ) * SEC_COUNT ); return *this; }
+
 	size_t& at( const MemorySectionIdentifier& index )
 	{ return offsets_[index.Index()]; }
 	size_t  at( const MemorySectionIdentifier& index ) const
@@ -123,6 +127,61 @@ public:
 	const size_t* Raw() { return offsets_; }
 };
 
+struct MemoryCounter
+{
+	size_t live; // bytes currently allocated
+	size_t peak; // high-water mark of "live"
+
+	MemoryCounter() :
+		live( 0 ), peak( 0 ) {}
+
+	void Update( size_t bytes )
+	{
+		live = bytes;
+		if( live > peak ) {
+			peak = live;
+		}
+	}
+};
+
+struct MemoryUsage
+{
+	MemoryCounter sections[SEC_COUNT]; // stack sections are shared between contexts
+	MemoryCounter arena; // overall storage reserved by the context's arena
+	MemoryCounter native_images; // JIT-compiled images of all contexts
+
+	MemoryCounter& at( const MemorySectionIdentifier& index )       { return sections[index.Index()]; }
+	MemoryCounter  at( const MemorySectionIdentifier& index ) const { return sections[index.Index()]; }
+};
+
+/*
+ * A host-owned array mapped over a range of the DATA section or the bytepool.
+ * DATA windows consist of int_t or fp_t elements (selected by "type"),
+ * bytepool windows are plain bytes (type is V_MAX).
+ */
+struct HostBuffer
+{
+	size_t address; // first mapped cell (byte for the bytepool)
+	size_t count;
+	void* buffer;
+	Value::Type type;
+
+	bool Contains( size_t addr ) const { return addr - address < count; }
+};
+
+/*
+ * Stored section image which is read on demand, in byte ranges of the image
+ * (see IReader::DeferSectionImage() and IMMU::DeferSection()).
+ */
+class SectionSource
+{
+public:
+	virtual ~SectionSource() {}
+	virtual void Read( size_t offset, size_t bytes, void* dest ) = 0;
+};
+
+typedef std::shared_ptr<SectionSource> section_source_t;
+
 /*
  * Possible reference types:
  * - symbol				"variable"
@@ -203,15 +262,18 @@ struct Symbol
 	Symbol( const char* name, const Reference& resolved_reference ) :
 		hash( crc32_runtime( name ) ), ref( resolved_reference ), is_resolved( 1 ) {}
 
+	// For stripped symbol tables, where names may be missing.
+	explicit Symbol( size_t symbol_hash ) :
+		hash( symbol_hash ), ref(), is_resolved( 0 ) {}
+
 
 	bool operator== ( const Symbol& that ) const { return hash == that.hash; }
 	bool operator!= ( const Symbol& that ) const { return hash != that.hash; }
 };
 
-// This is something like TR1's std::unordered_map with manual hashing,
-// since we need to have direct access to hashes themselves.
-typedef std::map<size_t, std::pair<std::string, Symbol> > symbol_map;
-typedef symbol_map::value_type::second_type symbol_type;
+// Keyed by the symbol hash, since we need to have direct access to hashes themselves.
+typedef SymbolTable<Symbol> symbol_map;
+typedef symbol_map::mapped_type symbol_type;
 
 
 struct Command
@@ -244,6 +306,26 @@ struct Command
 		arg( {} ), id( 0 ), type( Value::V_MAX ), cached_executor( nullptr ), cached_handle( nullptr ) {}
 };
 
+/*
+ * A loaded program, frozen to be shared read-only between any number of instances
+ * (possibly in different ProcessorAPI objects and threads).
+ * Dispatch caches of the commands are cleared: they are specific to a ProcessorAPI.
+ */
+struct ProgramImage
+{
+	std::vector<Command> commands;
+	std::vector<calc_t> data; // initial data, copied into each instance
+	size_t data_reserved;
+	calc_t data_reserve_pattern;
+	std::vector<char> bytepool; // initial bytepool, copied into each instance
+	symbol_map symbols;
+
+	ProgramImage() :
+		data_reserved( 0 ), data_reserve_pattern() {}
+};
+
+typedef std::shared_ptr<const ProgramImage> program_image_t;
+
 namespace ProcDebug
 {
 
@@ -300,14 +382,24 @@ struct DecodeResult
 	std::vector<calc_t> data;
 	std::vector<char> bytepool;
 
+	// Reserved DATA cells to be appended after "data", each initialised to the pattern.
+	size_t data_reserved;
+	calc_t data_reserve_pattern;
+
 	symbol_map mentioned_symbols;
 
+	DecodeResult() :
+		data_reserved( 0 ) {}
+
 	void Clear()
 	{
 		commands.clear();
 		data.clear();
 		bytepool.clear();
 
+		data_reserved = 0;
+		data_reserve_pattern = calc_t();
+
 		mentioned_symbols.clear();
 	}
 };
@@ -316,7 +408,7 @@ calc_t ExecuteGate( abi_native_fn_t jit_compiled_function );
 
 inline void InsertSymbol( const Symbol& symbol, const char* name, symbol_map& target_map )
 {
-	target_map.insert( std::make_pair( symbol.hash, std::make_pair( std::string( name ), symbol ) ) );
+	target_map.insert( symbol.hash, name, strlen( name ), symbol );
 }
 
 } // namespace Processor
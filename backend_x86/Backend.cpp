@@ -21,6 +21,47 @@ namespace ProcessorImplementation
 using namespace Processor;
 using namespace x86backend;
 
+namespace
+{
+
+/*
+ * Exported image: a header followed by the native code (with stale addresses at relocation sites),
+ * the instruction offsets, the code reference patches and the relocations.
+ */
+const uint32_t exported_image_signature = 0x4E363878; // "x86N"
+const uint32_t exported_image_version = 1;
+
+struct ExportedImageHeader
+{
+	uint32_t signature;
+	uint32_t version;
+	uint64_t command_count;
+	uint64_t code_bytes;
+	uint64_t insn_offset_count;
+	uint64_t reference_count;
+	uint64_t relocation_count;
+} PACKED;
+
+struct ExportedReference
+{
+	uint64_t where;
+	uint64_t next_insn;
+	uint64_t what;
+	uint8_t type;
+	uint8_t reserved[7];
+} PACKED;
+
+struct ExportedRelocation
+{
+	uint64_t where;
+	uint64_t argument;
+	uint64_t addend;
+	uint8_t type;
+	uint8_t reserved[7];
+} PACKED;
+
+} // unnamed namespace
+
 bool x86Backend::ImageIsOK( size_t chk )
 {
 	msg( E_INFO, E_DEBUG, "Verifying image for checksum %zx", chk );
@@ -81,6 +122,185 @@ void x86Backend::Deallocate()
 		proc_->ExecutionManager().DeallocateMemory( current_image_->mm.image, current_image_->mm.length );
 		current_image_->mm.image = nullptr;
 	}
+
+	UpdateImageUsage();
+}
+
+void x86Backend::UpdateImageUsage()
+{
+	size_t bytes = 0;
+	for( const std::pair<const size_t, NativeImage>& image: images_ ) {
+		bytes += image.second.data.size();
+		bytes += image.second.insn_offsets.capacity() * sizeof( off_t );
+		bytes += image.second.references.capacity() * sizeof( ReferencePatch );
+		bytes += image.second.relocations.capacity() * sizeof( Relocation );
+		if( image.second.mm.image ) {
+			bytes += image.second.mm.length;
+		}
+	}
+	image_usage_.Update( bytes );
+}
+
+MemoryCounter x86Backend::QueryImageMemory() const
+{
+	return image_usage_;
+}
+
+llarray x86Backend::ExportImage( size_t chk )
+{
+	cassert( ImageIsOK( chk ), "Image for checksum %zx is not good/ready", chk );
+	const NativeImage& image = images_.find( chk )->second;
+
+	ExportedImageHeader hdr;
+	mem_init( hdr );
+	hdr.signature = exported_image_signature;
+	hdr.version = exported_image_version;
+	hdr.command_count = image.insn_offsets.size() - 1; // the last entry is the end of code
+	hdr.code_bytes = image.data.size();
+	hdr.insn_offset_count = image.insn_offsets.size();
+	hdr.reference_count = image.references.size();
+	hdr.relocation_count = image.relocations.size();
+
+	llarray result;
+	result.append( sizeof( hdr ), &hdr );
+	result.append( image.data );
+
+	for( off_t offset: image.insn_offsets ) {
+		uint64_t record = offset;
+		result.append( sizeof( record ), &record );
+	}
+
+	for( const ReferencePatch& reference: image.references ) {
+		ExportedReference record;
+		mem_init( record );
+		record.where = reference.where;
+		record.next_insn = reference.next_insn;
+		record.what = reference.what;
+		record.type = reference.type;
+		result.append( sizeof( record ), &record );
+	}
+
+	for( const Relocation& relocation: image.relocations ) {
+		ExportedRelocation record;
+		mem_init( record );
+		record.where = relocation.where;
+		record.argument = relocation.argument;
+		record.addend = relocation.addend;
+		record.type = relocation.type;
+		result.append( sizeof( record ), &record );
+	}
+
+	msg( E_INFO, E_VERBOSE, "Exported image for checksum %zx: %zu bytes of code, %zu relocations",
+	     chk, image.data.size(), image.relocations.size() );
+	return result;
+}
+
+bool x86Backend::ImportImage( size_t chk, const void* image, size_t size )
+{
+	ExportedImageHeader hdr;
+	if( size < sizeof( hdr ) ) {
+		msg( E_WARNING, E_VERBOSE, "Not importing the native image: truncated header" );
+		return false;
+	}
+
+	const char* ptr = reinterpret_cast<const char*>( image );
+	memcpy( &hdr, ptr, sizeof( hdr ) );
+
+	if( hdr.signature != exported_image_signature || hdr.version != exported_image_version ) {
+		msg( E_WARNING, E_VERBOSE, "Not importing the native image: not an x86 image of version %u", exported_image_version );
+		return false;
+	}
+
+	size_t command_count = proc_->MMU()->QuerySectionLimits().Code();
+	if( hdr.command_count != command_count || hdr.insn_offset_count != command_count + 1 ) {
+		msg( E_WARNING, E_VERBOSE, "Not importing the native image: compiled for %llu commands, context has %zu",
+		     static_cast<unsigned long long>( hdr.command_count ), command_count );
+		return false;
+	}
+
+	// The counts come from the image: check each against what is left, so that nothing overflows.
+	size_t remaining = size - sizeof( hdr );
+	cverify( hdr.code_bytes <= remaining, "Invalid native image size: %zu bytes", size );
+	remaining -= hdr.code_bytes;
+	cverify( hdr.insn_offset_count <= remaining / sizeof( uint64_t ), "Invalid native image size: %zu bytes", size );
+	remaining -= sizeof( uint64_t ) * hdr.insn_offset_count;
+	cverify( hdr.reference_count <= remaining / sizeof( ExportedReference ), "Invalid native image size: %zu bytes", size );
+	remaining -= sizeof( ExportedReference ) * hdr.reference_count;
+	cverify( hdr.relocation_count == remaining / sizeof( ExportedRelocation ) && !( remaining % sizeof( ExportedRelocation ) ),
+	         "Invalid native image size: %zu bytes", size );
+	ptr += sizeof( hdr );
+
+	Select( chk, true );
+	Clear();
+
+	NativeImage& native = *current_image_;
+	native.data = llarray( ptr, hdr.code_bytes );
+	ptr += hdr.code_bytes;
+
+	native.insn_offsets.resize( hdr.insn_offset_count );
+	for( off_t& offset: native.insn_offsets ) {
+		uint64_t record;
+		memcpy( &record, ptr, sizeof( record ) );
+		ptr += sizeof( record );
+
+		cverify( record <= hdr.code_bytes, "Invalid native image: instruction offset %llu out of code",
+		         static_cast<unsigned long long>( record ) );
+		offset = record;
+	}
+
+	native.references.resize( hdr.reference_count );
+	for( ReferencePatch& reference: native.references ) {
+		ExportedReference record;
+		memcpy( &record, ptr, sizeof( record ) );
+		ptr += sizeof( record );
+
+		cverify( hdr.code_bytes >= sizeof( uint64_t ) && record.where <= hdr.code_bytes - sizeof( uint64_t ) &&
+		         record.type <= ReferencePatch::RT_TO_INSTRUCTIONPOINTER &&
+		         record.what < hdr.insn_offset_count && record.next_insn < hdr.insn_offset_count,
+		         "Invalid native image: bad code reference" );
+		reference.where = record.where;
+		reference.next_insn = record.next_insn;
+		reference.what = record.what;
+		reference.type = static_cast<ReferencePatch::ReferenceType>( record.type );
+	}
+
+	native.relocations.resize( hdr.relocation_count );
+	for( Relocation& relocation: native.relocations ) {
+		ExportedRelocation record;
+		memcpy( &record, ptr, sizeof( record ) );
+		ptr += sizeof( record );
+
+		cverify( hdr.code_bytes >= sizeof( uint64_t ) && record.where <= hdr.code_bytes - sizeof( uint64_t ) &&
+		         record.type <= Relocation::RL_GATE,
+		         "Invalid native image: bad relocation" );
+		relocation.where = record.where;
+		relocation.argument = record.argument;
+		relocation.addend = record.addend;
+		relocation.type = static_cast<Relocation::RelocationType>( record.type );
+	}
+
+	native.prebuilt = true;
+	UpdateImageUsage();
+
+	msg( E_INFO, E_VERBOSE, "Imported image for checksum %zx: %llu bytes of code, %llu relocations",
+	     chk, static_cast<unsigned long long>( hdr.code_bytes ), static_cast<unsigned long long>( hdr.relocation_count ) );
+	return true;
+}
+
+void x86Backend::ReleaseImage( size_t chk )
+{
+	if( images_.find( chk ) == images_.end() ) {
+		return;
+	}
+
+	msg( E_INFO, E_DEBUG, "Releasing image for checksum %zx", chk );
+
+	Select( chk );
+	Deallocate();
+	images_.erase( chk );
+	current_image_ = nullptr;
+
+	UpdateImageUsage();
 }
 
 void x86Backend::Finalize()
@@ -114,8 +334,14 @@ void x86Backend::Finalize()
 		}
 	}
 
+	// Patch in the addresses
+	for( const Relocation& relocation: current_image_->relocations ) {
+		*reinterpret_cast<void**>( img + relocation.where ) = RelocationTarget( relocation );
+	}
+
 	current_image_->mm.image = img;
 	current_image_->mm.length = current_image_->data.size();
+	UpdateImageUsage();
 
 	cassert( ImageIsOK( current_chk_ ), "Newly finalized image is not OK - inconsistency" );
 }
@@ -126,6 +352,53 @@ void x86Backend::Clear()
 
 	Deallocate();
 	current_image_->data.clear();
+	current_image_->insn_offsets.clear();
+	current_image_->references.clear();
+	current_image_->relocations.clear();
+	current_image_->prebuilt = false;
+}
+
+void x86Backend::AddRelocation( Relocation::RelocationType type, size_t argument, size_t addend )
+{
+	Relocation relocation;
+	relocation.type = type;
+	relocation.where = Target().size() - sizeof( uint64_t );
+	relocation.argument = argument;
+	relocation.addend = addend;
+	current_image_->relocations.push_back( relocation );
+}
+
+void* x86Backend::RelocationTarget( const Relocation& relocation )
+{
+	IMMU* mmu = proc_->MMU();
+
+	switch( relocation.type ) {
+	case Relocation::RL_DATA:
+		return mmu->ADataPayload( relocation.argument );
+
+	case Relocation::RL_REGISTER:
+		cassert( relocation.argument < R_MAX, "Invalid register in relocation: %zu", relocation.argument );
+		return &mmu->ARegister( static_cast<Register>( relocation.argument ) ).integer;
+
+	case Relocation::RL_BYTEPOOL:
+		return mmu->ABytepool( relocation.argument );
+
+	case Relocation::RL_COMMAND:
+		cassert( relocation.addend < sizeof( Command ), "Invalid offset into command in relocation: %zu", relocation.addend );
+		return reinterpret_cast<char*>( &mmu->ACommand( relocation.argument ) ) + relocation.addend;
+
+	case Relocation::RL_BACKEND:
+		return this;
+
+	case Relocation::RL_IMAGE:
+		return current_image_;
+
+	case Relocation::RL_GATE:
+		return reinterpret_cast<void*>( &BinaryGateFunction );
+
+	default:
+		casshole( "Invalid relocation type: %u", relocation.type );
+	}
 }
 
 llarray& x86Backend::Target()
@@ -138,6 +411,7 @@ llarray& x86Backend::Target()
 ModRMWrapper x86Backend::CompileReferenceResolution( const DirectReference& dref )
 {
 	void* data_ptr = nullptr;
+	Relocation::RelocationType relocation_type;
 
 	switch( dref.section ) {
 	default:
@@ -150,15 +424,18 @@ ModRMWrapper x86Backend::CompileReferenceResolution( const DirectReference& dref
 		return ModRMWrapper( IndirectNoShift::Displacement32 ).SetDisplacementToInsn( dref.address );
 
 	case S_DATA:
-		data_ptr = &proc_->MMU()->AData( dref.address ).integer;
+		data_ptr = proc_->MMU()->ADataPayload( dref.address );
+		relocation_type = Relocation::RL_DATA;
 		break;
 
 	case S_REGISTER:
 		data_ptr = &proc_->MMU()->ARegister( static_cast<Register>( dref.address ) ).integer;
+		relocation_type = Relocation::RL_REGISTER;
 		break;
 
 	case S_BYTEPOOL:
 		data_ptr = proc_->MMU()->ABytepool( dref.address );
+		relocation_type = Relocation::RL_BYTEPOOL;
 		break;
 
 	case S_FRAME:
@@ -175,6 +452,7 @@ ModRMWrapper x86Backend::CompileReferenceResolution( const DirectReference& dref
 		.AddOpcodeRegister( Reg64::RCX )
 		.AddImmediate( data_ptr )
 		.Emit( this );
+	AddRelocation( relocation_type, dref.address );
 	return ModRMWrapper( IndirectNoShift::RCX );
 }
 
@@ -198,7 +476,7 @@ abiret_t x86Backend::RuntimeReferenceResolution( NativeImage* image, const Direc
 		break;
 
 	case S_DATA:
-		result.address = &proc_->MMU()->AData( dref.address ).integer;
+		result.address = proc_->MMU()->ADataPayload( dref.address );
 		break;
 
 	case S_REGISTER:
@@ -312,6 +590,7 @@ void x86Backend::CompileBinaryGateCall( x86Backend::BinaryFunction function, abi
 		.AddOpcodeRegister( Reg64::RDI )
 		.AddImmediate( this )
 		.Emit( this );
+	AddRelocation( Relocation::RL_BACKEND );
 
 	// mov rsi, {image}
 	Insn()
@@ -319,6 +598,7 @@ void x86Backend::CompileBinaryGateCall( x86Backend::BinaryFunction function, abi
 		.AddOpcodeRegister( Reg64::RSI )
 		.AddImmediate( current_image_ )
 		.Emit( this );
+	AddRelocation( Relocation::RL_IMAGE );
 
 	// mov rdx, {function}
 	Insn()
@@ -334,12 +614,22 @@ void x86Backend::CompileBinaryGateCall( x86Backend::BinaryFunction function, abi
 		.AddImmediate( argument )
 		.Emit( this );
 
+	// The argument points into the command being compiled.
+	cassert( !current_image_->insn_offsets.empty(), "Gate call outside of a command" );
+	size_t insn = current_image_->insn_offsets.size() - 1;
+	ptrdiff_t offset_into_command = reinterpret_cast<const char*>( argument ) -
+	                                reinterpret_cast<const char*>( &proc_->MMU()->ACommand( insn ) );
+	cassert( offset_into_command >= 0 && static_cast<size_t>( offset_into_command ) < sizeof( Command ),
+	         "Gate call argument is not within the compiled command %zu", insn );
+	AddRelocation( Relocation::RL_COMMAND, insn, offset_into_command );
+
 	// mov rax, {address}
 	Insn()
 		.AddOpcode( 0xB8 )
 		.AddOpcodeRegister( Reg64::RAX )
 		.AddImmediate( &BinaryGateFunction )
 		.Emit( this );
+	AddRelocation( Relocation::RL_GATE );
 
 	// call rax
 	Insn()
@@ -578,13 +868,24 @@ void x86Backend::CompileBuffer( size_t chk )
 {
 	msg( E_INFO, E_DEBUG, "Compiling for checksum %zx", chk );
 	Select( chk, true );
-	Clear();
 
 	IMMU* mmu = proc_->MMU();
 	ILogic* logic = proc_->LogicProvider();
 
 	Offsets limits = mmu->QuerySectionLimits();
 
+	// Native code embeds DATA addresses, so the reserved DATA region
+	// shall be materialized before any of them are taken.
+	mmu->MaterializeReservedData();
+
+	if( current_image_->prebuilt ) {
+		msg( E_INFO, E_VERBOSE, "Using the imported image (%zu bytes)", current_image_->data.size() );
+		Finalize();
+		return;
+	}
+
+	Clear();
+
 	msg( E_INFO, E_DEBUG, "Emitting prologue" );
 	CompilePrologue();
 
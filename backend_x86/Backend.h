@@ -38,6 +38,25 @@ class INTERPRETER_X86BACKEND_API x86Backend : public IBackend, public x86backend
 		size_t what; // virtual insn being referenced
 	};
 
+	// An absolute address embedded into the native code (as a 64-bit immediate),
+	// recomputed whenever the image is finalized.
+	struct Relocation
+	{
+		enum RelocationType
+		{
+			RL_DATA, // DATA cell payload; argument is the address
+			RL_REGISTER, // register payload; argument is the register ID
+			RL_BYTEPOOL, // argument is the bytepool offset
+			RL_COMMAND, // virtual command; argument is the insn, addend is the offset into the Command
+			RL_BACKEND, // the backend object
+			RL_IMAGE, // the NativeImage object
+			RL_GATE // BinaryGateFunction()
+		} type;
+		off_t where; // offset in the native buffer where to write the address
+		size_t argument;
+		size_t addend;
+	};
+
 	enum class BinaryFunction : abiret_t
 	{
 		BF_RESOLVEREFERENCE,
@@ -49,6 +68,8 @@ class INTERPRETER_X86BACKEND_API x86Backend : public IBackend, public x86backend
 		llarray data; // primary working buffer
 		std::vector<off_t> insn_offsets; // offsets of the native instructions (per-cmd) in buffer
 		std::vector<ReferencePatch> references;
+		std::vector<Relocation> relocations;
+		bool prebuilt; // imported; finalized without compilation
 		struct // mapped executable region
 		{
 			void* image;
@@ -58,11 +79,17 @@ class INTERPRETER_X86BACKEND_API x86Backend : public IBackend, public x86backend
 	std::map<size_t, NativeImage> images_;
 	size_t current_chk_;
 	NativeImage* current_image_;
+	MemoryCounter image_usage_;
 
 	void Select( size_t chk, bool create = false );
 	void Finalize();
 	void Deallocate();
 	void Clear();
+	void UpdateImageUsage();
+
+	// Record a relocation of the 64-bit immediate ending the last emitted instruction.
+	void AddRelocation( Relocation::RelocationType type, size_t argument = 0, size_t addend = 0 );
+	void* RelocationTarget( const Relocation& relocation );
 
 	virtual llarray& Target();
 	virtual void AddCodeReference( size_t insn, bool relative );
@@ -160,6 +187,10 @@ public:
 	virtual void CompileBuffer( size_t chk );
 	virtual abi_native_fn_t GetImage( size_t chk );
 	virtual bool ImageIsOK( size_t chk );
+	virtual MemoryCounter QueryImageMemory() const;
+	virtual llarray ExportImage( size_t chk );
+	virtual bool ImportImage( size_t chk, const void* image, size_t size );
+	virtual void ReleaseImage( size_t chk );
 };
 
 } // namespace ProcessorImplementation
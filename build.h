@@ -18,6 +18,9 @@
 #include <uXray/fxcrc32.h>
 #include <uXray/fxjitruntime.h>
 
+#include <unordered_map>
+#include <unordered_set>
+
 #ifdef INTERPRETER_STDAFX_H
 # define INTERPRETER_API EXPORT
 # define INTERPRETER_TE
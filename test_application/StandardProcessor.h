@@ -0,0 +1,82 @@
+#ifndef INTERPRETER_TEST_STANDARDPROCESSOR_H
+#define INTERPRETER_TEST_STANDARDPROCESSOR_H
+
+#include "../API.h"
+
+#include <time.h>
+
+/*
+ * A private processor with all the standard modules attached (no I/O handlers, no backend),
+ * for loader threads and benchmarks. Modules are attached in the order of
+ * InterpreterClientApplication::RegisterModules(), so that command IDs are the same.
+ * The owner calls Initialise() once the processor is configured; it is deinitialised on destruction.
+ */
+class StandardProcessor
+{
+	// Modules are declared after the processor to be destroyed (detached) before it.
+	Processor::ProcessorAPI processor_;
+	ProcessorImplementation::MMU mmu_;
+	ProcessorImplementation::UATLinker linker_;
+	ProcessorImplementation::CommandSet_mkI command_set_;
+	ProcessorImplementation::FloatExecutor float_executor_;
+	ProcessorImplementation::IntegerExecutor integer_executor_;
+	ProcessorImplementation::ServiceExecutor service_executor_;
+	ProcessorImplementation::Logic logic_;
+
+	bool initialised_;
+
+public:
+	StandardProcessor() :
+		initialised_( false )
+	{
+		processor_.Attach( &mmu_ );
+		processor_.Attach( &linker_ );
+		processor_.Attach( &command_set_ );
+		processor_.Attach( &float_executor_ );
+		processor_.Attach( &integer_executor_ );
+		processor_.Attach( &service_executor_ );
+		processor_.Attach( &logic_ );
+	}
+
+	~StandardProcessor()
+	{
+		if( initialised_ ) {
+			processor_.Initialise( false );
+		}
+	}
+
+	StandardProcessor( const StandardProcessor& ) = delete;
+	StandardProcessor& operator=( const StandardProcessor& ) = delete;
+
+	Processor::ProcessorAPI& API() { return processor_; }
+
+	void Initialise()
+	{
+		processor_.Initialise();
+		initialised_ = true;
+	}
+
+	// Monotonic time in seconds, for measurements.
+	static double Now()
+	{
+		timespec now;
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		return now.tv_sec + now.tv_nsec * 1e-9;
+	}
+
+	// Create an empty file in /tmp named after "kind"; the caller removes it.
+	static std::string CreateTemporary( const char* kind )
+	{
+		char path[STATIC_LENGTH];
+		snprintf( path, STATIC_LENGTH, "/tmp/%s.XXXXXX", kind );
+
+		int fd = mkstemp( path );
+		s_cassert( fd >= 0, "Could not create a temporary file: %s", strerror( errno ) );
+		close( fd );
+
+		return path;
+	}
+};
+
+#endif // INTERPRETER_TEST_STANDARDPROCESSOR_H
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,180 @@
+#undef __STRICT_ANSI__
+
+#include "StandardProcessor.h"
+
+DeclareDescriptor( AsmBench, , )
+ImplementDescriptor( AsmBench, "assembly benchmark", MOD_APPMODULE )
+
+/*
+ * Assembly front-end benchmark.
+ * Generates a large source file and reports the best throughput of several passes of
+ * - parsing (the reader's decode stream only) and
+ * - loading (parsing, linking and building the context).
+ */
+
+struct Measurement
+{
+	const char* name;
+	double best_seconds;
+};
+
+class AsmBench : LogBase( AsmBench )
+{
+	// Handlers are declared after the processor to be destroyed (detached) before it.
+	StandardProcessor standard_;
+	Processor::ProcessorAPI& processor_;
+	ProcessorImplementation::AsmHandler asm_handler_;
+
+	std::string source_path_;
+	size_t source_bytes_;
+	size_t source_statements_;
+
+	FILE* OpenSource();
+
+public:
+	AsmBench();
+	virtual ~AsmBench();
+
+	void Generate( size_t blocks );
+	double Parse();
+	double Load();
+	void Report( const Measurement& measurement );
+};
+
+AsmBench::AsmBench() :
+	processor_( standard_.API() ),
+	source_bytes_( 0 ),
+	source_statements_( 0 )
+{
+	processor_.Attach( &asm_handler_ );
+	standard_.Initialise();
+}
+
+AsmBench::~AsmBench()
+{
+	if( !source_path_.empty() ) {
+		unlink( source_path_.c_str() );
+	}
+}
+
+FILE* AsmBench::OpenSource()
+{
+	FILE* file = fopen( source_path_.c_str(), "rt" );
+	cassert( file, "Could not open \"%s\": %s", source_path_.c_str(), strerror( errno ) );
+	return file;
+}
+
+void AsmBench::Generate( size_t blocks )
+{
+	source_path_ = StandardProcessor::CreateTemporary( "asmbench" );
+
+	FILE* file = fopen( source_path_.c_str(), "wt" );
+	cassert( file, "Could not open a temporary file: %s", strerror( errno ) );
+
+	// Each block is self-contained: every referenced symbol is defined within it.
+	for( size_t i = 0; i < blocks; ++i ) {
+		fprintf( file,
+		         "decl.i v%zu = %zu\n"
+		         "decl.f w%zu = %zu.5\n"
+		         "decl.i a%zu[16]\n"
+		         "l%zu:\tpush.i %zu\n"
+		         "\tld.i v%zu ; load\n"
+		         "\tst.i $ra\n"
+		         "\tld.f (d:%zu)\n"
+		         "\tadd.i\n"
+		         "\tlea \"string %zu\\n\"\n"
+		         "\tjmp l%zu\n",
+		         i, i, i, i, i, i, i * 7, i, i, i, i );
+	}
+
+	source_statements_ = blocks * 10;
+	source_bytes_ = ftell( file );
+	fclose( file );
+
+	msg( E_INFO, E_USER, "Generated %zu statements (%zu bytes) in \"%s\"",
+	     source_statements_, source_bytes_, source_path_.c_str() );
+}
+
+double AsmBench::Parse()
+{
+	FILE* file = OpenSource();
+	double start = StandardProcessor::Now();
+
+	asm_handler_.RdSetup( file );
+	while( asm_handler_.ReadStream() );
+	asm_handler_.RdReset();
+
+	return StandardProcessor::Now() - start;
+}
+
+double AsmBench::Load()
+{
+	FILE* file = OpenSource();
+	double start = StandardProcessor::Now();
+
+	Processor::ctx_t context = processor_.Load( file );
+
+	double seconds = StandardProcessor::Now() - start;
+	processor_.DeleteContext( context );
+
+	return seconds;
+}
+
+void AsmBench::Report( const Measurement& measurement )
+{
+	msg( E_INFO, E_USER, "%-6s: %8.3f ms, %8.2f MB/s, %10.0f statements/s",
+	     measurement.name, measurement.best_seconds * 1e3,
+	     source_bytes_ / measurement.best_seconds / ( 1 << 20 ),
+	     source_statements_ / measurement.best_seconds );
+}
+
+void usage( const char* name )
+{
+	fprintf( stderr,
+	         "Usage: %s [--debug] [<block count> [<pass count>]]\n"
+	         "Each block is ten statements; by default 100000 blocks are parsed in 5 passes.\n",
+	         name );
+	exit( 1 );
+}
+
+int main( int argc, char** argv )
+{
+	Debug::EventLevelIndex_ debug_level = Debug::E_USER;
+	size_t numbers[2] = { 100000, 5 };
+	size_t numbers_given = 0;
+
+	for( int i = 1; i < argc; ++i ) {
+		if( !strcmp( argv[i], "--debug" ) ) {
+			debug_level = Debug::E_DEBUG;
+		} else if( numbers_given < 2 && ( numbers[numbers_given++] = strtoul( argv[i], nullptr, 0 ) ) ) {
+			continue;
+		} else {
+			usage( argv[0] );
+		}
+	}
+
+	Debug::API::SetDefaultVerbosity( debug_level );
+
+	try {
+		AsmBench bench;
+		bench.Generate( numbers[0] );
+
+		Measurement parse = { "parse", HUGE_VAL }, load = { "load", HUGE_VAL };
+
+		for( size_t pass = 0; pass < numbers[1]; ++pass ) {
+			parse.best_seconds = std::min( parse.best_seconds, bench.Parse() );
+			load.best_seconds = std::min( load.best_seconds, bench.Load() );
+		}
+
+		bench.Report( parse );
+		bench.Report( load );
+	}
+
+	catch( std::exception& e ) {
+		fprintf( stderr, "Benchmark failed: %s\n", e.what() );
+		return 1;
+	}
+
+	return 0;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
@@ -0,0 +1,504 @@
+#undef __STRICT_ANSI__
+
+#include "StandardProcessor.h"
+
+#include <sys/stat.h>
+
+DeclareDescriptor( LoadBench, , )
+ImplementDescriptor( LoadBench, "loading benchmark", MOD_APPMODULE )
+
+using Processor::ctx_t;
+
+/*
+ * Loader and linker scaling benchmark.
+ * Generates a synthetic program of several modules (in assembly and in byte-code)
+ * and reports the best time of several passes of each loading phase:
+ * - parsing the assembly modules (the reader's decode stream only),
+ * - loading the assembly modules (parsing, linking and building the contexts),
+ * - merging the modules into one context,
+ * - writing the merged context as byte-code,
+ * - loading the byte-code modules.
+ * With several steps, the program size is doubled on each step and the growth of each phase is reported,
+ * so that anything worse than linear shows up as a ratio above 2.
+ *
+ * With --compress, the merged image is also written with WO_COMPRESS, and the size of both images
+ * and the best throughput of the section codec over the raw image (as a single block) are reported.
+ */
+
+struct GeneratorParameters
+{
+	size_t modules;
+	size_t commands; // per module
+	size_t symbols; // per module, half data and half labels (aliases not counted)
+	size_t cells; // per module, at least one per data symbol
+	size_t alias_depth; // of the alias chain over every fourth data symbol
+};
+
+struct CodecMeasurement
+{
+	size_t raw_bytes; // of the merged image
+	size_t compressed_bytes; // of the merged image written with WO_COMPRESS
+	size_t block_bytes; // of the raw image compressed as a single block
+	double compress_seconds;
+	double decompress_seconds;
+};
+
+enum Phase
+{
+	PH_PARSE = 0,
+	PH_LOAD_ASM,
+	PH_MERGE,
+	PH_DUMP,
+	PH_LOAD_BYTECODE,
+	PH_MAX
+};
+
+class LoadBench : LogBase( LoadBench )
+{
+	static const size_t alias_stride = 4;
+
+	// Handlers are declared after the processor to be destroyed (detached) before it.
+	StandardProcessor standard_;
+	Processor::ProcessorAPI& processor_;
+	ProcessorImplementation::AsmHandler asm_handler_;
+	ProcessorImplementation::BytecodeHandler bytecode_handler_;
+
+	std::vector<std::string> asm_paths_, bytecode_paths_;
+	std::string dump_path_, compressed_path_;
+
+	size_t total_commands_;
+	size_t total_symbols_;
+
+	static FILE* Open( const std::string& path, const char* mode );
+	static size_t FileSize( const std::string& path );
+	static std::string DataReference( const GeneratorParameters& parameters, size_t module, size_t index );
+
+	void GenerateModule( const GeneratorParameters& parameters, size_t module, FILE* file );
+	double LoadAll( const std::vector<std::string>& paths, Processor::IReader* reader, std::vector<ctx_t>* contexts );
+	void DeleteAll( std::vector<ctx_t>& contexts );
+	void RemoveFiles();
+
+public:
+	LoadBench( size_t jobs );
+	virtual ~LoadBench();
+
+	void Generate( const GeneratorParameters& parameters );
+	void Pass( double* seconds );
+	void MeasureCodec( CodecMeasurement* result );
+
+	size_t TotalCommands() const { return total_commands_; }
+	size_t TotalSymbols() const { return total_symbols_; }
+};
+
+LoadBench::LoadBench( size_t jobs ) :
+	processor_( standard_.API() ),
+	total_commands_( 0 ),
+	total_symbols_( 0 )
+{
+	processor_.SetLinkerJobs( jobs );
+	standard_.Initialise();
+}
+
+LoadBench::~LoadBench()
+{
+	RemoveFiles();
+}
+
+FILE* LoadBench::Open( const std::string& path, const char* mode )
+{
+	FILE* file = fopen( path.c_str(), mode );
+	s_cassert( file, "Could not open \"%s\": %s", path.c_str(), strerror( errno ) );
+	return file;
+}
+
+size_t LoadBench::FileSize( const std::string& path )
+{
+	struct stat info;
+	s_cassert( !stat( path.c_str(), &info ), "Could not stat \"%s\": %s", path.c_str(), strerror( errno ) );
+	return info.st_size;
+}
+
+void LoadBench::RemoveFiles()
+{
+	for( const std::string& path: asm_paths_ ) {
+		unlink( path.c_str() );
+	}
+
+	for( const std::string& path: bytecode_paths_ ) {
+		unlink( path.c_str() );
+	}
+
+	if( !dump_path_.empty() ) {
+		unlink( dump_path_.c_str() );
+	}
+
+	if( !compressed_path_.empty() ) {
+		unlink( compressed_path_.c_str() );
+	}
+
+	asm_paths_.clear();
+	bytecode_paths_.clear();
+	dump_path_.clear();
+	compressed_path_.clear();
+}
+
+// Data symbols with an alias chain are referenced through its last alias.
+std::string LoadBench::DataReference( const GeneratorParameters& parameters, size_t module, size_t index )
+{
+	char name[STATIC_LENGTH];
+
+	if( parameters.alias_depth && !( index % alias_stride ) ) {
+		snprintf( name, STATIC_LENGTH, "m%zu_v%zu_a%zu", module, index, parameters.alias_depth - 1 );
+	} else {
+		snprintf( name, STATIC_LENGTH, "m%zu_v%zu", module, index );
+	}
+
+	return name;
+}
+
+void LoadBench::GenerateModule( const GeneratorParameters& parameters, size_t module, FILE* file )
+{
+	size_t variables = std::max<size_t>( parameters.symbols / 2, 1 );
+	size_t labels = std::min( std::max<size_t>( parameters.symbols - variables, 1 ), parameters.commands );
+	size_t cells = std::max( parameters.cells, variables );
+	size_t filler = ( cells - variables ) / variables;
+
+	// Data symbols are spread over the cells; the rest of the cells are unnamed.
+	for( size_t k = 0; k < variables; ++k ) {
+		fprintf( file, "decl.i m%zu_v%zu = %zu\n", module, k, k );
+		for( size_t i = 0; i < filler; ++i ) {
+			fprintf( file, "decl.i = %zu\n", i );
+		}
+	}
+
+	for( size_t i = variables * ( filler + 1 ); i < cells; ++i ) {
+		fprintf( file, "decl.i = %zu\n", i );
+	}
+
+	for( size_t k = 0; k < variables; k += alias_stride ) {
+		for( size_t depth = 0; depth < parameters.alias_depth; ++depth ) {
+			if( depth ) {
+				fprintf( file, "decl.i m%zu_v%zu_a%zu : m%zu_v%zu_a%zu\n", module, k, depth, module, k, depth - 1 );
+			} else {
+				fprintf( file, "decl.i m%zu_v%zu_a0 : m%zu_v%zu\n", module, k, module, k );
+			}
+		}
+	}
+
+	total_symbols_ += variables + labels + parameters.alias_depth * ( ( variables + alias_stride - 1 ) / alias_stride );
+
+	// Labels are spread over the code; calls go to the next module.
+	size_t next_module = ( module + 1 ) % parameters.modules;
+	size_t next_label = 0;
+
+	for( size_t i = 0; i < parameters.commands; ++i ) {
+		while( next_label < labels && next_label * parameters.commands / labels == i ) {
+			fprintf( file, "m%zu_l%zu:\n", module, next_label++ );
+		}
+
+		size_t k = i / 6;
+		switch( i % 6 ) {
+		case 0:
+			fprintf( file, "\tld.i %s\n", DataReference( parameters, module, k % variables ).c_str() );
+			break;
+
+		case 1:
+			fprintf( file, "\tpush.i %zu\n", i );
+			break;
+
+		case 2:
+			fprintf( file, "\tadd.i\n" );
+			break;
+
+		case 3:
+			fprintf( file, "\tst.i %s\n", DataReference( parameters, module, ( k * 7 ) % variables ).c_str() );
+			break;
+
+		case 4:
+			fprintf( file, "\tcall m%zu_l%zu\n", next_module, k % labels );
+			break;
+
+		case 5:
+			if( k % 4 ) {
+				fprintf( file, "\tjmp m%zu_l%zu\n", module, ( k + 1 ) % labels );
+			} else {
+				fprintf( file, "\tlea \"module %zu string %zu\"\n", module, k );
+			}
+			break;
+
+		default:
+			casshole( "Switch error" );
+			break;
+		}
+	}
+
+	total_commands_ += parameters.commands;
+}
+
+void LoadBench::Generate( const GeneratorParameters& parameters )
+{
+	RemoveFiles();
+	total_commands_ = total_symbols_ = 0;
+
+	for( size_t module = 0; module < parameters.modules; ++module ) {
+		asm_paths_.push_back( StandardProcessor::CreateTemporary( "loadbench-asm" ) );
+		FILE* file = Open( asm_paths_.back(), "wt" );
+		GenerateModule( parameters, module, file );
+		fclose( file );
+	}
+
+	// Byte-code modules are written from the loaded assembly ones.
+	std::vector<ctx_t> contexts;
+	LoadAll( asm_paths_, &asm_handler_, &contexts );
+
+	processor_.Attach( &bytecode_handler_ );
+	for( ctx_t context: contexts ) {
+		bytecode_paths_.push_back( StandardProcessor::CreateTemporary( "loadbench-bc" ) );
+		processor_.Dump( context, Open( bytecode_paths_.back(), "wb" ) );
+	}
+	processor_.Detach( &bytecode_handler_ );
+
+	DeleteAll( contexts );
+	dump_path_ = StandardProcessor::CreateTemporary( "loadbench-dump" );
+	compressed_path_ = StandardProcessor::CreateTemporary( "loadbench-lz" );
+
+	msg( E_INFO, E_USER, "Generated %zu modules: %zu commands, %zu symbols in total",
+	     parameters.modules, total_commands_, total_symbols_ );
+}
+
+double LoadBench::LoadAll( const std::vector<std::string>& paths, Processor::IReader* reader, std::vector<ctx_t>* contexts )
+{
+	processor_.Attach( reader );
+	double start = StandardProcessor::Now();
+
+	for( const std::string& path: paths ) {
+		contexts->push_back( processor_.Load( Open( path, "rb" ) ) );
+	}
+
+	double seconds = StandardProcessor::Now() - start;
+	processor_.Detach( reader );
+
+	return seconds;
+}
+
+void LoadBench::DeleteAll( std::vector<ctx_t>& contexts )
+{
+	for( ctx_t context: contexts ) {
+		processor_.DeleteContext( context );
+	}
+
+	contexts.clear();
+}
+
+void LoadBench::Pass( double* seconds )
+{
+	std::vector<ctx_t> contexts;
+
+	processor_.Attach( &asm_handler_ );
+	double start = StandardProcessor::Now();
+
+	for( const std::string& path: asm_paths_ ) {
+		asm_handler_.RdSetup( Open( path, "rt" ) );
+		while( asm_handler_.ReadStream() );
+		asm_handler_.RdReset();
+	}
+
+	seconds[PH_PARSE] = StandardProcessor::Now() - start;
+	processor_.Detach( &asm_handler_ );
+
+	seconds[PH_LOAD_ASM] = LoadAll( asm_paths_, &asm_handler_, &contexts );
+
+	start = StandardProcessor::Now();
+	ctx_t merged = processor_.MergeContexts( contexts );
+	seconds[PH_MERGE] = StandardProcessor::Now() - start;
+
+	DeleteAll( contexts );
+
+	processor_.Attach( &bytecode_handler_ );
+	start = StandardProcessor::Now();
+	processor_.Dump( merged, Open( dump_path_, "wb" ) );
+	seconds[PH_DUMP] = StandardProcessor::Now() - start;
+	processor_.Detach( &bytecode_handler_ );
+
+	processor_.DeleteContext( merged );
+
+	seconds[PH_LOAD_BYTECODE] = LoadAll( bytecode_paths_, &bytecode_handler_, &contexts );
+	DeleteAll( contexts );
+}
+
+void LoadBench::MeasureCodec( CodecMeasurement* result )
+{
+	std::vector<ctx_t> contexts;
+	LoadAll( asm_paths_, &asm_handler_, &contexts );
+	ctx_t merged = processor_.MergeContexts( contexts );
+	DeleteAll( contexts );
+
+	mask_t writer_options = processor_.WriterOptions();
+	processor_.Attach( &bytecode_handler_ );
+	processor_.SetWriterOptions( writer_options & ~MASK( Processor::WO_COMPRESS ) );
+	processor_.Dump( merged, Open( dump_path_, "wb" ) );
+	processor_.SetWriterOptions( writer_options | MASK( Processor::WO_COMPRESS ) );
+	processor_.Dump( merged, Open( compressed_path_, "wb" ) );
+	processor_.SetWriterOptions( writer_options );
+	processor_.Detach( &bytecode_handler_ );
+
+	processor_.DeleteContext( merged );
+
+	result->raw_bytes = FileSize( dump_path_ );
+	result->compressed_bytes = FileSize( compressed_path_ );
+
+	std::vector<char> image( result->raw_bytes ), block( Processor::Compression::CompressBound( image.size() ) ),
+	                  decoded( image.size() );
+
+	FILE* file = Open( dump_path_, "rb" );
+	size_t read = fread( image.data(), 1, image.size(), file );
+	fclose( file );
+	cassert( read == image.size(), "Could not read \"%s\"", dump_path_.c_str() );
+
+	double start = StandardProcessor::Now();
+	result->block_bytes = Processor::Compression::Compress( image.data(), image.size(), block.data(), block.size() );
+	result->compress_seconds = StandardProcessor::Now() - start;
+	cassert( result->block_bytes, "Could not compress the image" );
+
+	start = StandardProcessor::Now();
+	bool decoded_ok = Processor::Compression::Decompress( block.data(), result->block_bytes, decoded.data(), decoded.size() );
+	result->decompress_seconds = StandardProcessor::Now() - start;
+	cassert( decoded_ok && decoded == image, "Compressed image does not decode to the original" );
+}
+
+void usage( const char* name )
+{
+	fprintf( stderr,
+	         "Usage: %s [--debug] [--compress] [--modules <count>] [--commands <count>] [--symbols <count>]\n"
+	         "[--cells <count>] [--alias-depth <count>] [--jobs <count>] [--passes <count>] [--steps <count>]\n"
+	         "\n"
+	         "* --compress            : also compare the merged image written raw and compressed\n"
+	         "* --modules <count>     : modules of the program (default 8)\n"
+	         "* --commands <count>    : commands per module (default 20000)\n"
+	         "* --symbols <count>     : data symbols and labels per module, half each (default 2000)\n"
+	         "* --cells <count>       : data cells per module (default 4000)\n"
+	         "* --alias-depth <count> : length of the alias chain over every fourth data symbol (default 4)\n"
+	         "* --jobs <count>        : threads to link merged modules on (default 1)\n"
+	         "* --passes <count>      : passes per step; the best time is reported (default 3)\n"
+	         "* --steps <count>       : double the module size this many times less one (default 1)\n",
+	         name );
+	exit( 1 );
+}
+
+int main( int argc, char** argv )
+{
+	static const char* phase_names[PH_MAX] = { "parse", "load", "merge", "dump", "load-bc" };
+
+	Debug::EventLevelIndex_ debug_level = Debug::E_USER;
+	GeneratorParameters parameters = { 8, 20000, 2000, 4000, 4 };
+	size_t jobs = 1, passes = 3, steps = 1;
+	bool compress = false;
+
+	struct Option
+	{
+		const char* name;
+		size_t* value;
+		size_t minimum;
+	} options[] = {
+		{ "--modules", &parameters.modules, 1 },
+		{ "--commands", &parameters.commands, 1 },
+		{ "--symbols", &parameters.symbols, 2 },
+		{ "--cells", &parameters.cells, 1 },
+		{ "--alias-depth", &parameters.alias_depth, 0 },
+		{ "--jobs", &jobs, 1 },
+		{ "--passes", &passes, 1 },
+		{ "--steps", &steps, 1 }
+	};
+
+	for( int i = 1; i < argc; ++i ) {
+		if( !strcmp( argv[i], "--debug" ) ) {
+			debug_level = Debug::E_DEBUG;
+			continue;
+		}
+
+		if( !strcmp( argv[i], "--compress" ) ) {
+			compress = true;
+			continue;
+		}
+
+		Option* option = std::find_if( std::begin( options ), std::end( options ),
+		                               [&]( const Option& candidate ) { return !strcmp( argv[i], candidate.name ); } );
+		if( option == std::end( options ) || ++i == argc ) {
+			usage( argv[0] );
+		}
+
+		*option->value = strtoul( argv[i], nullptr, 0 );
+		if( *option->value < option->minimum ) {
+			usage( argv[0] );
+		}
+	}
+
+	Debug::API::SetDefaultVerbosity( debug_level );
+
+	try {
+		LoadBench bench( jobs );
+		double previous[PH_MAX];
+
+		for( size_t step = 0; step < steps; ++step ) {
+			bench.Generate( parameters );
+
+			double best[PH_MAX];
+			std::fill( std::begin( best ), std::end( best ), HUGE_VAL );
+
+			for( size_t pass = 0; pass < passes; ++pass ) {
+				double seconds[PH_MAX];
+				bench.Pass( seconds );
+
+				for( unsigned phase = 0; phase < PH_MAX; ++phase ) {
+					best[phase] = std::min( best[phase], seconds[phase] );
+				}
+			}
+
+			for( unsigned phase = 0; phase < PH_MAX; ++phase ) {
+				char growth[STATIC_LENGTH] = "";
+				if( step ) {
+					snprintf( growth, STATIC_LENGTH, ", x%.2f", best[phase] / previous[phase] );
+				}
+
+				smsg( E_INFO, E_USER, "%-8s: %9.3f ms, %8.1f ns/command, %8.1f ns/symbol%s",
+				      phase_names[phase], best[phase] * 1e3,
+				      best[phase] * 1e9 / bench.TotalCommands(), best[phase] * 1e9 / bench.TotalSymbols(), growth );
+				previous[phase] = best[phase];
+			}
+
+			if( compress ) {
+				CodecMeasurement codec = { 0, 0, 0, HUGE_VAL, HUGE_VAL };
+
+				for( size_t pass = 0; pass < passes; ++pass ) {
+					CodecMeasurement measurement;
+					bench.MeasureCodec( &measurement );
+
+					codec.raw_bytes = measurement.raw_bytes;
+					codec.compressed_bytes = measurement.compressed_bytes;
+					codec.block_bytes = measurement.block_bytes;
+					codec.compress_seconds = std::min( codec.compress_seconds, measurement.compress_seconds );
+					codec.decompress_seconds = std::min( codec.decompress_seconds, measurement.decompress_seconds );
+				}
+
+				smsg( E_INFO, E_USER, "image   : %zu bytes raw, %zu bytes compressed (%.1f%%)",
+				      codec.raw_bytes, codec.compressed_bytes, 100.0 * codec.compressed_bytes / codec.raw_bytes );
+				smsg( E_INFO, E_USER, "codec   : ratio %.3f, compress %.1f MB/s, decompress %.1f MB/s",
+				      static_cast<double>( codec.block_bytes ) / codec.raw_bytes,
+				      codec.raw_bytes / codec.compress_seconds / ( 1 << 20 ),
+				      codec.raw_bytes / codec.decompress_seconds / ( 1 << 20 ) );
+			}
+
+			parameters.commands *= 2;
+			parameters.symbols *= 2;
+			parameters.cells *= 2;
+		}
+	}
+
+	catch( std::exception& e ) {
+		fprintf( stderr, "Benchmark failed: %s\n", e.what() );
+		return 1;
+	}
+
+	return 0;
+}
+// kate: indent-mode cstyle; indent-width 4; replace-tabs off; tab-width 4;
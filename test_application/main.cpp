@@ -1,6 +1,7 @@
 #undef __STRICT_ANSI__
 
 #include "../API.h"
+#include "StandardProcessor.h"
 
 #include <uXray/fxjitruntime.h>
 #include <uXray/time_ops.h>
@@ -15,6 +16,9 @@ ImplementDescriptor( SDLApplication, "SDL-based UI", MOD_APPMODULE )
 DeclareDescriptor( Timer, , )
 ImplementDescriptor( Timer, "timer helper", MOD_APPMODULE )
 
+DeclareDescriptor( KernelLoader, , )
+ImplementDescriptor( KernelLoader, "kernel loader", MOD_APPMODULE )
+
 using Processor::int_t;
 using Processor::fp_t;
 using Processor::calc_t;
@@ -35,6 +39,17 @@ struct ExecutionParameters
 	std::vector<InputFile> files;
 	const char* dump_bytecode_to;
 	bool no_exec;
+	mask_t linker_options;
+	mask_t writer_options;
+	size_t jobs;
+	bool stream;
+	bool strip;
+	bool eliminate_dead_code;
+	std::vector<std::string> exported_symbols;
+	std::vector<std::pair<size_t, const char*> > replacements; // input file number (from 1) -> new file
+	const char* profile_data_to;
+	const char* reorder_data_by;
+	const char* cache_directory;
 };
 
 struct Statistics {
@@ -72,6 +87,11 @@ Timer* timer = nullptr;
 
 void* timer_threadfunc( void* );
 void timer_cancellation( void* );
+
+// ---- Loader threads
+class KernelLoader;
+
+void* loader_threadfunc( void* argument );
 // ----
 
 class Timer : LogBase( Timer )
@@ -150,6 +170,7 @@ class InterpreterClientApplication : LogBase( ICA )
 
 	Processor::ProcessorAPI processor;
 	StatisticsCollectorLogic* custom_logic;
+	ProcessorImplementation::BytecodeHandler* stream_reader; // kept attached while the kernel is streamed
 	bool is_running;
 	ExecutionParameters* params;
 
@@ -207,6 +228,7 @@ class InterpreterClientApplication : LogBase( ICA )
 	}
 
 public:
+	// Keep in sync with StandardProcessor (used by the loader threads), except for the backend.
 	void RegisterModules() {
 		processor.Attach( new ProcessorImplementation::MMU );
 		processor.Attach( new ProcessorImplementation::UATLinker );
@@ -226,21 +248,81 @@ public:
 	}
 
 	void RegisterCommandHandlers() {
-		processor.CommandSet()->AddCommand( Processor::CommandTraits( "delay", "User: Delay execution for milliseconds", Processor::A_VALUE, true ) );
-		processor.CommandSet()->AddCommandImplementation( "delay", 0, Fcast<void*>( &delay_command ) );
+		AddUserCommands( processor );
+	}
 
-		processor.CommandSet()->AddCommand( Processor::CommandTraits( "rand", "User: Random value", Processor::A_NONE, true ) );
-		processor.CommandSet()->AddCommandImplementation( "rand", 0, Fcast<void*>( &rand_c ) );
+	void LoadFilesParallel( std::vector<InputFile>& files );
 
-		processor.CommandSet()->AddCommand( Processor::CommandTraits( "pi", "User: Get Pi", Processor::A_NONE, false ) );
-		processor.CommandSet()->AddCommandImplementation( "pi", 0, Fcast<void*>( &pi_c ) );
+	static void AddUserCommands( Processor::ProcessorAPI& target ) {
+		target.CommandSet()->AddCommand( Processor::CommandTraits( "delay", "User: Delay execution for milliseconds", Processor::A_VALUE, true ) );
+		target.CommandSet()->AddCommandImplementation( "delay", 0, Fcast<void*>( &delay_command ) );
 
-		processor.CommandSet()->AddCommand( Processor::CommandTraits( "lcm", "User: Least Common Multiple", Processor::A_NONE, false ) );
-		processor.CommandSet()->AddCommandImplementation( "lcm", 0, Fcast<void*>( &lcm_c ) );
+		target.CommandSet()->AddCommand( Processor::CommandTraits( "rand", "User: Random value", Processor::A_NONE, true ) );
+		target.CommandSet()->AddCommandImplementation( "rand", 0, Fcast<void*>( &rand_c ) );
+
+		target.CommandSet()->AddCommand( Processor::CommandTraits( "pi", "User: Get Pi", Processor::A_NONE, false ) );
+		target.CommandSet()->AddCommandImplementation( "pi", 0, Fcast<void*>( &pi_c ) );
+
+		target.CommandSet()->AddCommand( Processor::CommandTraits( "lcm", "User: Least Common Multiple", Processor::A_NONE, false ) );
+		target.CommandSet()->AddCommandImplementation( "lcm", 0, Fcast<void*>( &lcm_c ) );
+	}
+
+	// Load an input file into a new context; assembly files go through the module cache (if set).
+	static ctx_t LoadInputFile( Processor::ProcessorAPI& target, const InputFile& input_file,
+	                            ProcessorImplementation::AsmHandler* asm_handler,
+	                            ProcessorImplementation::BytecodeHandler* bytecode_handler ) {
+		FILE* file = fopen( input_file.filename, "rt" );
+		s_cassert( file, "Could not open file \"%s\" for reading", input_file.filename );
+
+		ctx_t context;
+		std::string cache_entry;
+
+		if( input_file.is_bytecode ) {
+			target.Attach( bytecode_handler );
+			context = target.Load( file );
+			target.Detach( bytecode_handler );
+			return context;
+		}
+
+		if( FILE* cached = target.OpenCachedModule( file, &cache_entry ) ) {
+			bool loaded = false;
+			target.Attach( bytecode_handler );
+
+			try {
+				context = target.Load( cached );
+				loaded = true;
+			}
+
+			// A broken entry is not fatal: it is replaced by the source, loaded below.
+			catch( std::exception& e ) {
+				msg( E_WARNING, E_USER, "Could not load module cache entry for \"%s\": %s", input_file.filename, e.what() );
+				target.DiscardCachedModule( cache_entry );
+			}
+
+			target.Detach( bytecode_handler );
+
+			if( loaded ) {
+				fclose( file );
+				return context;
+			}
+		}
+
+		target.Attach( asm_handler );
+		context = target.Load( file );
+		target.Detach( asm_handler );
+
+		if( !cache_entry.empty() ) {
+			target.Attach( bytecode_handler );
+			target.CacheModule( context, cache_entry );
+			target.Detach( bytecode_handler );
+		}
+
+		return context;
 	}
 
 	InterpreterClientApplication( ExecutionParameters* parameters ) :
 		custom_logic( nullptr ),
+		stream_reader( nullptr ),
 		is_running( false ),
 		params( parameters )
 	{
@@ -262,6 +344,7 @@ public:
 			StopTimer();
 		}
 
+		delete stream_reader;
 		processor.Initialise( false );
 	}
 
@@ -273,30 +356,82 @@ public:
 		custom_logic->ResetStatistics();
 	}
 
+	void DumpMemoryUsage( const char* stage ) {
+		using Processor::MemorySectionIdentifier;
+		using Processor::MemoryCounter;
+
+		ctx_t ctx = processor.CurrentContext().buffer;
+		Processor::MemoryUsage usage = processor.QueryMemoryUsage( ctx );
+
+		msg( E_INFO, E_USER, "Memory usage %s (context %zu): live/peak bytes", stage, ctx );
+
+		for( unsigned i = 0; i < Processor::SEC_STACK_IMAGE; ++i ) {
+			Processor::MemorySectionType type = static_cast<Processor::MemorySectionType>( i );
+			if( type == Processor::SEC_DATA_RESERVE || type == Processor::SEC_NATIVE_IMAGE ||
+			    type == Processor::SEC_SYMBOL_TABLE || type == Processor::SEC_SYMBOL_NAMES ) {
+				continue; // not backed by context memory
+			}
+
+			MemoryCounter counter = usage.at( MemorySectionIdentifier( type ) );
+			msg( E_INFO, E_USER, "  %-24s %zu / %zu", Processor::ProcDebug::Print( type ).c_str(), counter.live, counter.peak );
+		}
+
+		for( unsigned i = 0; i < Processor::Value::V_MAX; ++i ) {
+			Processor::Value::Type type = static_cast<Processor::Value::Type>( i );
+			MemoryCounter counter = usage.at( MemorySectionIdentifier( Processor::SEC_STACK_IMAGE, type ) );
+			msg( E_INFO, E_USER, "  %-24s %zu / %zu",
+			     ( "stack " + Processor::ProcDebug::Print( type ) ).c_str(), counter.live, counter.peak );
+		}
+
+		msg( E_INFO, E_USER, "  %-24s %zu / %zu", "arena", usage.arena.live, usage.arena.peak );
+		msg( E_INFO, E_USER, "  %-24s %zu / %zu", "native images", usage.native_images.live, usage.native_images.peak );
+	}
+
 	void LoadKernel( std::vector<InputFile>& files ) {
 		processor.MMU()->ResetEverything();
+		processor.SetLinkerOptions( params->linker_options );
+		processor.SetLinkerJobs( params->jobs );
+		processor.SetWriterOptions( params->writer_options );
+		processor.SetModuleCache( params->cache_directory );
 
 		msg( E_INFO, E_USER, "Loading processor kernel" );
 
 		ProcessorImplementation::AsmHandler* asm_handler = new ProcessorImplementation::AsmHandler;
 		ProcessorImplementation::BytecodeHandler* bytecode_handler = new ProcessorImplementation::BytecodeHandler;
 
-		{
+		bool streaming = params->stream && files.size() == 1 && files.front().is_bytecode && !params->dump_bytecode_to;
+		if( params->stream && !streaming ) {
+			msg( E_WARNING, E_USER, "Streaming needs a single byte-code file and no dumping; loading normally" );
+		}
+
+		// The debug output of concurrent loaders would be interleaved.
+		bool parallel = params->jobs > 1 && files.size() > 1;
+		if( parallel && params->debug_level == Debug::E_DEBUG ) {
+			msg( E_WARNING, E_USER, "Loading files on a single thread to keep the debug output readable" );
+			parallel = false;
+		}
+
+		if( streaming ) {
+			timeops t( "Kernel loading (until the first code chunk)" );
+			InputFile& input_file = files.front();
+
+			msg( E_INFO, E_USER, "Streaming file \"%s\" (byte-code)", input_file.filename );
+			FILE* file = fopen( input_file.filename, "rt" );
+			cassert( file, "Could not open file \"%s\" for reading", input_file.filename );
+
+			// The rest of the file is loaded during execution.
+			stream_reader = bytecode_handler;
+			bytecode_handler = nullptr;
+			processor.Attach( stream_reader );
+			input_file.context_assigned = processor.LoadStreamBegin( file );
+		} else if( parallel ) {
+			timeops t( "Kernel loading" );
+			LoadFilesParallel( files );
+		} else {
 			timeops t( "Kernel loading" );
 			for( InputFile& input_file: files ) {
 				msg( E_INFO, E_USER, "Loading file \"%s\" (%s)", input_file.filename, input_file.is_bytecode ? "byte-code" : "assembly" );
-				FILE* file = fopen( input_file.filename, "rt" );
-				cassert( file, "Could not open file \"%s\" for reading", input_file.filename );
-
-				if( input_file.is_bytecode ) {
-					processor.Attach( bytecode_handler );
-					input_file.context_assigned = processor.Load( file );
-					processor.Detach( bytecode_handler );
-				} else {
-					processor.Attach( asm_handler );
-					input_file.context_assigned = processor.Load( file );
-					processor.Detach( asm_handler );
-				}
+				input_file.context_assigned = LoadInputFile( processor, input_file, asm_handler, bytecode_handler );
 			}
 		}
 
@@ -318,6 +453,48 @@ public:
 			final_context = files.front().context_assigned;
 		}
 
+		if( !params->replacements.empty() ) {
+			timeops t( "Kernel module replacement" );
+			cassert( files.size() > 1 && !streaming, "Modules can be replaced only in a merged context" );
+
+			for( const std::pair<size_t, const char*>& replacement: params->replacements ) {
+				cassert( replacement.first && replacement.first <= files.size(),
+				         "Invalid input file number to replace: %zu", replacement.first );
+				const InputFile& input_file = files[replacement.first - 1];
+
+				msg( E_INFO, E_USER, "Replacing file \"%s\" with \"%s\"", input_file.filename, replacement.second );
+				FILE* file = fopen( replacement.second, "rt" );
+				cassert( file, "Could not open file \"%s\" for reading", replacement.second );
+
+				// The replacement is of the same kind as the replaced file.
+				Processor::IReader* reader = input_file.is_bytecode ?
+				                             static_cast<Processor::IReader*>( bytecode_handler ) : asm_handler;
+				processor.Attach( reader );
+				processor.ReplaceModule( input_file.context_assigned, file );
+				processor.Detach( reader );
+			}
+		}
+
+		if( params->eliminate_dead_code && !streaming ) {
+			timeops t( "Kernel dead code elimination" );
+			processor.EliminateDeadCode( final_context, params->exported_symbols );
+		}
+
+		if( params->reorder_data_by && !streaming ) {
+			timeops t( "Kernel data reordering" );
+
+			FILE* profile_file = fopen( params->reorder_data_by, "rt" );
+			cassert( profile_file, "Could not open file \"%s\" for reading", params->reorder_data_by );
+
+			processor.ReorderData( final_context, profile_file );
+			fclose( profile_file );
+		}
+
+		if( params->strip && !streaming ) {
+			timeops t( "Kernel stripping" );
+			processor.StripSymbols( final_context, params->exported_symbols );
+		}
+
 		if( params->dump_bytecode_to ) {
 			timeops t( "Kernel dumping" );
 
@@ -338,11 +515,20 @@ public:
 			timeops t( "Kernel JIT-compilation" );
 			processor.Compile();
 		}
+
+		DumpMemoryUsage( "after loading" );
 	}
 
 	void ExecKernelOnce() {
 		Processor::calc_t exec_result;
 
+		if( params->profile_data_to ) {
+			if( params->use_jit ) {
+				msg( E_WARNING, E_USER, "Data accesses of compiled code are not counted" );
+			}
+			processor.LogicProvider()->SetDataProfiling( true );
+		}
+
 		try {
 			msg( E_INFO, E_USER, "Beginning kernel execution" );
 			StartTimer();
@@ -364,6 +550,18 @@ public:
 		StopTimer();
 		msg( E_INFO, E_USER, "Kernel execution completed (result: %s)",
 		     Processor::ProcDebug::PrintValue( exec_result ).c_str() );
+
+		if( params->profile_data_to ) {
+			processor.LogicProvider()->SetDataProfiling( false );
+
+			FILE* profile_file = fopen( params->profile_data_to, "wt" );
+			cassert( profile_file, "Could not open file \"%s\" for writing", params->profile_data_to );
+
+			processor.DumpDataProfile( processor.CurrentContext().buffer, profile_file );
+			fclose( profile_file );
+		}
+
+		DumpMemoryUsage( "after execution" );
 	}
 
 	void TestExecKernel() {
@@ -451,6 +649,155 @@ void Timer::ProcessSingleFrame()
 	DumpResults( &last_interval, &last_capture_stats );
 }
 
+/*
+ * A private processor to load input files on a worker thread.
+ * Its modules and user commands are registered in the same order as the main processor's,
+ * so that command IDs in the program images it exports are valid there.
+ *
+ * The loader itself does not log. Its modules do (at E_VERBOSE and below, apart from errors), and
+ * they are allowed to since every message is emitted by the logger as a whole, whatever the thread.
+ * With E_DEBUG verbosity the files are loaded on the main thread instead (see LoadKernel()).
+ */
+class KernelLoader : LogBase( KernelLoader )
+{
+public:
+	struct Queue
+	{
+		pthread_mutex_t mutex;
+		std::vector<InputFile>* files;
+		std::vector<Processor::program_image_t> images; // one per file
+		size_t next_file;
+		std::string error; // of the first failed file
+	};
+
+private:
+	// Handlers are declared after the processor to be destroyed (detached) before it.
+	StandardProcessor standard_;
+	Processor::ProcessorAPI& processor_;
+	ProcessorImplementation::AsmHandler asm_handler_;
+	ProcessorImplementation::BytecodeHandler bytecode_handler_;
+
+	Queue* queue_;
+	pthread_t thread_;
+
+	bool TakeFile( size_t* index );
+	void LoadFile( size_t index );
+
+public:
+	KernelLoader( Queue* queue, mask_t linker_options, const char* cache_directory );
+
+	void Start();
+	void Join();
+	void Run();
+};
+
+KernelLoader::KernelLoader( Queue* queue, mask_t linker_options, const char* cache_directory ) :
+	processor_( standard_.API() ),
+	queue_( queue )
+{
+	InterpreterClientApplication::AddUserCommands( processor_ );
+	processor_.SetLinkerOptions( linker_options );
+	standard_.Initialise();
+	processor_.SetModuleCache( cache_directory );
+}
+
+void KernelLoader::Start()
+{
+	int result = pthread_create( &thread_, nullptr, &loader_threadfunc, this );
+	cassert( !result, "Could not start a loader thread: %s", strerror( result ) );
+}
+
+void KernelLoader::Join()
+{
+	pthread_join( thread_, nullptr );
+}
+
+bool KernelLoader::TakeFile( size_t* index )
+{
+	pthread_mutex_lock( &queue_->mutex );
+	bool taken = queue_->next_file < queue_->files->size();
+	if( taken ) {
+		*index = queue_->next_file++;
+	}
+	pthread_mutex_unlock( &queue_->mutex );
+
+	return taken;
+}
+
+void KernelLoader::LoadFile( size_t index )
+{
+	InputFile& input_file = queue_->files->at( index );
+	ctx_t context = InterpreterClientApplication::LoadInputFile( processor_, input_file, &asm_handler_, &bytecode_handler_ );
+
+	// Each slot is written by a single loader.
+	queue_->images[index] = processor_.ExportImage( context );
+	processor_.DeleteContext( context );
+}
+
+void KernelLoader::Run()
+{
+	size_t index;
+	while( TakeFile( &index ) ) {
+		try {
+			LoadFile( index );
+		}
+
+		catch( std::exception& e ) {
+			pthread_mutex_lock( &queue_->mutex );
+			if( queue_->error.empty() ) {
+				queue_->error = std::string( "Could not load \"" ) + queue_->files->at( index ).filename + "\": " + e.what();
+			}
+			queue_->next_file = queue_->files->size(); // stop the other loaders
+			pthread_mutex_unlock( &queue_->mutex );
+			return;
+		}
+	}
+}
+
+void* loader_threadfunc( void* argument )
+{
+	reinterpret_cast<KernelLoader*>( argument )->Run();
+	return nullptr;
+}
+
+void InterpreterClientApplication::LoadFilesParallel( std::vector<InputFile>& files )
+{
+	size_t jobs = std::min( params->jobs, files.size() );
+	msg( E_INFO, E_USER, "Loading %zu files on %zu threads", files.size(), jobs );
+	for( const InputFile& input_file: files ) {
+		msg( E_INFO, E_USER, "Loading file \"%s\" (%s)", input_file.filename, input_file.is_bytecode ? "byte-code" : "assembly" );
+	}
+
+	KernelLoader::Queue queue;
+	pthread_mutex_init( &queue.mutex, nullptr );
+	queue.files = &files;
+	queue.images.resize( files.size() );
+	queue.next_file = 0;
+
+	// Loaders are created on this thread: module registration is not thread-safe.
+	std::vector<KernelLoader*> loaders;
+	for( size_t i = 0; i < jobs; ++i ) {
+		loaders.push_back( new KernelLoader( &queue, params->linker_options, params->cache_directory ) );
+	}
+
+	for( KernelLoader* loader: loaders ) {
+		loader->Start();
+	}
+
+	for( KernelLoader* loader: loaders ) {
+		loader->Join();
+		delete loader;
+	}
+
+	pthread_mutex_destroy( &queue.mutex );
+	cassert( queue.error.empty(), "%s", queue.error.c_str() );
+
+	// Instantiate in the order of the files, so that the merged layout does not depend on scheduling.
+	for( size_t i = 0; i < files.size(); ++i ) {
+		files[i].context_assigned = processor.Instantiate( queue.images[i] );
+	}
+}
+
 Timer::Timer() :
 last_capture_time( static_cast<unsigned long>( 0 ) ),
 last_interval( static_cast<unsigned long>( 0 ) )
@@ -504,14 +851,30 @@ void usage( const char* name )
 {
 	fprintf( stderr,
 		     "Usage: %s [--use-jit] [--use-timer] [--quiet|--debug]\n"
-			           "[--asm <assembly files...>] [--bytecode <bytecode files...>] [--dump-to <target bytecode file>]\n"
+			           "[--merge-strings] [--jobs <count>] [--asm <assembly files...>] [--bytecode <bytecode files...>] [--dump-to <target bytecode file>] [--compress] [--native] [--stream] [--lazy]\n"
+			           "[--gc] [--strip [--keep-names]] [--export <symbol>...] [--replace <number> <file>...]\n"
+			           "[--profile-data <file>] [--reorder-data <file>] [--cache <directory>]\n"
 					   "\n"
 					   "* --use-jit                        : enable JIT compilation\n"
 					   "* --use-timer                      : enable periodic statistics dump\n"
 					   "* --quiet, --debug                 : manipulate log verbosity (NOTE: timer output is not visible with --quiet)\n"
+					   "* --merge-strings                  : intern identical strings in the bytepool when linking\n"
+					   "* --jobs <count>                   : load and link input files on this many threads (default 1)\n"
 					   "* --asm <assembly files...>        : any number of input files in assembly\n"
 					   "* --bytecode <bytecode files...>   : any number of input files in binary form\n"
 					   "* --dump-to <target bytecode file> : dump the byte-code (after loading and combining) to a file\n"
+					   "* --compress                       : compress the dumped byte-code sections where it pays off\n"
+					   "* --native                         : embed the compiled native code into the dumped byte-code (requires JIT)\n"
+					   "* --stream                         : start executing a single byte-code file before it is loaded completely\n"
+					   "* --lazy                           : read data of byte-code files on first access\n"
+					   "* --strip                          : drop symbols not needed to run the program (and names of the dumped ones)\n"
+					   "* --gc                             : drop code and data which cannot be reached from the entry point\n"
+					   "* --export <symbol>                : keep the given symbol (and what it refers to) with --strip and --gc\n"
+					   "* --keep-names                     : write the names of the dumped symbols when stripping\n"
+					   "* --replace <number> <file>        : after merging, replace the given input file (counting from 1) with another one\n"
+					   "* --profile-data <file>            : count data accesses while executing and save them by symbol to a file\n"
+					   "* --reorder-data <file>            : after linking, place the data most accessed in a saved profile first\n"
+					   "* --cache <directory>              : keep byte-code of the assembly files in a directory and load it while they are unchanged\n"
 					   "* --no-exec                        : do not execute code (only load and dump, if asked)\n",
 			 name );
 
@@ -530,6 +893,15 @@ int main( int argc, char** argv )
 	params.use_timer = false;
 	params.dump_bytecode_to = nullptr;
 	params.no_exec = false;
+	params.linker_options = 0;
+	params.writer_options = 0;
+	params.jobs = 1;
+	params.stream = false;
+	params.strip = false;
+	params.eliminate_dead_code = false;
+	params.profile_data_to = nullptr;
+	params.reorder_data_by = nullptr;
+	params.cache_directory = nullptr;
 
 	bool current_is_bytecode = false;
 	for( int i = 1; i < argc; ++i ) {
@@ -551,6 +923,57 @@ int main( int argc, char** argv )
 			params.dump_bytecode_to = argv[++i];
 		} else if( !strcmp(parameter, "--no-exec") ) {
 			params.no_exec = true;
+		} else if( !strcmp( parameter, "--merge-strings" ) ) {
+			params.linker_options |= MASK( Processor::LO_MERGE_STRINGS );
+		} else if( !strcmp( parameter, "--compress" ) ) {
+			params.writer_options |= MASK( Processor::WO_COMPRESS );
+		} else if( !strcmp( parameter, "--native" ) ) {
+			params.writer_options |= MASK( Processor::WO_NATIVE_IMAGE );
+		} else if( !strcmp( parameter, "--stream" ) ) {
+			params.stream = true;
+		} else if( !strcmp( parameter, "--lazy" ) ) {
+			params.linker_options |= MASK( Processor::LO_LAZY_SECTIONS );
+		} else if( !strcmp( parameter, "--strip" ) ) {
+			params.strip = true;
+			params.writer_options |= MASK( Processor::WO_STRIP_SYMBOLS );
+		} else if( !strcmp( parameter, "--gc" ) ) {
+			params.eliminate_dead_code = true;
+		} else if( !strcmp( parameter, "--export" ) ) {
+			if( ++i == argc ) {
+				usage( argv[0] );
+			}
+			params.exported_symbols.push_back( argv[i] );
+		} else if( !strcmp( parameter, "--replace" ) ) {
+			if( i + 2 >= argc ) {
+				usage( argv[0] );
+			}
+			size_t number = strtoul( argv[++i], nullptr, 0 );
+			params.replacements.push_back( std::make_pair( number, argv[++i] ) );
+		} else if( !strcmp( parameter, "--profile-data" ) ) {
+			if( ++i == argc ) {
+				usage( argv[0] );
+			}
+			params.profile_data_to = argv[i];
+		} else if( !strcmp( parameter, "--reorder-data" ) ) {
+			if( ++i == argc ) {
+				usage( argv[0] );
+			}
+			params.reorder_data_by = argv[i];
+		} else if( !strcmp( parameter, "--cache" ) ) {
+			if( ++i == argc ) {
+				usage( argv[0] );
+			}
+			params.cache_directory = argv[i];
+		} else if( !strcmp( parameter, "--keep-names" ) ) {
+			params.writer_options |= MASK( Processor::WO_SYMBOL_NAMES );
+		} else if( !strcmp( parameter, "--jobs" ) ) {
+			if( ++i == argc ) {
+				usage( argv[0] );
+			}
+			params.jobs = strtoul( argv[i], nullptr, 0 );
+			if( !params.jobs ) {
+				usage( argv[0] );
+			}
 		} else if( !strcmp( parameter, "--help" ) ) {
 			usage( argv[0] );
 		} else if( !strncmp( parameter, "--", 2 ) ) {